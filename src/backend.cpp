@@ -14,14 +14,18 @@
 
 #include "backend.h"
 #include "butil.h"
+#include "channel_registry.h"
+#include "utils.h"
 
 namespace uskit {
 
-Backend::Backend() : _channel(std::make_shared<BRPC_NAMESPACE::Channel>()) {}
+Backend::Backend() :
+        _is_dynamic(false),
+        _redis_pipeline(false) {}
 
 Backend::~Backend() {}
 
-int Backend::init(const BackendConfig& config) {
+int Backend::init(const BackendConfig& config, const std::string& usid) {
     // Setup backend channel options
     BRPC_NAMESPACE::ChannelOptions options;
     const std::string& protocol = config.protocol();
@@ -42,14 +46,68 @@ int Backend::init(const BackendConfig& config) {
     if (config.has_load_balancer()) {
         load_balancer = config.load_balancer();
     }
+    _usid = usid;
     _is_dynamic = config.is_dynamic();
+    _redis_pipeline = config.redis_pipeline() && protocol == "redis";
 
-    // Initialize backend channel
-    if (_channel->Init(config.server().c_str(), load_balancer.c_str(), &options) != 0) {
+    // Obtain backend channel, shared with other backends of the same settings
+    _server = config.server();
+    _load_balancer = load_balancer;
+    _channel = ChannelRegistry::instance().get(_server, _load_balancer, options);
+    if (!_channel) {
         LOG(ERROR) << "Failed to initialize channel of backend [" << config.name() << "]";
         return -1;
     }
 
+    // Initialize channel pool for dynamic hosts
+    _host_channel_pool.reset(new HostChannelPool);
+    if (_host_channel_pool->init(options, config.max_host_channels(),
+                config.host_channel_idle_timeout_s() * 1000L) != 0) {
+        LOG(ERROR) << "Failed to initialize host channel pool of backend [" << config.name() << "]";
+        return -1;
+    }
+
+    // Load protobuf schema
+    if (config.proto_descriptor_size() > 0) {
+        _proto_schema.reset(new ProtoSchema);
+        if (_proto_schema->init(config.proto_descriptor()) != 0) {
+            LOG(ERROR) << "Failed to load proto descriptors of backend [" << config.name() << "]";
+            return -1;
+        }
+    }
+
+    if (config.has_prewarm()) {
+        _prewarm_config.reset(new PrewarmConfig(config.prewarm()));
+    }
+
+    // Initialize retry budget
+    if (config.has_retry_budget()) {
+        _retry_budget.reset(new RetryBudget);
+        if (_retry_budget->init(config.name(), config.retry_budget()) != 0) {
+            LOG(ERROR) << "Failed to initialize retry budget of backend [" << config.name() << "]";
+            return -1;
+        }
+    }
+
+    // Initialize circuit breaker
+    if (config.has_circuit_breaker()) {
+        _circuit_breaker.reset(new CircuitBreaker);
+        if (_circuit_breaker->init(_usid, config.name(), config.circuit_breaker()) != 0) {
+            LOG(ERROR) << "Failed to initialize circuit breaker of backend [" << config.name() << "]";
+            return -1;
+        }
+    }
+
+    // Initialize concurrency limiter
+    if (config.has_concurrency_limiter()) {
+        _concurrency_limiter.reset(new ConcurrencyLimiter);
+        if (_concurrency_limiter->init(_usid, config.name(), config.concurrency_limiter()) != 0) {
+            LOG(ERROR) << "Failed to initialize concurrency limiter of backend ["
+                       << config.name() << "]";
+            return -1;
+        }
+    }
+
     // Initialize request config template
     for (int i = 0; i < config.request_template_size(); ++i) {
         const RequestConfig& request_template = config.request_template(i);
@@ -62,6 +120,8 @@ int Backend::init(const BackendConfig& config) {
             }
         } else if (protocol == "redis") {
             request_config.reset(new RedisRequestConfig);
+        } else if (protocol == "baidu_std" || protocol == "h2:grpc") {
+            request_config.reset(new ProtobufRequestConfig);
         } else {
             LOG(ERROR) << "Unknown protocol [" << protocol << "]";
             return -1;
@@ -72,6 +132,9 @@ int Backend::init(const BackendConfig& config) {
             return -1;
         }
         _request_config_template_map.emplace(request_template.name(), std::move(request_config));
+        if (refers_flow_results(request_template)) {
+            _flow_reading_request_templates.insert(request_template.name());
+        }
     }
 
     // Initialize response config template
@@ -98,10 +161,54 @@ std::shared_ptr<BRPC_NAMESPACE::Channel> Backend::channel() const {
     return _channel;
 }
 
+std::shared_ptr<BRPC_NAMESPACE::Channel> Backend::retry_channel(
+        const ServiceRetryPolicy* retry_policy) const {
+    BRPC_NAMESPACE::ChannelOptions options = _channel->options();
+    options.retry_policy = retry_policy;
+    options.max_retry = retry_policy->max_retry();
+    return ChannelRegistry::instance().get(_server, _load_balancer, options);
+}
+
+RetryBudget* Backend::retry_budget() const {
+    return _retry_budget.get();
+}
+
+const std::string& Backend::server() const {
+    return _server;
+}
+
+const std::string& Backend::usid() const {
+    return _usid;
+}
+
 bool Backend::is_dynamic() const {
     return _is_dynamic;
 }
 
+bool Backend::redis_pipeline() const {
+    return _redis_pipeline;
+}
+
+CircuitBreaker* Backend::circuit_breaker() const {
+    return _circuit_breaker.get();
+}
+
+ConcurrencyLimiter* Backend::concurrency_limiter() const {
+    return _concurrency_limiter.get();
+}
+
+HostChannelPool* Backend::host_channel_pool() const {
+    return _host_channel_pool.get();
+}
+
+ProtoSchema* Backend::proto_schema() const {
+    return _proto_schema.get();
+}
+
+const PrewarmConfig* Backend::prewarm_config() const {
+    return _prewarm_config.get();
+}
+
 const BRPC_NAMESPACE::AdaptiveProtocolType Backend::protocol() const {
     const BRPC_NAMESPACE::AdaptiveProtocolType protocol = _channel->options().protocol;
     return protocol;
@@ -115,6 +222,10 @@ const BackendRequestConfig* Backend::request_config(const std::string& name) con
     }
 }
 
+bool Backend::request_config_reads_flow(const std::string& name) const {
+    return _flow_reading_request_templates.find(name) != _flow_reading_request_templates.end();
+}
+
 const BackendResponseConfig* Backend::response_config(const std::string& name) const {
     if (_response_config_template_map.find(name) != _response_config_template_map.end()) {
         return &_response_config_template_map.at(name);
@@ -18,8 +18,14 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include "brpc.h"
 #include "dynamic_config.h"
+#include "circuit_breaker.h"
+#include "concurrency_limiter.h"
+#include "host_channel_pool.h"
+#include "proto_schema.h"
+#include "retry_policy.h"
 
 namespace uskit {
 
@@ -34,36 +40,91 @@ public:
     Backend();
     Backend(Backend&&) = default;
     ~Backend();
-    // Initialize backend from configuration.
+    // Initialize backend from configuration of `usid'. Metrics are exposed
+    // with `usid' in name, or not exposed if `usid' is empty, i.e. config
+    // carried by request.
     // Returns 0 on success, -1 otherwise.
-    int init(const BackendConfig& config);
+    int init(const BackendConfig& config, const std::string& usid);
 
     // Obtain the channel associated with this backend.
     std::shared_ptr<BRPC_NAMESPACE::Channel> channel() const;
+    // Obtain a channel to the same servers which retries calls with
+    // `retry_policy', used by services with their own retry policy.
+    // Returns nullptr on failure.
+    std::shared_ptr<BRPC_NAMESPACE::Channel> retry_channel(
+            const ServiceRetryPolicy* retry_policy) const;
     // Obtain the protocol associated with this backend.
-    // Currently supported protocols: HTTP, Redis.
+    // Currently supported protocols: HTTP, Redis, baidu_std and gRPC(h2:grpc).
     const BRPC_NAMESPACE::AdaptiveProtocolType protocol() const;
     // Obtain a request config template with given name.
     // Returns nullptr if not found.
     const BackendRequestConfig* request_config(const std::string& name) const;
+    // Whether request config template with given name refers to `$backend'
+    // or `$result'.
+    bool request_config_reads_flow(const std::string& name) const;
     // Obtain a response config template with given name.
     // Returns nullptr if not found.
     const BackendResponseConfig* response_config(const std::string& name) const;
     // Obtain all service names associated with this backend.
     const std::vector<std::string>& services() const;
+    // Obtain the server address or naming service url of channel.
+    const std::string& server() const;
+    // Obtain the usid this backend belongs to, empty for config carried by
+    // request.
+    const std::string& usid() const;
     bool is_dynamic() const;
+    // Whether commands of services within one recall are pipelined.
+    bool redis_pipeline() const;
+    // Obtain the circuit breaker of this backend.
+    // Returns nullptr if circuit breaker is not configured.
+    CircuitBreaker* circuit_breaker() const;
+    // Obtain the concurrency limiter of this backend.
+    // Returns nullptr if concurrency limiter is not configured.
+    ConcurrencyLimiter* concurrency_limiter() const;
+    // Obtain the pool of channels to hosts decided at runtime.
+    HostChannelPool* host_channel_pool() const;
+    // Obtain the protobuf schema loaded from proto descriptors.
+    // Returns nullptr if no descriptor is configured.
+    ProtoSchema* proto_schema() const;
+    // Obtain the retry budget shared by all services of this backend.
+    // Returns nullptr if retry budget is not configured.
+    RetryBudget* retry_budget() const;
+    // Obtain the prewarm configuration.
+    // Returns nullptr if prewarm is not configured.
+    const PrewarmConfig* prewarm_config() const;
 
 private:
     // Underlying Channel
     std::shared_ptr<BRPC_NAMESPACE::Channel> _channel;
+    // Server and load balancer of channel
+    std::string _server;
+    std::string _load_balancer;
     // Backend services
     std::vector<std::string> _services;
+    // Usid of configuration
+    std::string _usid;
     // Dynamic requests FLAG, default is false
     bool _is_dynamic;
+    // Redis pipeline FLAG, default is false
+    bool _redis_pipeline;
+    // Circuit breaker shared by all services of this backend
+    std::unique_ptr<CircuitBreaker> _circuit_breaker;
+    // Concurrency limiter shared by all services of this backend
+    std::unique_ptr<ConcurrencyLimiter> _concurrency_limiter;
+    // Channels to hosts decided at runtime
+    std::unique_ptr<HostChannelPool> _host_channel_pool;
+    // Schema of protobuf services on this backend
+    std::unique_ptr<ProtoSchema> _proto_schema;
+    // Connection prewarm options
+    std::unique_ptr<PrewarmConfig> _prewarm_config;
+    // Retry budget shared by all services of this backend
+    std::unique_ptr<RetryBudget> _retry_budget;
 
     // Request config templates
     std::unordered_map<std::string, std::unique_ptr<BackendRequestConfig>>
             _request_config_template_map;
+    // Request config templates referring to `$backend' or `$result'
+    std::unordered_set<std::string> _flow_reading_request_templates;
     // Response config templates
     std::unordered_map<std::string, BackendResponseConfig> _response_config_template_map;
 };
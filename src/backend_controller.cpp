@@ -12,29 +12,129 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <errno.h>
+#include <algorithm>
+#include <cmath>
 #include "backend_controller.h"
 #include "backend_service.h"
+#include "bthread.h"
+#include "flow_context_array.h"
+#include "redis_pipeline.h"
 #include "utils.h"
 
 namespace uskit {
 
-BackendController::BackendController(
+BackendController::BackendController() :
+        _flow_context_array(nullptr),
+        _service(nullptr),
+        _context("backend_controller"),
+        _priority(0),
+        _fallback(false),
+        _rejected(false),
+        _request_built(false),
+        _breaker_permitted(false),
+        _concurrency_acquired(false),
+        _response(&_context.allocator()),
+        _call_start_us(0),
+        _call_done(this) {}
+
+BackendController::~BackendController() {
+    // Calls which are never joined still hold their breaker permits and
+    // concurrency slots.
+    if (_service != nullptr) {
+        _service->on_call_abort(this);
+    }
+}
+
+void BackendController::bind(
         const BackendService* service,
-        expression::ExpressionContext& context) :
-        _service(service),
-        _context("backend_controller", context),
-        _response(&_context.allocator()) {}
+        expression::ExpressionContext& context) {
+    _service = service;
+    _context.reset("backend_controller", context);
+    BackendResponse response(&_context.allocator());
+    _response.Swap(response);
+    _trace = current_trace();
+}
+
+void BackendController::reset() {
+    // Early returns of backend engine leave issued calls unjoined.
+    if (_request_built) {
+        join();
+        _request_built = false;
+    }
+    if (_service != nullptr) {
+        _service->on_call_abort(this);
+        _service = nullptr;
+    }
+    // Values are owned by allocator of parent context and are not freed here.
+    _response.SetNull();
+    _done.reset();
+    _brpc_cntl.Reset();
+    _flow_context_array = nullptr;
+    _service_context_index.reset();
+    _call_ids_ptr.reset();
+    _flow_name.clear();
+    _cntls_call_ids.clear();
+    _cancel_order.clear();
+    _priority = 0;
+    _recall_next.clear();
+    _fallback = false;
+    _rejected = false;
+    _breaker_permitted = false;
+    _concurrency_acquired = false;
+    _trace.reset();
+    _call_start_us = 0;
+}
+
+void HttpController::recycle() {
+    ObjectPool<HttpController>::instance().put(this);
+}
+
+void ProtobufController::reset() {
+    BackendController::reset();
+    _pb_request.reset();
+    _pb_response.reset();
+}
 
-BackendController::~BackendController() {}
+void ProtobufController::recycle() {
+    ObjectPool<ProtobufController>::instance().put(this);
+}
+
+void RedisController::reset() {
+    BackendController::reset();
+    _redis_response.Clear();
+    _pipeline.reset();
+    _reply_begin = 0;
+    _reply_count = 0;
+}
+
+void RedisController::recycle() {
+    ObjectPool<RedisController>::instance().put(this);
+}
 
 int BackendController::build_request(const policy::FlowPolicy* flow_policy) {
     _done = build_controller_closure(_cancel_order, this, flow_policy);
     if (_service->build_request(this) != 0) {
         return -1;
     }
+    _request_built = true;
+    if (_trace) {
+        _call_start_us = BUTIL_NAMESPACE::gettimeofday_us();
+    }
     return 0;
 }
 
+void BackendController::release_concurrency() {
+    _service->release_concurrency(this);
+}
+
+void BackendController::CallDoneClosure::Run() {
+    _cntl->release_concurrency();
+    if (_cntl->_done) {
+        _cntl->_done->Run();
+    }
+}
+
 int BackendController::parse_response() {
     // Parse response with policy of associated backend service
     if (_service->parse_response(this) != 0) {
@@ -44,7 +144,7 @@ int BackendController::parse_response() {
 }
 
 int BackendController::set_call_ids(const std::vector<CallIdPriorityPair>& call_ids) {
-    _cntls_call_ids = std::vector<CallIdPriorityPair>(call_ids.begin(), call_ids.end());
+    _cntls_call_ids.assign(call_ids.begin(), call_ids.end());
     return 0;
 }
 
@@ -90,8 +190,171 @@ bool BackendController::failed() {
     return brpc_controller().Failed();
 }
 
+BRPC_NAMESPACE::CallId BackendController::call_id() {
+    return brpc_controller().call_id();
+}
+
 int BackendController::run_service_suc_flag(bool& bool_value) {
-    return _service->run_success_flag(_context, bool_value);
+    if (_flow_context_array == nullptr) {
+        return _service->run_success_flag(_context, bool_value);
+    }
+    // Own `backend' of service context hides the snapshot's.
+    USResponse document(rapidjson::kObjectType);
+    expression::ExpressionContext view("success flag context", _context, document.GetAllocator());
+    rapidjson::Value backend = FlowContextArray::backend_view(*_context.parent(), view.allocator());
+    view.set_variable("backend", backend);
+    return _service->run_success_flag(view, bool_value);
+}
+
+void BackendController::on_call_end() {
+    _service->on_call_end(this);
+    if (!_trace) {
+        return;
+    }
+    TraceSpan span{"rpc(" + service_name() + ")", "rpc", _call_start_us,
+                   _call_start_us + get_latency_us(), bthread_self(), {}};
+    span.args.emplace_back("failed", failed() ? "true" : "false");
+    if (_fallback) {
+        span.args.emplace_back("fallback", "true");
+    }
+    span.args.emplace_back(
+            "remote_side", BUTIL_NAMESPACE::endpoint2str(_brpc_cntl.remote_side()).c_str());
+    // Span ids propagated to backend link this call to its rpcz spans.
+    const std::string* trace_id = _brpc_cntl.http_request().GetHeader("x-bd-trace-id");
+    const std::string* span_id = _brpc_cntl.http_request().GetHeader("x-bd-span-id");
+    if (trace_id != nullptr && span_id != nullptr) {
+        span.args.emplace_back("rpcz_trace_id", *trace_id);
+        span.args.emplace_back("rpcz_span_id", *span_id);
+    }
+    _trace->add_span(std::move(span));
+}
+
+int RedisController::join() {
+    // Commands of an unflushed pipeline are never sent.
+    if (_pipeline && !_pipeline->flushed()) {
+        return 0;
+    }
+    BRPC_NAMESPACE::Join(call_id());
+    return 0;
+}
+
+int64_t RedisController::get_latency_us() {
+    if (_pipeline) {
+        return _pipeline->latency_us();
+    }
+    return brpc_controller().latency_us();
+}
+
+BRPC_NAMESPACE::CallId RedisController::call_id() {
+    if (_pipeline) {
+        return _pipeline->call_id();
+    }
+    return brpc_controller().call_id();
+}
+
+int RedisController::reply_size() const {
+    if (_pipeline) {
+        return _reply_count;
+    }
+    return _redis_response.reply_size();
+}
+
+const BRPC_NAMESPACE::RedisReply& RedisController::reply(int index) const {
+    if (_pipeline) {
+        return _pipeline->response().reply(_reply_begin + index);
+    }
+    return _redis_response.reply(index);
+}
+
+void DynamicHTTPController::reset() {
+    BackendController::reset();
+    // Sub-call controllers go back to their own pool.
+    _brpc_cntls_list.clear();
+    _fanout_channel.reset();
+    _next_to_issue = 0;
+    _cancelled = false;
+    _finished = 0;
+    _fanout_start_us = 0;
+    _fanout_end_us = 0;
+    _fanout_stats = FanoutStats();
+    _fanout_stats_ready = false;
+    _fanout_dones.clear();
+}
+
+void DynamicHTTPController::recycle() {
+    ObjectPool<DynamicHTTPController>::instance().put(this);
+}
+
+void DynamicHTTPController::start_fanout(
+        const std::shared_ptr<BRPC_NAMESPACE::Channel>& channel,
+        size_t max_concurrency) {
+    _fanout_channel = channel;
+    const size_t total = _brpc_cntls_list.size();
+    if (max_concurrency == 0 || max_concurrency > total) {
+        max_concurrency = total;
+    }
+    // Closures must not move once calls are issued.
+    _fanout_dones.reserve(total);
+    for (size_t i = 0; i < total; ++i) {
+        _fanout_dones.emplace_back(this, i);
+    }
+    {
+        std::lock_guard<std::mutex> lock(_fanout_mutex);
+        _next_to_issue = max_concurrency;
+        _fanout_start_us = BUTIL_NAMESPACE::gettimeofday_us();
+        _fanout_end_us = _fanout_start_us;
+    }
+    for (size_t i = 0; i < max_concurrency; ++i) {
+        issue(i);
+    }
+}
+
+void DynamicHTTPController::issue(size_t index) {
+    // Call ids of pending calls are valid before issuing, so join works as usual.
+    _fanout_channel->CallMethod(
+            nullptr, _brpc_cntls_list[index].get(), nullptr, nullptr, &_fanout_dones[index]);
+}
+
+void DynamicHTTPController::FanoutClosure::Run() {
+    // Canceling by call id is dropped for calls not issued yet, so pending
+    // calls are not issued after the fan-out is canceled.
+    const bool cancelled = _cntl->_brpc_cntls_list[_index]->ErrorCode() == ECANCELED ||
+            (_cntl->_call_ids_ptr && _cntl->_call_ids_ptr->get_is_ready());
+    size_t next_begin = 0;
+    size_t next_end = 0;
+    bool drain = false;
+    bool last = false;
+    {
+        std::lock_guard<std::mutex> lock(_cntl->_fanout_mutex);
+        _cntl->_fanout_end_us = BUTIL_NAMESPACE::gettimeofday_us();
+        _cntl->_cancelled = _cntl->_cancelled || cancelled;
+        drain = _cntl->_cancelled;
+        const size_t total = _cntl->_brpc_cntls_list.size();
+        next_begin = _cntl->_next_to_issue;
+        if (drain) {
+            _cntl->_next_to_issue = total;
+        } else if (_cntl->_next_to_issue < total) {
+            ++_cntl->_next_to_issue;
+        }
+        next_end = _cntl->_next_to_issue;
+        last = ++_cntl->_finished == total;
+    }
+    if (drain) {
+        // brpc ends calls failed before issuing without sending them, which
+        // runs their closures and destroys their call ids.
+        for (size_t i = next_begin; i < next_end; ++i) {
+            _cntl->_brpc_cntls_list[i]->SetFailed(ECANCELED, "Fan-out is canceled");
+            _cntl->issue(i);
+        }
+    } else if (next_end > next_begin) {
+        _cntl->issue(next_begin);
+    }
+    if (last) {
+        _cntl->release_concurrency();
+    }
+    if (_cntl->_done) {
+        _cntl->_done->Run();
+    }
 }
 
 int DynamicHTTPController::join() {
@@ -103,15 +366,54 @@ int DynamicHTTPController::join() {
 }
 
 int64_t DynamicHTTPController::get_latency_us() {
-    int64_t latency_time = 0;
-    for (auto brpc_iter = brpc_controller_list().begin(); brpc_iter != brpc_controller_list().end();
-         ++brpc_iter) {
-        latency_time += brpc_iter->get()->latency_us() / 1000;
+    std::lock_guard<std::mutex> lock(_fanout_mutex);
+    return _fanout_end_us - _fanout_start_us;
+}
+
+// Nearest-rank percentile of sorted latencies.
+static int64_t latency_percentile(const std::vector<int64_t>& sorted_us, double ratio) {
+    if (sorted_us.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(ratio * sorted_us.size()));
+    rank = std::max<size_t>(rank, 1);
+    return sorted_us[std::min(rank, sorted_us.size()) - 1];
+}
+
+const FanoutStats& DynamicHTTPController::fanout_stats() {
+    if (_fanout_stats_ready) {
+        return _fanout_stats;
     }
-    return latency_time;
+    _fanout_stats_ready = true;
+    FanoutStats& stats = _fanout_stats;
+    stats.total = static_cast<int>(_brpc_cntls_list.size());
+    stats.wall_us = get_latency_us();
+    stats.latencies_us.reserve(_brpc_cntls_list.size());
+    for (auto& brpc_cntl : _brpc_cntls_list) {
+        if (brpc_cntl->ErrorCode() == ECANCELED) {
+            ++stats.cancelled;
+            continue;
+        }
+        if (brpc_cntl->Failed()) {
+            ++stats.failed;
+        }
+        stats.latencies_us.push_back(brpc_cntl->latency_us());
+    }
+    std::vector<int64_t> sorted_us(stats.latencies_us);
+    std::sort(sorted_us.begin(), sorted_us.end());
+    if (!sorted_us.empty()) {
+        stats.max_us = sorted_us.back();
+    }
+    stats.p50_us = latency_percentile(sorted_us, 0.5);
+    stats.p99_us = latency_percentile(sorted_us, 0.99);
+    return stats;
 }
 
 bool DynamicHTTPController::failed() {
+    // Rejected calls never create sub-calls, the error is set on own controller.
+    if (brpc_controller().Failed()) {
+        return true;
+    }
     for (auto brpc_iter = brpc_controller_list().begin(); brpc_iter != brpc_controller_list().end();
          ++brpc_iter) {
         if (brpc_iter->get()->Failed()) {
@@ -121,20 +423,33 @@ bool DynamicHTTPController::failed() {
     return false;
 }
 
-BackendController* build_backend_controller(
+// Take a controller of type T from pool and bind it.
+template <typename T>
+static BackendController* get_pooled_controller(
+        const BackendService* service,
+        expression::ExpressionContext& context) {
+    T* cntl = ObjectPool<T>::instance().get();
+    cntl->bind(service, context);
+    return cntl;
+}
+
+BackendControllerPtr build_backend_controller(
         const BackendService* service,
         expression::ExpressionContext& context) {
     BackendController* cntl = nullptr;
     const BRPC_NAMESPACE::AdaptiveProtocolType protocol = service->protocol();
     bool is_dynamic = service->is_dynamic();
 
-    // Currently supported protocols: HTTP, Redis.
+    // Currently supported protocols: HTTP, Redis, baidu_std and gRPC.
     if (protocol == BRPC_NAMESPACE::PROTOCOL_HTTP && !is_dynamic) {
-        cntl = new HttpController(service, context);
+        cntl = get_pooled_controller<HttpController>(service, context);
     } else if (protocol == BRPC_NAMESPACE::PROTOCOL_HTTP && is_dynamic) {
-        cntl = new DynamicHTTPController(service, context);
+        cntl = get_pooled_controller<DynamicHTTPController>(service, context);
     } else if (protocol == BRPC_NAMESPACE::PROTOCOL_REDIS) {
-        cntl = new RedisController(service, context);
+        cntl = get_pooled_controller<RedisController>(service, context);
+    } else if (protocol == BRPC_NAMESPACE::PROTOCOL_BAIDU_STD ||
+               protocol == BRPC_NAMESPACE::PROTOCOL_H2) {
+        cntl = get_pooled_controller<ProtobufController>(service, context);
     }
 
     if (cntl == nullptr) {
@@ -142,7 +457,7 @@ BackendController* build_backend_controller(
                         << "]";
     }
 
-    return cntl;
+    return BackendControllerPtr(cntl);
 }
 
 }  // namespace uskit
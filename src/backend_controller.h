@@ -24,20 +24,47 @@
 #include "rank_engine.h"
 #include "utils.h"
 #include "controller_closure.h"
+#include "fanout_stats.h"
+#include "object_pool.h"
+#include "request_trace.h"
 
 namespace uskit {
 
 // Forward declaration
 class BackendService;
 class BackendEngine;
+class RedisPipeline;
+
+// Pooled brpc controllers, e.g. sub-calls of dynamic fan-out, are reused after Reset().
+template <>
+struct ObjectPoolTraits<BRPC_NAMESPACE::Controller> {
+    static const char* name() {
+        return "brpc_controller";
+    }
+    static void reset(BRPC_NAMESPACE::Controller* cntl) {
+        cntl->Reset();
+    }
+};
 
 // A backend controller represents a single RPC call to a specific backend service
 // Backend controller is a wrapper for brpc::Controller
+// Backend controllers are pooled, see build_backend_controller.
 class BackendController {
 public:
-    BackendController(const BackendService* service, expression::ExpressionContext& context);
+    BackendController();
     virtual ~BackendController();
 
+    // Bind to a backend service and a parent context before a call.
+    void bind(const BackendService* service, expression::ExpressionContext& context);
+    // Release all state of the call, so that the controller can be bound
+    // again. A call still in flight is joined first, since its closure
+    // writes into this controller.
+    virtual void reset();
+    // Return this controller to its pool.
+    virtual void recycle() {
+        delete this;
+    }
+
     // Build request for RPC
     // Returns 0 on success, -1 otherwise.
     int build_request(const policy::FlowPolicy* flow_policy = nullptr);
@@ -47,8 +74,13 @@ public:
     virtual int join();
     virtual int64_t get_latency_us();
     virtual bool failed();
+    // Obtain the call id used to join and cancel this call
+    virtual BRPC_NAMESPACE::CallId call_id();
 
     // Obtain the associated backend service
+    const BackendService* service() const {
+        return _service;
+    }
     const std::string& service_name() const;
     // Obtain the BRPC_NAMESPACE::Controller associated with this backend controller
     BRPC_NAMESPACE::Controller& brpc_controller();
@@ -83,16 +115,74 @@ public:
     }
 
     int run_service_suc_flag(bool& bool_value);
+    // Feed result of the finished call to circuit breaker, and record the
+    // call into trace of sampled request.
+    void on_call_end();
+    // Trace of the request which issues this call, nullptr if not sampled.
+    RequestTrace* trace() const {
+        return _trace.get();
+    }
+
+    // Whether the response is filled by fallback of a short circuited call
+    bool is_fallback() const {
+        return _fallback;
+    }
+    void set_fallback(bool fallback) {
+        _fallback = fallback;
+    }
+    // Whether the call is rejected by circuit breaker or concurrency limiter
+    // without being sent
+    bool is_rejected() const {
+        return _rejected;
+    }
+    void set_rejected(bool rejected) {
+        _rejected = rejected;
+    }
+    // Whether this call is permitted by circuit breaker of backend and its
+    // result is not fed back yet
+    bool breaker_permitted() const {
+        return _breaker_permitted;
+    }
+    void set_breaker_permitted(bool permitted) {
+        _breaker_permitted = permitted;
+    }
+    // Whether a concurrency slot of backend is held by this call
+    bool concurrency_acquired() const {
+        return _concurrency_acquired;
+    }
+    void set_concurrency_acquired(bool acquired) {
+        _concurrency_acquired = acquired;
+    }
+
+    // Closure passed to RPC, which releases the concurrency slot of the
+    // finished call and runs `_done'.
+    google::protobuf::Closure* call_done() {
+        return &_call_done;
+    }
 
     std::unique_ptr<google::protobuf::Closure> _done;
-    std::vector<std::shared_ptr<uskit::expression::ExpressionContext> >* _flow_context_array;
-    std::unordered_map<std::string, size_t> _service_context_index;
+    FlowContextArray* _flow_context_array;
+    // Service context index shared with backend engine
+    std::shared_ptr<const std::unordered_map<std::string, size_t> > _service_context_index;
     // global call ids ptr
     std::shared_ptr<CallIdsVecThreadSafe> _call_ids_ptr;
     // name of current flow
     std::string _flow_name;
 
+protected:
+    // Release the concurrency slot once the call is finished.
+    void release_concurrency();
+
 private:
+    class CallDoneClosure : public google::protobuf::Closure {
+    public:
+        explicit CallDoneClosure(BackendController* cntl) : _cntl(cntl) {}
+        void Run() override;
+
+    private:
+        BackendController* _cntl;
+    };
+
     // Backend service that this backend controller will iteract with
     const BackendService* _service;
     // Underlying BRPC_NAMESPACE::Controller
@@ -106,54 +196,208 @@ private:
     // cntl priority
     int _priority;
     std::string _recall_next;
+    bool _fallback;
+    bool _rejected;
+    // Whether request is built and the call is issued or about to be
+    bool _request_built;
+    bool _breaker_permitted;
+    bool _concurrency_acquired;
     // Parsed response
     BackendResponse _response;
+    RequestTracePtr _trace;
+    // When request is sent, set for sampled request only
+    int64_t _call_start_us;
+    CallDoneClosure _call_done;
 };
 
 // Controller for HTTP RPC
 class HttpController : public BackendController {
 public:
-    HttpController(const BackendService* service, expression::ExpressionContext& context) :
-            BackendController(service, context) {}
+    void recycle() override;
+};
+
+// Backend controller for protobuf RPC, i.e. baidu_std and gRPC
+class ProtobufController : public BackendController {
+public:
+    void reset() override;
+    void recycle() override;
+    // Take ownership of dynamic request and response messages, which must live
+    // until the call is finished.
+    void set_messages(google::protobuf::Message* request, google::protobuf::Message* response) {
+        _pb_request.reset(request);
+        _pb_response.reset(response);
+    }
+    google::protobuf::Message* pb_request() {
+        return _pb_request.get();
+    }
+    google::protobuf::Message* pb_response() {
+        return _pb_response.get();
+    }
+
+private:
+    std::unique_ptr<google::protobuf::Message> _pb_request;
+    std::unique_ptr<google::protobuf::Message> _pb_response;
 };
 
 // Backend controller for Redis RPC
 class RedisController : public BackendController {
 public:
-    RedisController(const BackendService* service, expression::ExpressionContext& context) :
-            BackendController(service, context) {}
+    RedisController() : _reply_begin(0), _reply_count(0) {}
+    void reset() override;
+    void recycle() override;
     BRPC_NAMESPACE::RedisResponse& redis_response() {
         return _redis_response;
     }
+    int join() override;
+    int64_t get_latency_us() override;
+    BRPC_NAMESPACE::CallId call_id() override;
+
+    // Pipeline that commands of this call are merged into, nullptr if not pipelined
+    RedisPipeline* pipeline() const {
+        return _pipeline.get();
+    }
+    void set_pipeline(const std::shared_ptr<RedisPipeline>& pipeline) {
+        _pipeline = pipeline;
+    }
+    void set_reply_range(int reply_begin, int reply_count) {
+        _reply_begin = reply_begin;
+        _reply_count = reply_count;
+    }
+    // Replies of this call, taken from the pipeline response if pipelined
+    int reply_size() const;
+    const BRPC_NAMESPACE::RedisReply& reply(int index) const;
 
 private:
     // Redis response of brpc
     BRPC_NAMESPACE::RedisResponse _redis_response;
+    std::shared_ptr<RedisPipeline> _pipeline;
+    // Range of replies in pipeline response
+    int _reply_begin;
+    int _reply_count;
 };
 
 // Backend controller for Dynamic HTTP RPC
 class DynamicHTTPController : public BackendController {
 public:
-    DynamicHTTPController(const BackendService* service, expression::ExpressionContext& context) :
-            BackendController(service, context) {}
-    std::vector<std::unique_ptr<BRPC_NAMESPACE::Controller>>& brpc_controller_list() {
+    DynamicHTTPController() :
+            _next_to_issue(0),
+            _cancelled(false),
+            _finished(0),
+            _fanout_start_us(0),
+            _fanout_end_us(0),
+            _fanout_stats_ready(false) {}
+    void reset() override;
+    void recycle() override;
+    // Sub-call controllers are taken from pool, see get_pooled_object.
+    std::vector<PooledPtr<BRPC_NAMESPACE::Controller>>& brpc_controller_list() {
         return _brpc_cntls_list;
     }
+    // Issue all calls in controller list through `channel`, at most `max_concurrency`
+    // of them are in flight at the same time and the rest are issued when earlier
+    // ones finish. 0 means unlimited. Once the fan-out is canceled, pending calls
+    // fail with ECANCELED without being sent.
+    void start_fanout(
+            const std::shared_ptr<BRPC_NAMESPACE::Channel>& channel,
+            size_t max_concurrency);
+    // Statistics of sub-calls, collected on first call after join.
+    const FanoutStats& fanout_stats();
     int join() override;
+    // Wall time from the first send to the last completion of sub-calls.
     int64_t get_latency_us() override;
     bool failed() override;
     std::mutex _outer_mutex;
 
 private:
+    // Issues next pending call when a bounded fan-out call is done.
+    class FanoutClosure : public google::protobuf::Closure {
+    public:
+        FanoutClosure(DynamicHTTPController* cntl, size_t index) : _cntl(cntl), _index(index) {}
+        // Only moved by vector before any call is issued.
+        FanoutClosure(FanoutClosure&& other) :
+                google::protobuf::Closure(), _cntl(other._cntl), _index(other._index) {}
+        void Run() override;
+
+    private:
+        DynamicHTTPController* _cntl;
+        // Index of the sub-call in controller list
+        size_t _index;
+    };
+
+    void issue(size_t index);
+
     // List of BRPC_CONTROLLORS
-    std::vector<std::unique_ptr<BRPC_NAMESPACE::Controller>> _brpc_cntls_list;
+    std::vector<PooledPtr<BRPC_NAMESPACE::Controller>> _brpc_cntls_list;
+    std::shared_ptr<BRPC_NAMESPACE::Channel> _fanout_channel;
+    std::mutex _fanout_mutex;
+    size_t _next_to_issue;
+    // Set once a sub-call is canceled or the flow is ready to quit
+    bool _cancelled;
+    // Number of finished calls, the concurrency slot is released with the last one
+    size_t _finished;
+    int64_t _fanout_start_us;
+    int64_t _fanout_end_us;
+    FanoutStats _fanout_stats;
+    bool _fanout_stats_ready;
+    // Closure of each sub-call, capacity is kept across reuse
+    std::vector<FanoutClosure> _fanout_dones;
+};
+
+// Deleter which returns backend controller to its pool.
+struct BackendControllerDeleter {
+    void operator()(BackendController* cntl) const {
+        cntl->recycle();
+    }
 };
 
-// Backend controller factory
-BackendController* build_backend_controller(
+typedef std::unique_ptr<BackendController, BackendControllerDeleter> BackendControllerPtr;
+
+// Backend controller factory, controllers are taken from per-thread pools
+// and bound to `service' and `context'. Returns nullptr if protocol of
+// service is not supported.
+BackendControllerPtr build_backend_controller(
         const BackendService* service,
         expression::ExpressionContext& context);
 
+template <>
+struct ObjectPoolTraits<HttpController> {
+    static const char* name() {
+        return "http_controller";
+    }
+    static void reset(HttpController* cntl) {
+        cntl->reset();
+    }
+};
+
+template <>
+struct ObjectPoolTraits<ProtobufController> {
+    static const char* name() {
+        return "protobuf_controller";
+    }
+    static void reset(ProtobufController* cntl) {
+        cntl->reset();
+    }
+};
+
+template <>
+struct ObjectPoolTraits<RedisController> {
+    static const char* name() {
+        return "redis_controller";
+    }
+    static void reset(RedisController* cntl) {
+        cntl->reset();
+    }
+};
+
+template <>
+struct ObjectPoolTraits<DynamicHTTPController> {
+    static const char* name() {
+        return "dynamic_http_controller";
+    }
+    static void reset(DynamicHTTPController* cntl) {
+        cntl->reset();
+    }
+};
+
 }  // namespace uskit
 
 #endif  // USKIT_BACKEND_CONTROLLER_H
@@ -12,28 +12,137 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <map>
 #include <set>
+#include <unordered_set>
 #include "butil.h"
 #include "backend_engine.h"
 #include "backend_controller.h"
+#include "redis_pipeline.h"
 #include "utils.h"
 #include "thread_data.h"
 #include "policy/flow_policy.h"
 
 namespace uskit {
 
-BackendEngine::BackendEngine() {}
+// Pipelines of current recall keyed by backend and priority of calls
+typedef std::map<std::pair<const Backend*, int>, std::shared_ptr<RedisPipeline>>
+        RedisPipelineMap;
+
+// Merge the call into the Redis pipeline of its backend within current recall.
+// Members share the call id of the merged call, so only calls of the same
+// priority are merged and PRIORITY and HIERACHY cancel orders still hold.
+static void attach_redis_pipeline(
+        BackendController* cntl,
+        const BackendService& service,
+        int priority,
+        RedisPipelineMap& pipelines) {
+    const Backend* backend = service.backend();
+    RedisController* redis_cntl = dynamic_cast<RedisController*>(cntl);
+    if (redis_cntl == nullptr || !backend->redis_pipeline()) {
+        return;
+    }
+    const auto key = std::make_pair(backend, priority);
+    auto iter = pipelines.find(key);
+    if (iter == pipelines.end()) {
+        iter = pipelines.emplace(key, std::make_shared<RedisPipeline>(backend->channel())).first;
+    }
+    redis_cntl->set_pipeline(iter->second);
+}
+
+static void flush_redis_pipelines(RedisPipelineMap& pipelines) {
+    for (auto& pipeline : pipelines) {
+        pipeline.second->flush();
+    }
+}
+
+// Acquire concurrency slots of all calls to a backend within a recall at once
+// before any of them is issued, so a call never waits for slots held by its
+// siblings and issuing is not delayed call by call. Calls beyond the acquired
+// slots are rejected when building request.
+static void acquire_concurrency(std::vector<BackendControllerPtr>& cntls) {
+    std::map<ConcurrencyLimiter*, std::vector<BackendController*>> limited_cntls;
+    for (auto& cntl : cntls) {
+        ConcurrencyLimiter* limiter = cntl->service()->backend()->concurrency_limiter();
+        if (limiter != nullptr) {
+            limited_cntls[limiter].push_back(cntl.get());
+        }
+    }
+    for (auto& iter : limited_cntls) {
+        std::vector<BackendController*>& limited = iter.second;
+        const int acquired = iter.first->acquire(static_cast<int>(limited.size()));
+        for (int i = 0; i < acquired; ++i) {
+            limited[i]->set_concurrency_acquired(true);
+        }
+    }
+}
+
+// Let closures of rejected calls move on as if the calls were finished. They
+// run after all calls are issued, since closures of global policies may run
+// next flow nodes inline.
+static void run_rejected_closures(std::vector<BackendControllerPtr>& cntls) {
+    for (auto& cntl : cntls) {
+        if (cntl->is_rejected() && cntl->_done) {
+            cntl->_done->Run();
+        }
+    }
+}
+
+// Publish call ids of an issued controller at `index' of `call_ids', so that
+// they are cancelled once the recall is discarded. Calls published after
+// quitting are cancelled here, the quitter may have missed them.
+static void publish_call_ids(BackendController& cntl, size_t index, CallIdsVecThreadSafe& call_ids) {
+    std::vector<BRPC_NAMESPACE::CallId> ids;
+    int ret = 0;
+    if (DynamicHTTPController* dhc = dynamic_cast<DynamicHTTPController*>(&cntl)) {
+        for (const auto& brpc_cntl : dhc->brpc_controller_list()) {
+            ids.push_back(brpc_cntl->call_id());
+        }
+        ret = call_ids.set_call_id(index, ids);
+    } else {
+        ids.push_back(cntl.call_id());
+        ret = call_ids.set_call_id(index, ids.front());
+    }
+    if (ret == 1) {
+        for (const auto& id : ids) {
+            BRPC_NAMESPACE::StartCancel(id);
+        }
+    }
+}
+
+// Log fan-out statistics of dynamic service, which is
+// `fanout(<service>)=total,failed,cancelled,wall_us,max_us,p50_us,p99_us`.
+static void log_fanout_stats(UnifiedSchedulerThreadData* td, BackendController& cntl) {
+    DynamicHTTPController* dynamic_cntl = dynamic_cast<DynamicHTTPController*>(&cntl);
+    if (td == nullptr || dynamic_cntl == nullptr) {
+        return;
+    }
+    const FanoutStats& stats = dynamic_cntl->fanout_stats();
+    std::vector<std::string> fields = {
+        std::to_string(stats.total),
+        std::to_string(stats.failed),
+        std::to_string(stats.cancelled),
+        std::to_string(stats.wall_us),
+        std::to_string(stats.max_us),
+        std::to_string(stats.p50_us),
+        std::to_string(stats.p99_us)};
+    td->add_log_entry("fanout(" + cntl.service_name() + ")", fields);
+}
+
+BackendEngine::BackendEngine() :
+        _service_context_index(std::make_shared<std::unordered_map<std::string, size_t>>()) {}
 
 BackendEngine::~BackendEngine() {}
 
-int BackendEngine::init(const BackendEngineConfig& config) {
+int BackendEngine::init(const BackendEngineConfig& config, const std::string& usid) {
     std::vector<std::string> backends;
+    auto service_context_index = std::make_shared<std::unordered_map<std::string, size_t>>();
     // Initialize backends
     size_t service_beg = 0;
     for (int i = 0; i < config.backend_size(); ++i) {
         const BackendConfig& backend_config = config.backend(i);
         Backend backend;
-        if (backend.init(backend_config) != 0) {
+        if (backend.init(backend_config, usid) != 0) {
             LOG(ERROR) << "Failed to init backend [" << backend_config.name() << "]";
             return -1;
         }
@@ -47,10 +156,11 @@ int BackendEngine::init(const BackendEngineConfig& config) {
                 return -1;
             }
             _service_map.emplace(service_config.name(), std::move(service));
-            _service_context_index.emplace(service_config.name(), service_beg++);
+            service_context_index->emplace(service_config.name(), service_beg++);
         }
         backends.emplace_back(backend_config.name());
     }
+    _service_context_index = service_context_index;
 
     LOG(INFO) << "Initialized backends: " << JoinString(backends, ',');
 
@@ -60,7 +170,8 @@ int BackendEngine::init(const BackendEngineConfig& config) {
 int BackendEngine::run(
         const std::vector<std::pair<std::string, int>>& recall_services,
         expression::ExpressionContext& context,
-        const std::string cancel_order) const {
+        const std::string cancel_order,
+        std::shared_ptr<CallIdsVecThreadSafe> call_ids) const {
     std::vector<std::string> recall_services_strs;
     for (auto& rec : recall_services) {
         recall_services_strs.push_back(rec.first);
@@ -69,7 +180,7 @@ int BackendEngine::run(
     UnifiedSchedulerThreadData* td =
             static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
 
-    std::vector<std::unique_ptr<BackendController>> cntls;
+    std::vector<BackendControllerPtr> cntls;
 
     Timer recall_tm("recall_total_t_ms(" + recall_services_str + ")");
     Timer build_request_tm("build_request_total_t_ms(" + recall_services_str + ")");
@@ -80,6 +191,9 @@ int BackendEngine::run(
 
     std::vector<std::string> build_request_result;
     std::vector<CallIdPriorityPair> cntls_call_ids;
+    // Index in `recall_services' of each controller in `cntls'
+    std::vector<size_t> cntl_indexes;
+    RedisPipelineMap redis_pipelines;
     for (std::vector<std::pair<std::string, int>>::const_iterator iter = recall_services.begin();
          iter != recall_services.end();
          ++iter) {
@@ -90,25 +204,43 @@ int BackendEngine::run(
             US_LOG(WARNING) << "Unknown service [" << iter->first << "], skipping";
         } else {
             // Build backend controller
-            std::unique_ptr<BackendController> cntl(
-                    build_backend_controller(&service_iter->second, context));
-            cntls_call_ids.push_back(
-                    CallIdPriorityPair(cntl->brpc_controller().call_id(), iter->second));
+            BackendControllerPtr cntl = build_backend_controller(&service_iter->second, context);
+            attach_redis_pipeline(cntl.get(), service_iter->second, iter->second, redis_pipelines);
+            cntls_call_ids.push_back(CallIdPriorityPair(cntl->call_id(), iter->second));
             cntl->set_cancel_order(cancel_order);
             cntl->set_priority(iter->second);
+            cntl->_call_ids_ptr = call_ids;
             cntls.emplace_back(std::move(cntl));
+            cntl_indexes.push_back(iter - recall_services.begin());
         }
         tm.stop();
     }
-    for (auto iter = cntls.begin(); iter != cntls.end(); ++iter) {
-        BackendController& cntl = **iter;
+    acquire_concurrency(cntls);
+    // Whether request of each controller in `cntls' is built
+    std::vector<bool> request_built(cntls.size(), false);
+    for (size_t i = 0; i < cntls.size(); ++i) {
+        BackendController& cntl = *cntls[i];
         cntl.set_call_ids(cntls_call_ids);
+        // Calls of a discarded recall are not issued.
+        if (call_ids && call_ids->get_is_ready()) {
+            continue;
+        }
         US_DLOG(INFO) << "start build cntl: " << cntl.brpc_controller().call_id();
         if (cntl.build_request() == 0) {
             US_DLOG(INFO) << "finish cntl: " << cntl.brpc_controller().call_id();
             build_request_result.push_back(cntl.service_name());
+            request_built[i] = true;
+        }
+    }
+    flush_redis_pipelines(redis_pipelines);
+    if (call_ids) {
+        for (size_t i = 0; i < cntls.size(); ++i) {
+            if (request_built[i]) {
+                publish_call_ids(*cntls[i], cntl_indexes[i], *call_ids);
+            }
         }
     }
+    run_rejected_closures(cntls);
     if (recall_services_strs.size() > 0) {
         td->add_log_entry(
                 "build_request_result(" + recall_services_str + ")", build_request_result);
@@ -116,16 +248,18 @@ int BackendEngine::run(
     }
     std::vector<std::string> recall_result;
     // Wait util all service calls finish
-    for (auto iter = cntls.begin(); iter != cntls.end(); ++iter) {
-        std::string service_name = iter->get()->service_name();
-        if (std::find(build_request_result.begin(), build_request_result.end(), service_name) !=
-            build_request_result.end()) {
-            iter->get()->join();
+    for (size_t i = 0; i < cntls.size(); ++i) {
+        if (request_built[i]) {
+            cntls[i]->join();
         }
     }
 
-    for (auto iter = cntls.begin(); iter != cntls.end(); ++iter) {
-        BackendController& cntl = **iter;
+    for (size_t i = 0; i < cntls.size(); ++i) {
+        BackendController& cntl = *cntls[i];
+        if (request_built[i]) {
+            cntl.on_call_end();
+            log_fanout_stats(td, cntl);
+        }
         auto latency_us = cntl.get_latency_us();
         td->add_log_entry("recall_t_ms(" + cntl.service_name() + ")", latency_us / 1000);
         if (!cntl.failed()) {
@@ -149,7 +283,9 @@ int BackendEngine::run(
         Timer tm("parse_response_t_ms(" + cntl.service_name() + ")");
         tm.start();
 
-        if (brpc_cntl.Failed()) {
+        if (cntl.is_fallback()) {
+            US_LOG(INFO) << "Use fallback response of service [" << cntl.service_name() << "]";
+        } else if (brpc_cntl.Failed()) {
             US_LOG(WARNING) << "Failed to receive response from service [" << cntl.service_name()
                             << "]"
                             << " remote_server=" << brpc_cntl.remote_side()
@@ -157,12 +293,13 @@ int BackendEngine::run(
                             << " error_msg=" << brpc_cntl.ErrorText();
             // Skip parsing
             continue;
+        } else {
+            US_LOG(INFO) << "Received response from service [" << cntl.service_name() << "]"
+                         << " remote_server=" << brpc_cntl.remote_side()
+                         << " latency=" << brpc_cntl.latency_us() << "us";
         }
-        US_LOG(INFO) << "Received response from service [" << cntl.service_name() << "]"
-                     << " remote_server=" << brpc_cntl.remote_side()
-                     << " latency=" << brpc_cntl.latency_us() << "us";
-        // Parse response
-        if (cntl.parse_response() == 0) {
+        // Parse response, fallback response is used as is
+        if (cntl.is_fallback() || cntl.parse_response() == 0) {
             rapidjson::Value* backend_result = context.get_variable("backend");
             rapidjson::Value service_name;
             service_name.SetString(
@@ -189,75 +326,89 @@ int BackendEngine::run(
 int BackendEngine::run(
         const policy::FlowPolicy* flow_policy,
         const FlowRecallConfig* recall_config,
-        std::vector<std::shared_ptr<uskit::expression::ExpressionContext>>& context,
+        FlowContextArray& context,
         std::shared_ptr<policy::FlowPolicyHelper> helper) const {
     std::shared_ptr<CallIdsVecThreadSafe> ids_ptr = helper->_call_ids_ptr;
     std::vector<std::string> recall_services_strs;
-    std::vector<std::pair<std::string, int>> config_services = recall_config->get_recall_services();
-    std::vector<std::pair<std::string, int>> recall_services;
-    std::vector<std::string> tmp_services = helper->_filterout_services;
-    std::set<std::string> filterout(tmp_services.begin(), tmp_services.end());
+    const std::vector<std::string>& filterout = helper->_filterout_services;
     std::string intervene_service = "";
-    if (recall_config->get_intervene_service(*(context[0].get()), intervene_service) != 0) {
+    if (recall_config->get_intervene_service(context.snapshot(), intervene_service) != 0) {
         US_LOG(ERROR) << "Failed to evaluate InterveneConfig target";
         return -1;
     }
+    // Entries of the compiled recall plan, only intervene service is resolved
+    // per request.
+    std::vector<const RecallPlanEntry*> recall_entries;
+    RecallPlanEntry intervene_entry;
     if (intervene_service != "") {
-        recall_services.push_back(std::make_pair(intervene_service, 0));
+        intervene_entry.service_name = intervene_service;
+        intervene_entry.service = get_service(intervene_service);
+        intervene_entry.service_id =
+                intervene_entry.service != nullptr ? get_service_index(intervene_service) : 0;
+        intervene_entry.priority = 0;
+        auto next_iter = recall_config->get_recall_next().find(intervene_service);
+        if (next_iter != recall_config->get_recall_next().end()) {
+            intervene_entry.next_flow = next_iter->second;
+        }
+        recall_entries.push_back(&intervene_entry);
         helper->_intervene_service = intervene_service;
+    } else if (filterout.empty()) {
+        for (const auto& entry : recall_config->recall_plan()) {
+            recall_entries.push_back(&entry);
+        }
     } else {
-        for (auto& rec : config_services) {
-            if (filterout.find(rec.first) == filterout.end()) {
-                recall_services.push_back(rec);
-                US_DLOG(INFO) << "push service [" << rec.first << "]";
+        const std::unordered_set<std::string> filterout_set(filterout.begin(), filterout.end());
+        for (const auto& entry : recall_config->recall_plan()) {
+            if (filterout_set.find(entry.service_name) == filterout_set.end()) {
+                recall_entries.push_back(&entry);
+                US_DLOG(INFO) << "push service [" << entry.service_name << "]";
             }
         }
     }
 
-    for (auto& rec : recall_services) {
-        recall_services_strs.push_back(rec.first);
+    for (const RecallPlanEntry* entry : recall_entries) {
+        recall_services_strs.push_back(entry->service_name);
     }
     std::string recall_services_str = JoinString(recall_services_strs, ',');
 
-    std::vector<std::unique_ptr<BackendController>> cntls;
+    std::vector<BackendControllerPtr> cntls;
+    // Service context index of each controller in `cntls'
+    std::vector<size_t> cntl_service_ids;
 
     Timer recall_tm("recall_total_t_ms(" + recall_services_str + ")");
     recall_tm.start();
     Timer build_request_tm("build_request_total_t_ms(" + recall_services_str + ")");
     build_request_tm.start();
-    std::unordered_set<std::string> build_request_result_set;
-    std::vector<std::string> build_request_result;
     std::vector<CallIdPriorityPair> cntls_call_ids;
-    std::unordered_map<size_t, const std::string> callid_serv_map;
-    for (std::vector<std::pair<std::string, int>>::const_iterator iter = recall_services.begin();
-         iter != recall_services.end();
-         ++iter) {
-        Timer tm("build_request_t_ms(" + iter->first + ")");
+    // Index in `cntls' of the controller each call id in `cntls_call_ids'
+    // belongs to
+    std::vector<size_t> call_id_cntls;
+    RedisPipelineMap redis_pipelines;
+    for (const RecallPlanEntry* entry : recall_entries) {
+        Timer tm("build_request_t_ms(" + entry->service_name + ")");
         tm.start();
-        auto service_iter = _service_map.find(iter->first);
-        if (service_iter == _service_map.end() ||
+        if (entry->service == nullptr ||
             (helper->_target_service_set &&
-             helper->_target_service_set->find(iter->first) !=
+             helper->_target_service_set->find(entry->service_name) !=
                      helper->_target_service_set->end())) {
-            US_LOG(WARNING) << "Service [" << iter->first
+            US_LOG(WARNING) << "Service [" << entry->service_name
                             << "] is Unknown or not in targets, skipping";
         } else {
             // Build backend controller
-            size_t service_index = _service_context_index.find(iter->first)->second;
-            std::unique_ptr<BackendController> cntl(
-                    build_backend_controller(&service_iter->second, *(context[service_index])));
-            std::vector<BRPC_NAMESPACE::CallId> dhc_call_ids;
+            size_t service_index = entry->service_id;
+            BackendControllerPtr cntl =
+                    build_backend_controller(entry->service, context.at(service_index));
+            attach_redis_pipeline(cntl.get(), *entry->service, entry->priority, redis_pipelines);
             if (dynamic_cast<DynamicHTTPController*>(cntl.get())) {
                 US_DLOG(INFO) << "dynamic http controller";
             } else {
-                cntls_call_ids.push_back(
-                        CallIdPriorityPair(cntl->brpc_controller().call_id(), iter->second));
-                callid_serv_map.emplace(cntls_call_ids.size() - 1, iter->first);
+                cntls_call_ids.push_back(CallIdPriorityPair(cntl->call_id(), entry->priority));
+                call_id_cntls.push_back(cntls.size());
             }
             cntl->set_cancel_order(recall_config->get_cancel_order());
-            cntl->set_priority(iter->second);
+            cntl->set_priority(entry->priority);
             if (ids_ptr) {
-                int ret = ids_ptr->set_call_id(service_index, cntl->brpc_controller().call_id());
+                int ret = ids_ptr->set_call_id(service_index, cntl->call_id());
                 if (ret == -1) {
                     US_LOG(ERROR) << "Unable to set call id to call_ids_ptr";
                     return -1;
@@ -267,31 +418,29 @@ int BackendEngine::run(
                 }
             }
             cntl->_call_ids_ptr = ids_ptr;
-            std::unordered_map<std::string, std::string> _recall_next =
-                    recall_config->get_recall_next();
             cntl->_flow_context_array = &context;
             cntl->_flow_name = recall_config->get_flow_name();
-            for (auto iter : _service_context_index) {
-                cntl->_service_context_index.emplace(iter.first, iter.second);
-            }
+            cntl->_service_context_index = _service_context_index;
 
-            auto _next_iter = _recall_next.find(iter->first);
-            if (_next_iter != _recall_next.end()) {
-                cntl->set_recall_next(_next_iter->second);
-                US_DLOG(INFO) << "recall next map: " << _next_iter->first << " "
-                              << _next_iter->second;
+            if (!entry->next_flow.empty()) {
+                cntl->set_recall_next(entry->next_flow);
+                US_DLOG(INFO) << "recall next map: " << entry->service_name << " "
+                              << entry->next_flow;
             }
 
             cntls.emplace_back(std::move(cntl));
+            cntl_service_ids.push_back(service_index);
         }
         tm.stop();
     }
-    for (auto iter = cntls.begin(); iter != cntls.end(); ++iter) {
-        BackendController& cntl = **iter;
+    acquire_concurrency(cntls);
+    // Whether request of each controller in `cntls' is built
+    std::vector<bool> request_built(cntls.size(), false);
+    for (size_t i = 0; i < cntls.size(); ++i) {
+        BackendController& cntl = *cntls[i];
         cntl.set_call_ids(cntls_call_ids);
         if (cntl.build_request(flow_policy) == 0) {
-            build_request_result.push_back(cntl.service_name());
-            build_request_result_set.insert(cntl.service_name());
+            request_built[i] = true;
             std::vector<BRPC_NAMESPACE::CallId> dhc_call_ids;
             if (DynamicHTTPController* dhc = dynamic_cast<DynamicHTTPController*>(&cntl)) {
                 for (auto brpc_iter = dhc->brpc_controller_list().begin();
@@ -300,10 +449,9 @@ int BackendEngine::run(
                     dhc_call_ids.push_back(brpc_iter->get()->call_id());
                     cntls_call_ids.push_back(
                             CallIdPriorityPair(brpc_iter->get()->call_id(), cntl.get_priority()));
-                    callid_serv_map.emplace(cntls_call_ids.size() - 1, cntl.service_name());
+                    call_id_cntls.push_back(i);
                 }
-                size_t service_index = _service_context_index.find(cntl.service_name())->second;
-                int ret = ids_ptr->set_call_id(service_index, dhc_call_ids);
+                int ret = ids_ptr->set_call_id(cntl_service_ids[i], dhc_call_ids);
                 if (ret == -1) {
                     US_LOG(ERROR) << "Unable to set call id to call_ids_ptr";
                     return -1;
@@ -314,24 +462,31 @@ int BackendEngine::run(
             }
         }
     }
+    flush_redis_pipelines(redis_pipelines);
+    run_rejected_closures(cntls);
 
     build_request_tm.stop();
 
     std::vector<std::string> recall_result;
     // Wait util all service calls finish
     for (size_t index = 0; index < cntls_call_ids.size(); ++index) {
-        std::string service_name = callid_serv_map.find(index)->second;
-        if (build_request_result_set.find(service_name) != build_request_result_set.end()) {
+        if (request_built[call_id_cntls[index]]) {
             BRPC_NAMESPACE::Join(cntls_call_ids[index].first);
         }
     }
 
-    for (auto iter = cntls.begin(); iter != cntls.end(); ++iter) {
-        BackendController& cntl = **iter;
+    for (size_t i = 0; i < cntls.size(); ++i) {
+        BackendController& cntl = *cntls[i];
         BRPC_NAMESPACE::Controller& brpc_cntl = cntl.brpc_controller();
+        if (request_built[i]) {
+            cntl.on_call_end();
+        }
         auto latency_us = cntl.get_latency_us();
         UnifiedSchedulerThreadData* td =
             static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
+        if (request_built[i]) {
+            log_fanout_stats(td, cntl);
+        }
         if (td != nullptr) {
             td->add_log_entry("recall_t_ms(" + cntl.service_name() + ")", latency_us / 1000);
         }
@@ -344,15 +499,29 @@ int BackendEngine::run(
 }
 
 size_t BackendEngine::get_service_size() const {
-    return _service_context_index.size();
+    return _service_context_index->size();
 }
 
 size_t BackendEngine::get_service_index(const std::string& service_name) const {
-    return _service_context_index.find(service_name)->second;
+    return _service_context_index->find(service_name)->second;
 }
 
 bool BackendEngine::has_service(const std::string& service_name) const {
-    return (_service_context_index.find(service_name) != _service_context_index.end());
+    return (_service_context_index->find(service_name) != _service_context_index->end());
+}
+
+const BackendService* BackendEngine::get_service(const std::string& service_name) const {
+    auto iter = _service_map.find(service_name);
+    if (iter == _service_map.end()) {
+        return nullptr;
+    }
+    return &iter->second;
+}
+
+void BackendEngine::prewarm(ConnectionPrewarmer& prewarmer) const {
+    for (const auto& backend : _backend_map) {
+        prewarmer.add(backend.first, backend.second);
+    }
 }
 
 }  // namespace uskit
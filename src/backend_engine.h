@@ -18,9 +18,12 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <memory>
 #include "config.pb.h"
 #include "expression/expression.h"
+#include "flow_context_array.h"
 #include "backend_service.h"
+#include "connection_prewarmer.h"
 
 namespace uskit {
 
@@ -35,28 +38,39 @@ public:
     BackendEngine();
     BackendEngine(BackendEngine&&) = default;
     ~BackendEngine();
-    // Initialize backend engine from configuration.
+    // Initialize backend engine from configuration of `usid'.
     // Returns 0 on success, -1 otherwise.
-    int init(const BackendEngineConfig& config);
+    int init(const BackendEngineConfig& config, const std::string& usid);
     // Recall specified backend service in parallel.
-    // Support cancel operations
+    // Support cancel operations, calls are published to `call_ids' if given
+    // and cancelled once it quits.
     // Return 0 on success, -1 otherwise.
     int run(const std::vector<std::pair<std::string, int> >& recall_services,
             expression::ExpressionContext& context,
-            const std::string cancel_order) const;
+            const std::string cancel_order,
+            std::shared_ptr<CallIdsVecThreadSafe> call_ids = nullptr) const;
     int run(const policy::FlowPolicy* flow_policy,
             const FlowRecallConfig* recall_config,
-            std::vector<std::shared_ptr<uskit::expression::ExpressionContext> >& context_vec,
+            FlowContextArray& context_vec,
             std::shared_ptr<policy::FlowPolicyHelper> helper = nullptr) const;
     // Return number of services
     size_t get_service_size() const;
     size_t get_service_index(const std::string& service_name) const;
     bool has_service(const std::string& service_name) const;
+    // Return service by name, nullptr if not found.
+    const BackendService* get_service(const std::string& service_name) const;
+    // Service context index shared with backend controllers.
+    std::shared_ptr<const std::unordered_map<std::string, size_t>> service_context_index() const {
+        return _service_context_index;
+    }
+    // Add backends to be prewarmed.
+    void prewarm(ConnectionPrewarmer& prewarmer) const;
 
 private:
     std::unordered_map<std::string, Backend> _backend_map;
     std::unordered_map<std::string, BackendService> _service_map;
-    std::unordered_map<std::string, size_t> _service_context_index;
+    // Immutable after init, shared by all controllers.
+    std::shared_ptr<const std::unordered_map<std::string, size_t>> _service_context_index;
 };
 
 }  // namespace uskit
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <errno.h>
 #include "butil.h"
 #include "backend_controller.h"
 #include "backend_service.h"
@@ -20,7 +21,7 @@
 
 namespace uskit {
 
-BackendService::BackendService() {}
+BackendService::BackendService() : _is_dynamic(false), _request_reads_flow(true) {}
 
 BackendService::~BackendService() {}
 
@@ -32,8 +33,33 @@ int BackendService::init(const ServiceConfig& service_config, Backend* backend)
         US_LOG(ERROR) << "service success config initialize failed";
         return -1;
     }
+    if (_fallback.init(service_config.fallback()) != 0) {
+        US_LOG(ERROR) << "service fallback config initialize failed";
+        return -1;
+    }
+    // Statistics of config carried by request are only logged.
+    if (_is_dynamic && !_backend->usid().empty()) {
+        _fanout_recorder.reset(new FanoutRecorder(_backend->usid(), _name));
+    }
+    std::shared_ptr<BRPC_NAMESPACE::Channel> retry_channel;
+    if (service_config.has_retry()) {
+        _retry_policy.reset(new ServiceRetryPolicy);
+        if (_retry_policy->init(
+                    _backend->usid(), _name, service_config.retry(), _backend->retry_budget()) != 0) {
+            LOG(ERROR) << "Failed to initialize retry policy of service [" << _name << "]";
+            return -1;
+        }
+        retry_channel = _backend->retry_channel(_retry_policy.get());
+        if (!retry_channel) {
+            LOG(ERROR) << "Failed to initialize channel of service [" << _name << "]";
+            return -1;
+        }
+    }
     if (service_config.has_request()) {
         const RequestConfig& request_config = service_config.request();
+        _request_reads_flow = refers_flow_results(request_config) ||
+                (request_config.has_include() &&
+                 _backend->request_config_reads_flow(request_config.include()));
         std::string request_policy_name(service_config.request_policy());
         if (request_policy_name == "default") {
             const BRPC_NAMESPACE::AdaptiveProtocolType protocol =
@@ -44,6 +70,9 @@ int BackendService::init(const ServiceConfig& service_config, Backend* backend)
                 request_policy_name = "dynamic_default";
             } else if (protocol == BRPC_NAMESPACE::PROTOCOL_REDIS) {
                 request_policy_name = "redis_default";
+            } else if (protocol == BRPC_NAMESPACE::PROTOCOL_BAIDU_STD ||
+                       protocol == BRPC_NAMESPACE::PROTOCOL_H2) {
+                request_policy_name = "protobuf_default";
             }
         }
         // Get backend request policy
@@ -55,6 +84,9 @@ int BackendService::init(const ServiceConfig& service_config, Backend* backend)
             return -1;
         }
 
+        if (retry_channel) {
+            _request_policy->set_service_channel(retry_channel);
+        }
         if (_request_policy->init(request_config, _backend) != 0) {
             LOG(ERROR) << "Failed to initialize request policy [" << request_policy_name << "]";
             return -1;
@@ -73,6 +105,9 @@ int BackendService::init(const ServiceConfig& service_config, Backend* backend)
                 response_policy_name = "dynamic_default";
             } else if (protocol == BRPC_NAMESPACE::PROTOCOL_REDIS) {
                 response_policy_name = "redis_default";
+            } else if (protocol == BRPC_NAMESPACE::PROTOCOL_BAIDU_STD ||
+                       protocol == BRPC_NAMESPACE::PROTOCOL_H2) {
+                response_policy_name = "protobuf_default";
             }
         }
         // Get backend response policy
@@ -94,13 +129,95 @@ int BackendService::init(const ServiceConfig& service_config, Backend* backend)
 }
 
 int BackendService::build_request(BackendController* cntl) const {
+    CircuitBreaker* breaker = _backend->circuit_breaker();
+    if (breaker != nullptr) {
+        if (!breaker->on_call_begin()) {
+            on_call_abort(cntl);
+            return reject(cntl, EHOSTDOWN, "circuit breaker is open");
+        }
+        cntl->set_breaker_permitted(true);
+    }
+    // Slots are acquired for all calls of the recall before building.
+    if (_backend->concurrency_limiter() != nullptr && !cntl->concurrency_acquired()) {
+        on_call_abort(cntl);
+        return reject(cntl, BRPC_NAMESPACE::ELIMIT, "backend is over concurrency limit");
+    }
+    RetryBudget* budget = _backend->retry_budget();
+    if (budget != nullptr && !_is_dynamic) {
+        budget->on_request(1);
+    }
     if (_request_policy && _request_policy->run(cntl) != 0) {
         US_LOG(WARNING) << "Failed to build request for service [" << _name << "]";
+        on_call_abort(cntl);
         return -1;
     }
+    if (budget != nullptr && _is_dynamic) {
+        // Every sub-call of fan-out is a request to backend.
+        DynamicHTTPController* dynamic_cntl = static_cast<DynamicHTTPController*>(cntl);
+        budget->on_request(static_cast<int>(dynamic_cntl->brpc_controller_list().size()));
+    }
     return 0;
 }
 
+int BackendService::reject(
+        BackendController* cntl,
+        int error_code,
+        const std::string& reason) const {
+    US_LOG(WARNING) << "Skip calling service [" << _name << "]: " << reason;
+    cntl->brpc_controller().SetFailed(error_code, "Service [%s] is rejected: %s",
+            _name.c_str(), reason.c_str());
+    if (!_fallback.empty()) {
+        if (_fallback.run(cntl->context(), cntl->response()) != 0) {
+            US_LOG(WARNING) << "Failed to evaluate fallback of service [" << _name << "]";
+        } else {
+            cntl->set_fallback(true);
+        }
+    }
+    // Closure is run by backend engine once sibling calls are issued, see
+    // run_rejected_closures.
+    cntl->set_rejected(true);
+    return -1;
+}
+
+void BackendService::release_concurrency(BackendController* cntl) const {
+    ConcurrencyLimiter* limiter = _backend->concurrency_limiter();
+    if (limiter != nullptr && cntl->concurrency_acquired()) {
+        cntl->set_concurrency_acquired(false);
+        limiter->release(cntl->failed(), cntl->get_latency_us());
+    }
+}
+
+void BackendService::on_call_end(BackendController* cntl) const {
+    DynamicHTTPController* dynamic_cntl = dynamic_cast<DynamicHTTPController*>(cntl);
+    if (dynamic_cntl != nullptr && _fanout_recorder) {
+        _fanout_recorder->record(dynamic_cntl->fanout_stats());
+    }
+    // Fan-out without sub-calls never runs done closure.
+    release_concurrency(cntl);
+    CircuitBreaker* breaker = _backend->circuit_breaker();
+    if (breaker == nullptr || !cntl->breaker_permitted()) {
+        return;
+    }
+    cntl->set_breaker_permitted(false);
+    // Calls canceled by scheduler say nothing about backend health.
+    if (dynamic_cntl != nullptr) {
+        if (dynamic_cntl->brpc_controller_list().empty()) {
+            breaker->on_call_abort();
+        }
+        for (auto& brpc_cntl : dynamic_cntl->brpc_controller_list()) {
+            if (brpc_cntl->ErrorCode() == ECANCELED) {
+                breaker->on_call_abort();
+            } else {
+                breaker->on_call_end(brpc_cntl->Failed(), brpc_cntl->latency_us());
+            }
+        }
+    } else if (cntl->brpc_controller().ErrorCode() == ECANCELED) {
+        breaker->on_call_abort();
+    } else {
+        breaker->on_call_end(cntl->failed(), cntl->get_latency_us());
+    }
+}
+
 int BackendService::parse_response(BackendController* cntl) const {
     if (_response_policy && _response_policy->run(cntl) != 0) {
         US_LOG(WARNING) << "Failed to parse response for service [" << _name << "]";
@@ -109,14 +226,35 @@ int BackendService::parse_response(BackendController* cntl) const {
     return 0;
 }
 
+void BackendService::on_call_abort(BackendController* cntl) const {
+    CircuitBreaker* breaker = _backend->circuit_breaker();
+    if (breaker != nullptr && cntl->breaker_permitted()) {
+        breaker->on_call_abort();
+        cntl->set_breaker_permitted(false);
+    }
+    ConcurrencyLimiter* limiter = _backend->concurrency_limiter();
+    if (limiter != nullptr && cntl->concurrency_acquired()) {
+        limiter->cancel();
+        cntl->set_concurrency_acquired(false);
+    }
+}
+
 const std::string& BackendService::name() const {
     return _name;
 }
 
+const Backend* BackendService::backend() const {
+    return _backend;
+}
+
 bool BackendService::is_dynamic() const {
     return _is_dynamic;
 }
 
+bool BackendService::request_reads_flow() const {
+    return _request_reads_flow;
+}
+
 const BRPC_NAMESPACE::AdaptiveProtocolType BackendService::protocol() const {
     return _backend->protocol();
 }
@@ -16,8 +16,11 @@
 #define USKIT_BACKEND_SERVICE_H
 
 #include <string>
+#include <memory>
 #include "dynamic_config.h"
 #include "backend.h"
+#include "fanout_stats.h"
+#include "retry_policy.h"
 #include "policy/backend_policy.h"
 
 namespace uskit {
@@ -38,15 +41,27 @@ public:
     // Initialize backend service from configuration.
     // Returns 0 on success, -1 otherwise.
     int init(const ServiceConfig& service_config, Backend* backend);
-    // Build request for RPC
+    // Build request for RPC, the call is skipped and marked failed if circuit
+    // breaker of backend is open or no concurrency slot is acquired for it,
+    // see BackendEngine::run.
+    // Calls are deposited into retry budget of backend.
     // Returns 0 on success, -1 otherwise.
     int build_request(BackendController* cntl) const;
+    // Release concurrency slot of a finished RPC, called in its done closure.
+    void release_concurrency(BackendController* cntl) const;
+    // Feed result of a finished RPC to circuit breaker of backend, fan-out
+    // statistics of dynamic service are recorded as well.
+    void on_call_end(BackendController* cntl) const;
+    // Release resources held by a call which is not finished normally.
+    void on_call_abort(BackendController* cntl) const;
 
     // Parse response received from RPC
     // Returns 0 on success, -1 otherwise.
     int parse_response(BackendController* cntl) const;
 
     const std::string& name() const;
+    // Obtain the backend that this service belongs to.
+    const Backend* backend() const;
     // Obtain the protocol associated with this service.
     // Currently supported protocols: HTTP, Redis.
     const BRPC_NAMESPACE::AdaptiveProtocolType protocol() const;
@@ -54,16 +69,32 @@ public:
     int run_success_flag(expression::ExpressionContext& context ,bool& bool_value) const;
 
     bool is_dynamic() const;
+    // Whether request of this service refers to `$backend' or `$result', i.e.
+    // depends on results of flow nodes before.
+    bool request_reads_flow() const;
 
 private:
+    // Fail the call without issuing it and fill in fallback response if configured.
+    // Returns -1 always, the call should not be joined.
+    int reject(BackendController* cntl, int error_code, const std::string& reason) const;
+
     // Name of this service
     std::string _name;
     // Backend that this service belongs to
     Backend* _backend;
     // Dynamic requests FLAG
     bool _is_dynamic;
+    // Request refers to `$backend' or `$result'
+    bool _request_reads_flow;
     // Flags (AND-statements) define service success
     KEVec _condition;
+    // Response used when circuit breaker is open
+    KEMap _fallback;
+    // Fan-out statistics of dynamic service
+    std::unique_ptr<FanoutRecorder> _fanout_recorder;
+    // Retry policy of service, used by channel of request policy so it must
+    // outlive the policy
+    std::unique_ptr<ServiceRetryPolicy> _retry_policy;
 
     // Policy for building backend request
     std::unique_ptr<policy::BackendRequestPolicy> _request_policy;
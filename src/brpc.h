@@ -27,6 +27,10 @@
 #include BRPC_INCLUDE_PREFIX/channel.h>
 #include BRPC_INCLUDE_PREFIX/controller.h>
 #include BRPC_INCLUDE_PREFIX/restful.h>
+#include BRPC_INCLUDE_PREFIX/retry_policy.h>
 #include BRPC_INCLUDE_PREFIX/server.h>
+#include BRPC_INCLUDE_PREFIX/socket.h>
+#include BRPC_INCLUDE_PREFIX/details/naming_service_thread.h>
+#include BRPC_INCLUDE_PREFIX/traceprintf.h>
 
 #endif  // USKIT_BRPC_H
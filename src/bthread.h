@@ -0,0 +1,32 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_BTHREAD_H
+#define USKIT_BTHREAD_H
+
+#ifndef BTHREAD_INCLUDE_PREFIX
+#define BTHREAD_INCLUDE_PREFIX <bthread
+#endif
+
+#ifndef BTHREAD_NAMESPACE
+#define BTHREAD_NAMESPACE bthread
+#endif
+
+#include BTHREAD_INCLUDE_PREFIX/bthread.h>
+#include BTHREAD_INCLUDE_PREFIX/mutex.h>
+#include BTHREAD_INCLUDE_PREFIX/condition_variable.h>
+#include BTHREAD_INCLUDE_PREFIX/countdown_event.h>
+#include BTHREAD_INCLUDE_PREFIX/unstable.h>
+
+#endif  // USKIT_BTHREAD_H
@@ -0,0 +1,115 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include "channel_registry.h"
+#include "butil.h"
+
+namespace uskit {
+
+ChannelRegistry& ChannelRegistry::instance() {
+    static ChannelRegistry registry;
+    return registry;
+}
+
+static std::string channel_key(
+        const std::string& server,
+        const std::string& load_balancer,
+        const BRPC_NAMESPACE::ChannelOptions& options) {
+    std::string key(server);
+    key.append("|").append(load_balancer);
+    key.append("|").append(options.protocol.name());
+    if (options.protocol.has_param()) {
+        key.append(":").append(options.protocol.param());
+    }
+    key.append("|").append(options.connection_type.name());
+    key.append("|").append(std::to_string(options.connect_timeout_ms));
+    key.append("|").append(std::to_string(options.timeout_ms));
+    key.append("|").append(std::to_string(options.max_retry));
+    // Channels with retry policy are owned by the service of the policy.
+    if (options.retry_policy != nullptr) {
+        key.append("|").append(std::to_string(reinterpret_cast<uintptr_t>(options.retry_policy)));
+    }
+    return key;
+}
+
+std::shared_ptr<BRPC_NAMESPACE::Channel> ChannelRegistry::acquire(
+        const std::shared_ptr<Entry>& entry) {
+    ++entry->users;
+    // Channel is owned by entry, the returned pointer only counts its users.
+    return std::shared_ptr<BRPC_NAMESPACE::Channel>(
+            entry->channel.get(), [entry](BRPC_NAMESPACE::Channel*) {
+                entry->last_release_ms = BUTIL_NAMESPACE::monotonic_time_ms();
+                --entry->users;
+            });
+}
+
+void ChannelRegistry::evict(int64_t now_ms) {
+    if (now_ms - _last_evict_ms < 1000) {
+        return;
+    }
+    _last_evict_ms = now_ms;
+    for (auto iter = _channels.begin(); iter != _channels.end();) {
+        const Entry& entry = *iter->second;
+        if (entry.users == 0 && now_ms - entry.last_release_ms >= _idle_timeout_ms) {
+            iter = _channels.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+std::shared_ptr<BRPC_NAMESPACE::Channel> ChannelRegistry::get(
+        const std::string& server,
+        const std::string& load_balancer,
+        const BRPC_NAMESPACE::ChannelOptions& options) {
+    const std::string key = channel_key(server, load_balancer, options);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        evict(BUTIL_NAMESPACE::monotonic_time_ms());
+        auto iter = _channels.find(key);
+        if (iter != _channels.end()) {
+            return acquire(iter->second);
+        }
+    }
+
+    // Initialize outside of lock, resolving naming service may take a while.
+    std::shared_ptr<BRPC_NAMESPACE::Channel> channel(new BRPC_NAMESPACE::Channel);
+    if (channel->Init(server.c_str(), load_balancer.c_str(), &options) != 0) {
+        LOG(WARNING) << "Failed to initialize channel to [" << server << "]";
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::shared_ptr<Entry>& entry = _channels[key];
+    if (!entry) {
+        entry.reset(new Entry);
+        entry->channel = channel;
+        entry->users = 0;
+        entry->last_release_ms = 0;
+    }
+    // Otherwise created by another user concurrently.
+    return acquire(entry);
+}
+
+size_t ChannelRegistry::size() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _channels.size();
+}
+
+void ChannelRegistry::set_idle_timeout_ms(int64_t idle_timeout_ms) {
+    _idle_timeout_ms = idle_timeout_ms;
+}
+
+}  // namespace uskit
@@ -0,0 +1,77 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_CHANNEL_REGISTRY_H
+#define USKIT_CHANNEL_REGISTRY_H
+
+#include <string>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "brpc.h"
+
+namespace uskit {
+
+// Process-wide registry of channels, backends of different usids and reloaded
+// configurations share one channel(and its naming service and connections) if
+// they are created with the same server and options.
+// Channels are reference counted by their users. A channel released by its
+// last user is kept for an idle timeout, so configurations created per
+// request reuse it, and is destroyed lazily after that.
+class ChannelRegistry {
+public:
+    static ChannelRegistry& instance();
+
+    // Obtain a channel to `server', which is created if not exists. Channels are
+    // identified by server, load balancer, protocol, connection type, timeouts,
+    // max retry and retry policy, i.e. the options set by backend configuration.
+    // Returns nullptr on failure.
+    std::shared_ptr<BRPC_NAMESPACE::Channel> get(
+            const std::string& server,
+            const std::string& load_balancer,
+            const BRPC_NAMESPACE::ChannelOptions& options);
+    // Number of channels alive, including idle ones.
+    size_t size();
+    // Set how long a channel without users is kept.
+    void set_idle_timeout_ms(int64_t idle_timeout_ms);
+
+private:
+    struct Entry {
+        std::shared_ptr<BRPC_NAMESPACE::Channel> channel;
+        // Number of users holding the channel
+        std::atomic<int> users;
+        // When the channel was released by a user last time
+        std::atomic<int64_t> last_release_ms;
+    };
+
+    ChannelRegistry() : _idle_timeout_ms(60000), _last_evict_ms(0) {}
+    ChannelRegistry(const ChannelRegistry&) = delete;
+    ChannelRegistry& operator=(const ChannelRegistry&) = delete;
+
+    // Hand out the channel of entry to a new user.
+    static std::shared_ptr<BRPC_NAMESPACE::Channel> acquire(const std::shared_ptr<Entry>& entry);
+    // Drop channels idle for longer than idle timeout, at most once a second.
+    // Must be called with `_mutex' held.
+    void evict(int64_t now_ms);
+
+    std::mutex _mutex;
+    std::unordered_map<std::string, std::shared_ptr<Entry>> _channels;
+    std::atomic<int64_t> _idle_timeout_ms;
+    int64_t _last_evict_ms;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_CHANNEL_REGISTRY_H
@@ -0,0 +1,222 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <sstream>
+#include "circuit_breaker.h"
+#include "butil.h"
+
+namespace uskit {
+
+// Number of buckets the statistic window is divided into.
+static const int kWindowBuckets = 10;
+
+static const char* state_name(CircuitBreaker::State state) {
+    switch (state) {
+    case CircuitBreaker::CLOSED:
+        return "closed";
+    case CircuitBreaker::OPEN:
+        return "open";
+    case CircuitBreaker::HALF_OPEN:
+        return "half_open";
+    }
+    return "unknown";
+}
+
+CircuitBreaker::CircuitBreaker() :
+        _bucket_ms(1000),
+        _state(CLOSED),
+        _open_until_ms(0),
+        _isolation_ms(0),
+        _probing(0),
+        _probe_success(0),
+        _probe_deadline_ms(0) {}
+
+CircuitBreaker::~CircuitBreaker() {}
+
+int CircuitBreaker::init(
+        const std::string& usid, const std::string& name, const CircuitBreakerConfig& config) {
+    if (config.error_rate_threshold() <= 0 || config.slow_rate_threshold() <= 0) {
+        LOG(ERROR) << "Circuit breaker of backend [" << name << "] requires positive rate threshold";
+        return -1;
+    }
+    if (config.window_ms() < kWindowBuckets || config.isolation_ms() <= 0
+            || config.max_isolation_ms() < config.isolation_ms()
+            || config.half_open_probes() <= 0 || config.probe_timeout_ms() <= 0) {
+        LOG(ERROR) << "Invalid circuit breaker config of backend [" << name << "]";
+        return -1;
+    }
+    _name = name;
+    _config = config;
+    _bucket_ms = config.window_ms() / kWindowBuckets;
+    _buckets.assign(kWindowBuckets, Bucket{0, 0, 0, 0});
+    _isolation_ms = config.isolation_ms();
+    if (!usid.empty()) {
+        _status.reset(new BVAR_NAMESPACE::PassiveStatus<std::string>(
+                "us_circuit_breaker_" + usid + "_" + name, describe_status, this));
+    }
+    return 0;
+}
+
+bool CircuitBreaker::on_call_begin() {
+    const int64_t now_ms = BUTIL_NAMESPACE::monotonic_time_ms();
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_state == OPEN) {
+        if (now_ms < _open_until_ms) {
+            _rejected << 1;
+            return false;
+        }
+        _state = HALF_OPEN;
+        _probing = 0;
+        _probe_success = 0;
+        LOG(INFO) << "Circuit breaker of backend [" << _name << "] is half open";
+    }
+    if (_state == HALF_OPEN) {
+        if (_probing > 0 && now_ms >= _probe_deadline_ms) {
+            LOG(WARNING) << "Probes of circuit breaker of backend [" << _name << "] timed out";
+            _probing = 0;
+        }
+        if (_probing + _probe_success >= _config.half_open_probes()) {
+            _rejected << 1;
+            return false;
+        }
+        ++_probing;
+        _probe_deadline_ms = now_ms + _config.probe_timeout_ms();
+    }
+    return true;
+}
+
+void CircuitBreaker::on_call_abort() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_state == HALF_OPEN && _probing > 0) {
+        --_probing;
+    }
+}
+
+void CircuitBreaker::on_call_end(bool failed, int64_t latency_us) {
+    const bool slow = _config.latency_threshold_ms() > 0
+            && latency_us > _config.latency_threshold_ms() * 1000L;
+    const int64_t now_ms = BUTIL_NAMESPACE::monotonic_time_ms();
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_state == OPEN) {
+        // Calls issued before the breaker was tripped.
+        return;
+    }
+    if (_state == HALF_OPEN) {
+        if (_probing > 0) {
+            --_probing;
+        }
+        if (failed || slow) {
+            _isolation_ms = std::min<int64_t>(_isolation_ms * 2, _config.max_isolation_ms());
+            trip(now_ms);
+            return;
+        }
+        if (++_probe_success >= _config.half_open_probes()) {
+            reset();
+            LOG(INFO) << "Circuit breaker of backend [" << _name << "] is closed";
+        }
+        return;
+    }
+
+    Bucket& bucket = current_bucket(now_ms);
+    ++bucket.total;
+    if (failed) {
+        ++bucket.error;
+    }
+    if (slow) {
+        ++bucket.slow;
+    }
+    int64_t total = 0;
+    int64_t error = 0;
+    int64_t slow_count = 0;
+    window_stat(now_ms, total, error, slow_count);
+    if (total < _config.min_request()) {
+        return;
+    }
+    if (error * 100 >= total * _config.error_rate_threshold()
+            || (_config.latency_threshold_ms() > 0
+                && slow_count * 100 >= total * _config.slow_rate_threshold())) {
+        LOG(WARNING) << "Circuit breaker of backend [" << _name << "] is tripped, requests: "
+                     << total << ", errors: " << error << ", slow calls: " << slow_count;
+        trip(now_ms);
+    }
+}
+
+CircuitBreaker::State CircuitBreaker::state() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _state;
+}
+
+std::string CircuitBreaker::describe() {
+    int64_t total = 0;
+    int64_t error = 0;
+    int64_t slow = 0;
+    State state = CLOSED;
+    int64_t isolation_ms = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        window_stat(BUTIL_NAMESPACE::monotonic_time_ms(), total, error, slow);
+        state = _state;
+        isolation_ms = _isolation_ms;
+    }
+    std::ostringstream os;
+    os << "state=" << state_name(state)
+       << " requests=" << total
+       << " errors=" << error
+       << " slow=" << slow
+       << " isolation_ms=" << isolation_ms
+       << " rejected=" << _rejected.get_value();
+    return os.str();
+}
+
+CircuitBreaker::Bucket& CircuitBreaker::current_bucket(int64_t now_ms) {
+    const int64_t start_ms = now_ms - now_ms % _bucket_ms;
+    Bucket& bucket = _buckets[(now_ms / _bucket_ms) % _buckets.size()];
+    if (bucket.start_ms != start_ms) {
+        bucket = Bucket{start_ms, 0, 0, 0};
+    }
+    return bucket;
+}
+
+void CircuitBreaker::window_stat(int64_t now_ms, int64_t& total, int64_t& error, int64_t& slow) {
+    const int64_t window_begin_ms = now_ms - _bucket_ms * _buckets.size();
+    for (const auto& bucket : _buckets) {
+        if (bucket.start_ms > window_begin_ms) {
+            total += bucket.total;
+            error += bucket.error;
+            slow += bucket.slow;
+        }
+    }
+}
+
+void CircuitBreaker::trip(int64_t now_ms) {
+    _state = OPEN;
+    _open_until_ms = now_ms + _isolation_ms;
+    _probing = 0;
+    _probe_success = 0;
+}
+
+void CircuitBreaker::reset() {
+    _state = CLOSED;
+    _isolation_ms = _config.isolation_ms();
+    _probing = 0;
+    _probe_success = 0;
+    std::fill(_buckets.begin(), _buckets.end(), Bucket{0, 0, 0, 0});
+}
+
+void CircuitBreaker::describe_status(std::ostream& os, void* arg) {
+    os << static_cast<CircuitBreaker*>(arg)->describe();
+}
+
+}  // namespace uskit
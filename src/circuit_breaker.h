@@ -0,0 +1,94 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_CIRCUIT_BREAKER_H
+#define USKIT_CIRCUIT_BREAKER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include "bvar.h"
+#include "config.pb.h"
+
+namespace uskit {
+
+// A circuit breaker guards a backend from being called while it is unhealthy.
+// Call results are accumulated in a sliding time window, the breaker is tripped
+// when error rate or slow call rate in window exceeds the configured threshold.
+// Calls are rejected while the breaker is open, after isolation a few probe
+// calls are let through(half-open) to decide whether the breaker can be closed.
+// Probes which are not finished within `probe_timeout_ms` are given up.
+// Breaker state is exposed as bvar `us_circuit_breaker_<usid>_<name>`.
+class CircuitBreaker {
+public:
+    enum State {
+        CLOSED = 0,
+        OPEN = 1,
+        HALF_OPEN = 2,
+    };
+
+    CircuitBreaker();
+    ~CircuitBreaker();
+    // Initialize from configuration, state is not exposed if `usid' is empty.
+    // Returns 0 on success, -1 otherwise.
+    int init(const std::string& usid, const std::string& name, const CircuitBreakerConfig& config);
+    // Called before issuing a call.
+    // Returns true if the call is allowed, false if it should be rejected.
+    bool on_call_begin();
+    // Called when an allowed call was not finished normally, i.e. failed to
+    // build request or canceled by scheduler. The result is not accounted.
+    void on_call_abort();
+    // Called when an allowed call is finished.
+    void on_call_end(bool failed, int64_t latency_us);
+
+    State state();
+    // Readable description of current state and statistics.
+    std::string describe();
+
+private:
+    struct Bucket {
+        int64_t start_ms;
+        int64_t total;
+        int64_t error;
+        int64_t slow;
+    };
+    // Drop outdated buckets and return the current one, must be called with lock held.
+    Bucket& current_bucket(int64_t now_ms);
+    // Sum up statistics in window, must be called with lock held.
+    void window_stat(int64_t now_ms, int64_t& total, int64_t& error, int64_t& slow);
+    void trip(int64_t now_ms);
+    void reset();
+    static void describe_status(std::ostream& os, void* arg);
+
+    std::string _name;
+    CircuitBreakerConfig _config;
+    std::mutex _mutex;
+    std::vector<Bucket> _buckets;
+    int64_t _bucket_ms;
+    State _state;
+    int64_t _open_until_ms;
+    int64_t _isolation_ms;
+    // Probe calls in flight and probe calls succeeded in half-open state
+    int _probing;
+    int _probe_success;
+    // Probes in flight are given up after this time
+    int64_t _probe_deadline_ms;
+    BVAR_NAMESPACE::Adder<int64_t> _rejected;
+    std::unique_ptr<BVAR_NAMESPACE::PassiveStatus<std::string>> _status;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_CIRCUIT_BREAKER_H
@@ -0,0 +1,154 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include "concurrency_limiter.h"
+#include "butil.h"
+
+namespace uskit {
+
+// Drift of the lowest latency per sampling window, so that the limiter could
+// adapt when the backend becomes slower permanently.
+static const double kMinLatencyDrift = 1.01;
+
+ConcurrencyLimiter::ConcurrencyLimiter() :
+        _gradient(false),
+        _in_flight(0),
+        _limit(0),
+        _sample_start_us(0),
+        _sample_count(0),
+        _sample_latency_sum_us(0),
+        _min_latency_us(0) {}
+
+ConcurrencyLimiter::~ConcurrencyLimiter() {}
+
+int ConcurrencyLimiter::init(
+        const std::string& usid, const std::string& name, const ConcurrencyLimiterConfig& config) {
+    if (config.type() == "constant") {
+        _gradient = false;
+    } else if (config.type() == "gradient") {
+        _gradient = true;
+    } else {
+        LOG(ERROR) << "Unknown concurrency limiter type [" << config.type() << "] of backend ["
+                   << name << "]";
+        return -1;
+    }
+    if (config.max_concurrency() <= 0 || config.queue_timeout_ms() < 0
+            || config.min_concurrency() <= 0 || config.min_concurrency() > config.max_concurrency()
+            || config.sample_window_ms() <= 0) {
+        LOG(ERROR) << "Invalid concurrency limiter config of backend [" << name << "]";
+        return -1;
+    }
+    _name = name;
+    _config = config;
+    _limit = config.max_concurrency();
+    _sample_start_us = BUTIL_NAMESPACE::monotonic_time_us();
+    if (!usid.empty()) {
+        _status.reset(new BVAR_NAMESPACE::PassiveStatus<std::string>(
+                "us_concurrency_limiter_" + usid + "_" + name, describe_status, this));
+    }
+    return 0;
+}
+
+int ConcurrencyLimiter::acquire(int count) {
+    std::unique_lock<BTHREAD_NAMESPACE::Mutex> lock(_mutex);
+    if (_in_flight + count > _limit && count <= _limit && _config.queue_timeout_ms() > 0) {
+        const int64_t deadline_us =
+                BUTIL_NAMESPACE::monotonic_time_us() + _config.queue_timeout_ms() * 1000L;
+        while (_in_flight + count > _limit) {
+            const int64_t now_us = BUTIL_NAMESPACE::monotonic_time_us();
+            if (now_us >= deadline_us) {
+                break;
+            }
+            _cond.wait_for(lock, deadline_us - now_us);
+        }
+    }
+    const int acquired = std::max(0, std::min(count, _limit - _in_flight));
+    _in_flight += acquired;
+    if (acquired < count) {
+        _rejected << count - acquired;
+    }
+    return acquired;
+}
+
+void ConcurrencyLimiter::release(bool failed, int64_t latency_us) {
+    std::unique_lock<BTHREAD_NAMESPACE::Mutex> lock(_mutex);
+    --_in_flight;
+    // Failed calls are mostly timeouts, whose latency says little about capacity.
+    if (_gradient && !failed) {
+        ++_sample_count;
+        _sample_latency_sum_us += latency_us;
+        update_limit(BUTIL_NAMESPACE::monotonic_time_us());
+    }
+    _cond.notify_all();
+}
+
+void ConcurrencyLimiter::cancel() {
+    std::unique_lock<BTHREAD_NAMESPACE::Mutex> lock(_mutex);
+    --_in_flight;
+    // Waiters may wait for several slots.
+    _cond.notify_all();
+}
+
+std::string ConcurrencyLimiter::describe() {
+    int in_flight = 0;
+    int limit = 0;
+    double min_latency_us = 0;
+    {
+        std::unique_lock<BTHREAD_NAMESPACE::Mutex> lock(_mutex);
+        in_flight = _in_flight;
+        limit = _limit;
+        min_latency_us = _min_latency_us;
+    }
+    std::ostringstream os;
+    os << "type=" << _config.type()
+       << " in_flight=" << in_flight
+       << " limit=" << limit;
+    if (_gradient) {
+        os << " min_latency_us=" << static_cast<int64_t>(min_latency_us);
+    }
+    os << " rejected=" << _rejected.get_value();
+    return os.str();
+}
+
+void ConcurrencyLimiter::update_limit(int64_t now_us) {
+    if (now_us - _sample_start_us < _config.sample_window_ms() * 1000L || _sample_count == 0) {
+        return;
+    }
+    const double avg_latency_us = static_cast<double>(_sample_latency_sum_us) / _sample_count;
+    _sample_start_us = now_us;
+    _sample_count = 0;
+    _sample_latency_sum_us = 0;
+    if (avg_latency_us <= 0) {
+        return;
+    }
+    if (_min_latency_us <= 0 || avg_latency_us < _min_latency_us) {
+        _min_latency_us = avg_latency_us;
+    } else {
+        _min_latency_us *= kMinLatencyDrift;
+    }
+    // Shrink when latency grows, leave sqrt(limit) headroom for probing more capacity.
+    const double gradient = std::max(0.5, std::min(1.0, _min_latency_us / avg_latency_us));
+    const double new_limit = _limit * gradient + std::sqrt(static_cast<double>(_limit));
+    _limit = std::max(_config.min_concurrency(),
+            std::min(_config.max_concurrency(), static_cast<int>(std::lround(new_limit))));
+}
+
+void ConcurrencyLimiter::describe_status(std::ostream& os, void* arg) {
+    os << static_cast<ConcurrencyLimiter*>(arg)->describe();
+}
+
+}  // namespace uskit
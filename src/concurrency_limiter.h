@@ -0,0 +1,77 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_CONCURRENCY_LIMITER_H
+#define USKIT_CONCURRENCY_LIMITER_H
+
+#include <string>
+#include <memory>
+#include "bthread.h"
+#include "bvar.h"
+#include "config.pb.h"
+
+namespace uskit {
+
+// A concurrency limiter bounds in-flight calls issued to a backend(bulkhead).
+// Slots of all calls to a backend within one recall are acquired at once
+// before any of them is issued, and each slot is released when its call
+// finishes.
+// With `constant` type the limit is fixed to `max_concurrency`, with `gradient`
+// type the limit is adjusted between `min_concurrency` and `max_concurrency`
+// by the ratio between the lowest and the current sampled latency.
+// Limiter state is exposed as bvar `us_concurrency_limiter_<usid>_<name>`.
+class ConcurrencyLimiter {
+public:
+    ConcurrencyLimiter();
+    ~ConcurrencyLimiter();
+    // Initialize from configuration, state is not exposed if `usid' is empty.
+    // Returns 0 on success, -1 otherwise.
+    int init(const std::string& usid, const std::string& name,
+            const ConcurrencyLimiterConfig& config);
+    // Acquire `count' slots at once, wait at most `queue_timeout_ms` until
+    // all of them fit, never wait if `count' exceeds the limit.
+    // Returns number of slots acquired, calls without slot should be rejected.
+    int acquire(int count);
+    // Release a slot after the call is finished.
+    void release(bool failed, int64_t latency_us);
+    // Release a slot without sampling, i.e. the call was not issued.
+    void cancel();
+
+    // Readable description of current state and statistics.
+    std::string describe();
+
+private:
+    // Update limit with sampled latency, must be called with lock held.
+    void update_limit(int64_t now_us);
+    static void describe_status(std::ostream& os, void* arg);
+
+    std::string _name;
+    ConcurrencyLimiterConfig _config;
+    bool _gradient;
+    BTHREAD_NAMESPACE::Mutex _mutex;
+    BTHREAD_NAMESPACE::ConditionVariable _cond;
+    int _in_flight;
+    int _limit;
+    // Latency samples of gradient limiter
+    int64_t _sample_start_us;
+    int64_t _sample_count;
+    int64_t _sample_latency_sum_us;
+    double _min_latency_us;
+    BVAR_NAMESPACE::Adder<int64_t> _rejected;
+    std::unique_ptr<BVAR_NAMESPACE::PassiveStatus<std::string>> _status;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_CONCURRENCY_LIMITER_H
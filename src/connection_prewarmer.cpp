@@ -0,0 +1,190 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connection_prewarmer.h"
+#include <set>
+#include "butil.h"
+
+namespace uskit {
+
+struct ConnectionPrewarmer::Probe {
+    // Index of result in `_results'
+    size_t result_index;
+    std::shared_ptr<BRPC_NAMESPACE::Channel> channel;
+    BRPC_NAMESPACE::Controller cntl;
+    BRPC_NAMESPACE::RedisRequest redis_request;
+    BRPC_NAMESPACE::RedisResponse redis_response;
+    const google::protobuf::MethodDescriptor* method = nullptr;
+    std::unique_ptr<google::protobuf::Message> pb_request;
+    std::unique_ptr<google::protobuf::Message> pb_response;
+};
+
+// Collect servers reported by naming service.
+class ServerCollector : public BRPC_NAMESPACE::NamingServiceWatcher {
+public:
+    void OnAddedServers(const std::vector<BRPC_NAMESPACE::ServerId>& servers) override {
+        for (const auto& server : servers) {
+            BRPC_NAMESPACE::SocketUniquePtr socket;
+            if (BRPC_NAMESPACE::Socket::AddressFailedAsWell(server.id, &socket) >= 0) {
+                _endpoints.insert(socket->remote_side());
+            }
+        }
+    }
+    void OnRemovedServers(const std::vector<BRPC_NAMESPACE::ServerId>& servers) override {}
+    const std::set<BUTIL_NAMESPACE::EndPoint>& endpoints() const {
+        return _endpoints;
+    }
+
+private:
+    std::set<BUTIL_NAMESPACE::EndPoint> _endpoints;
+};
+
+// Obtain servers behind `server', which is either an address or a naming
+// service url.
+// Returns 0 on success, -1 otherwise.
+static int list_servers(const std::string& server, std::set<BUTIL_NAMESPACE::EndPoint>& endpoints) {
+    if (server.find("://") == std::string::npos) {
+        BUTIL_NAMESPACE::EndPoint endpoint;
+        if (BUTIL_NAMESPACE::str2endpoint(server.c_str(), &endpoint) != 0 &&
+            BUTIL_NAMESPACE::hostname2endpoint(server.c_str(), &endpoint) != 0) {
+            return -1;
+        }
+        endpoints.insert(endpoint);
+        return 0;
+    }
+    BUTIL_NAMESPACE::intrusive_ptr<BRPC_NAMESPACE::NamingServiceThread> ns_thread;
+    if (BRPC_NAMESPACE::GetNamingServiceThread(&ns_thread, server.c_str(), nullptr) != 0) {
+        return -1;
+    }
+    // Current servers are reported to a watcher as soon as it is added.
+    ServerCollector collector;
+    if (ns_thread->AddWatcher(&collector) != 0) {
+        return -1;
+    }
+    ns_thread->RemoveWatcher(&collector);
+    endpoints = collector.endpoints();
+    return 0;
+}
+
+ConnectionPrewarmer::ConnectionPrewarmer() {}
+
+ConnectionPrewarmer::~ConnectionPrewarmer() {}
+
+void ConnectionPrewarmer::add(const std::string& name, const Backend& backend) {
+    const PrewarmConfig* config = backend.prewarm_config();
+    std::shared_ptr<BRPC_NAMESPACE::Channel> channel = backend.channel();
+    if (config == nullptr || !channel || !_channels.insert(channel.get()).second) {
+        return;
+    }
+    const BRPC_NAMESPACE::AdaptiveProtocolType protocol = backend.protocol();
+    const google::protobuf::MethodDescriptor* method = nullptr;
+    if (protocol == BRPC_NAMESPACE::PROTOCOL_BAIDU_STD || protocol == BRPC_NAMESPACE::PROTOCOL_H2) {
+        if (backend.proto_schema() != nullptr && config->has_pb_method()) {
+            method = backend.proto_schema()->find_method(config->pb_method());
+        }
+        if (method == nullptr) {
+            LOG(WARNING) << "Skip prewarming backend [" << name << "], pb_method ["
+                         << config->pb_method() << "] not found";
+            return;
+        }
+    } else if (protocol != BRPC_NAMESPACE::PROTOCOL_HTTP &&
+               protocol != BRPC_NAMESPACE::PROTOCOL_REDIS) {
+        LOG(WARNING) << "Skip prewarming backend [" << name << "] of unsupported protocol";
+        return;
+    }
+
+    // Probe every server through a channel of its own, since load balancer
+    // of backend channel may not spread probes over all servers.
+    std::vector<std::shared_ptr<BRPC_NAMESPACE::Channel>> server_channels;
+    std::set<BUTIL_NAMESPACE::EndPoint> endpoints;
+    if (list_servers(backend.server(), endpoints) == 0) {
+        for (const auto& endpoint : endpoints) {
+            std::shared_ptr<BRPC_NAMESPACE::Channel> server_channel(new BRPC_NAMESPACE::Channel);
+            if (server_channel->Init(endpoint, &channel->options()) != 0) {
+                LOG(WARNING) << "Failed to initialize channel to server [" << endpoint
+                             << "] of backend [" << name << "]";
+                continue;
+            }
+            server_channels.emplace_back(std::move(server_channel));
+        }
+    } else {
+        LOG(WARNING) << "Failed to list servers of backend [" << name
+                     << "], probe through backend channel";
+        server_channels.emplace_back(channel);
+    }
+
+    _results.push_back(PrewarmResult{
+            name, config->connections() * static_cast<int>(server_channels.size()), 0});
+    for (int i = 0; i < _results.back().probes; ++i) {
+        std::unique_ptr<Probe> probe(new Probe);
+        probe->result_index = _results.size() - 1;
+        probe->channel = server_channels[i % server_channels.size()];
+        probe->cntl.set_timeout_ms(config->timeout_ms());
+        // Probes are not retried, a failed one is just reported.
+        probe->cntl.set_max_retry(0);
+        if (protocol == BRPC_NAMESPACE::PROTOCOL_HTTP) {
+            probe->cntl.http_request().uri() = config->http_uri();
+        } else if (protocol == BRPC_NAMESPACE::PROTOCOL_REDIS) {
+            probe->redis_request.AddCommand("PING");
+        } else {
+            probe->method = method;
+            probe->pb_request.reset(backend.proto_schema()->new_message(method->input_type()));
+            probe->pb_response.reset(backend.proto_schema()->new_message(method->output_type()));
+        }
+        _probes.emplace_back(std::move(probe));
+    }
+}
+
+void ConnectionPrewarmer::run() {
+    for (auto& probe : _probes) {
+        if (probe->method != nullptr) {
+            probe->channel->CallMethod(probe->method, &probe->cntl, probe->pb_request.get(),
+                    probe->pb_response.get(), BRPC_NAMESPACE::DoNothing());
+        } else if (probe->redis_request.command_size() > 0) {
+            probe->channel->CallMethod(nullptr, &probe->cntl, &probe->redis_request,
+                    &probe->redis_response, BRPC_NAMESPACE::DoNothing());
+        } else {
+            probe->channel->CallMethod(
+                    nullptr, &probe->cntl, nullptr, nullptr, BRPC_NAMESPACE::DoNothing());
+        }
+    }
+    for (auto& probe : _probes) {
+        BRPC_NAMESPACE::Join(probe->cntl.call_id());
+        const int error_code = probe->cntl.ErrorCode();
+        if (!probe->cntl.Failed() || error_code == BRPC_NAMESPACE::EHTTP ||
+            error_code == BRPC_NAMESPACE::ENOSERVICE || error_code == BRPC_NAMESPACE::ENOMETHOD) {
+            ++_results[probe->result_index].answered;
+        }
+    }
+    _probes.clear();
+    for (const auto& result : _results) {
+        LOG(INFO) << "Prewarmed backend [" << result.backend << "], " << result.answered
+                  << " of " << result.probes << " probes answered";
+    }
+}
+
+void ConnectionPrewarmer::dump(
+        rapidjson::Value& value,
+        rapidjson::Document::AllocatorType& allocator) const {
+    value.SetArray();
+    for (const auto& result : _results) {
+        rapidjson::Value item(rapidjson::kObjectType);
+        item.AddMember("backend", rapidjson::Value(result.backend.c_str(), allocator), allocator);
+        item.AddMember("probes", result.probes, allocator);
+        item.AddMember("answered", result.answered, allocator);
+        value.PushBack(item, allocator);
+    }
+}
+
+}  // namespace uskit
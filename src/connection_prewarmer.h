@@ -0,0 +1,67 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_CONNECTION_PREWARMER_H
+#define USKIT_CONNECTION_PREWARMER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_set>
+#include <rapidjson/document.h>
+#include "brpc.h"
+#include "backend.h"
+
+namespace uskit {
+
+// Result of prewarming a backend.
+struct PrewarmResult {
+    std::string backend;
+    // Number of probe calls issued
+    int probes;
+    // Number of probe calls answered by server
+    int answered;
+};
+
+// Establish connections of backends before serving traffic by issuing
+// concurrent probe calls to every server behind their channels: HTTP GET,
+// Redis PING or an empty protobuf call. A probe answered with an error, i.e. HTTP 404, still
+// counts since the connection is established.
+// Backends sharing one channel are prewarmed once. Probes of all backends are
+// issued together and joined at the end.
+class ConnectionPrewarmer {
+public:
+    ConnectionPrewarmer();
+    ~ConnectionPrewarmer();
+    // Add probes of backend if prewarm is configured.
+    void add(const std::string& name, const Backend& backend);
+    // Issue all probes and wait until they are finished.
+    void run();
+    const std::vector<PrewarmResult>& results() const {
+        return _results;
+    }
+    // Dump results as JSON array.
+    void dump(rapidjson::Value& value, rapidjson::Document::AllocatorType& allocator) const;
+
+private:
+    struct Probe;
+
+    std::vector<std::unique_ptr<Probe>> _probes;
+    std::vector<PrewarmResult> _results;
+    std::unordered_set<const BRPC_NAMESPACE::Channel*> _channels;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_CONNECTION_PREWARMER_H
@@ -17,6 +17,7 @@
 #include "policy/flow_policy.h"
 #include "controller_closure.h"
 #include "backend_controller.h"
+#include "request_trace.h"
 
 namespace uskit {
 
@@ -56,6 +57,7 @@ void BaseRPCClosure::Run() {
                      << " failed, live others alive.";
         return;
     }
+    ScopedSpan span(_cntl->trace(), "cancel", _cntl->service_name());
     for (auto rpc_id : _rpc_ids) {
         US_DLOG(INFO) << "start cancel rpc_id: " << rpc_id.first.value;
         cancel(rpc_id);
@@ -86,6 +88,7 @@ void GlobalClosure::cancel(CallIdPriorityPair rpc_id) const {
 }
 
 void GlobalClosure::cancel() {
+    ScopedSpan span(_cntl->trace(), "cancel", _cntl->service_name());
     if (_cntl->get_cancel_order() == std::string("GLOBAL_CANCEL")) {
         if (GlobalCancel() != 0) {
             US_LOG(WARNING) << "GLOBAL_CANCEL Failed";
@@ -131,7 +134,9 @@ int GlobalClosure::ResponseCheck() {
     Timer tm("parse_response_t_ms(" + _cntl->service_name() + ")");
     tm.start();
 
-    if (brpc_cntl.Failed()) {
+    if (_cntl->is_fallback()) {
+        US_LOG(INFO) << "Use fallback response of service [" << _cntl->service_name() << "]";
+    } else if (brpc_cntl.Failed()) {
         US_LOG(WARNING) << "Failed to receive response from service [" << _cntl->service_name()
                         << "]"
                         << " remote_server=" << brpc_cntl.remote_side()
@@ -139,16 +144,18 @@ int GlobalClosure::ResponseCheck() {
                         << " error_msg=" << brpc_cntl.ErrorText();
         // Skip parsing
         return -1;
+    } else {
+        US_LOG(INFO) << "Received response from service [" << _cntl->service_name() << "]"
+                     << " remote_server=" << brpc_cntl.remote_side()
+                     << " latency=" << brpc_cntl.latency_us() << "us";
     }
-    US_LOG(INFO) << "Received response from service [" << _cntl->service_name() << "]"
-                 << " remote_server=" << brpc_cntl.remote_side()
-                 << " latency=" << brpc_cntl.latency_us() << "us";
-    // Parse response
+    // Parse response, fallback response is used as is
     std::lock_guard<std::mutex> lock(_cntl->context().parent()->_outer_mutex);
     expression::ExpressionContext* context = &_cntl->context();  // node name: flow block"
 
-    if (_cntl->parse_response() == 0) {
-        rapidjson::Value* backend_result = context->get_variable("backend");
+    if (_cntl->is_fallback() || _cntl->parse_response() == 0) {
+        // Write into own `backend' of service context, not the shared snapshot.
+        rapidjson::Value* backend_result = &FlowContextArray::local_backend(*context->parent());
         rapidjson::Value service_name;
         service_name.SetString(
                 _cntl->service_name().c_str(),
@@ -157,6 +164,11 @@ int GlobalClosure::ResponseCheck() {
         US_DLOG(INFO) << "service [" << _cntl->service_name()
                       << "] response: " << json_encode(_cntl->response());
         backend_result->AddMember(service_name, _cntl->response(), context->allocator());
+        // Merged view is only read by global cancel of global policies.
+        if (_cntl->_call_ids_ptr != nullptr) {
+            _cntl->_flow_context_array->merge_result(
+                    _cntl->service_name(), (*backend_result)[_cntl->service_name().c_str()]);
+        }
         US_DLOG(INFO) << "backend_result source: " << json_encode(*backend_result);
         US_DLOG(INFO) << "backend_result: "
                       << json_encode(*(context->get_variable("backend"))).c_str();
@@ -183,27 +195,21 @@ int GlobalClosure::GlobalCancel() {
     }
     // quit config check:
     auto curr_node_config = _flow_policy->get_flow_config(_cntl->_flow_name);
-    // construct dummy context combine result from context_array
-    USResponse tmp_response = USResponse(rapidjson::kObjectType);
-    expression::ExpressionContext dummy_context("dummy_top_context", tmp_response.GetAllocator());
-    rapidjson::Value* request_val = _cntl->context().get_variable("request");
-    rapidjson::Value copyvalue(*request_val, dummy_context.allocator());
-    dummy_context.set_variable("request", copyvalue);
-    dummy_context.set_variable("backend", rapidjson::Value().SetObject());
-    for (size_t index = 0; index != _cntl->_service_context_index.size(); ++index) {
-        expression::ExpressionContext* tmp_context = (*_cntl->_flow_context_array)[index].get();
-        std::lock_guard<std::mutex> lock(tmp_context->_outer_mutex);
-        US_DLOG(INFO) << "[GC] tmp_context->_outer_mutex: " << &(tmp_context->_outer_mutex);
-        rapidjson::Value backcopyvalue(
-                *(tmp_context->get_variable("backend")), dummy_context.allocator());
-        if (!backcopyvalue.IsNull()) {
-            dummy_context.merge_variable("backend", backcopyvalue);
-            // US_DLOG(INFO) << "dummy_context: " << dummy_context.str();
-        }
-        // US_DLOG(INFO) << "index: (" << index << ") backend res: " << json_encode(backcopyvalue);
+    // Evaluate quit condition against merged backend view, each service
+    // appends its own result to the view once parsed.
+    FlowContextArray& flow_context_array = *_cntl->_flow_context_array;
+    bool quit = false;
+    {
+        USResponse tmp_response = USResponse(rapidjson::kObjectType);
+        std::lock_guard<std::mutex> lock(flow_context_array.merged_mutex());
+        expression::ExpressionContext dummy_context(
+                "dummy_top_context",
+                flow_context_array.merged_context(),
+                tmp_response.GetAllocator());
+        quit = curr_node_config->second.run_quit_config(dummy_context);
     }
-    US_DLOG(INFO) << "[" << _cntl->_flow_name << "] GC backend merge complete";
-    if (curr_node_config->second.run_quit_config(dummy_context)) {
+    // Cancel outside the lock, callbacks of canceled calls may run here.
+    if (quit) {
         if (_cntl->_call_ids_ptr->quit_flow() != 0) {
             US_LOG(ERROR) << "quit flow ERROR";
             return -1;
@@ -223,6 +229,7 @@ int GlobalClosure::HelperInit(std::shared_ptr<policy::FlowPolicyHelper> helper)
 }
 
 void GlobalClosure::Run() {
+    ScopedSpan span(_cntl->trace(), "closure", _cntl->service_name());
     if (DynamicHTTPController* dhc = dynamic_cast<DynamicHTTPController*>(_cntl)) {
         std::lock_guard<std::mutex> dyn_lock(dhc->_outer_mutex);
         for (auto brpc_iter = dhc->brpc_controller_list().begin();
@@ -264,9 +271,17 @@ void GlobalClosure::Run() {
         std::string intervene_flow = "";
         auto flow_config_iter = _flow_policy->get_flow_config(next_flow);
         expression::ExpressionContext* top_context = &_cntl->context();
+        // Own `backend' of service context hides the snapshot's, intervene
+        // conditions are evaluated against both.
+        USResponse view_document(rapidjson::kObjectType);
+        expression::ExpressionContext view_context(
+                "intervene context", *top_context, view_document.GetAllocator());
+        rapidjson::Value view_backend =
+                FlowContextArray::backend_view(*top_context->parent(), view_context.allocator());
+        view_context.set_variable("backend", view_backend);
         // if intervene match, jump to target flow until no-matched
         while (true) {
-            if (flow_config_iter->second.get_intervene_flow(*top_context, intervene_flow) != 0) {
+            if (flow_config_iter->second.get_intervene_flow(view_context, intervene_flow) != 0) {
                 US_LOG(ERROR) << "flow get intervene flow failed: [" << next_flow << "]";
                 return;
             }
@@ -280,16 +295,20 @@ void GlobalClosure::Run() {
 
         US_DLOG(INFO) << "top_context: " << top_context->str();
         // Local context
-        std::vector<std::string> service_list = flow_config_iter->second.get_recall_service_list();
-        for (auto service_name : service_list) {
-            size_t index = _cntl->_service_context_index.find(service_name)->second;
-            expression::ExpressionContext* tmp_context =
-                    _cntl->_flow_context_array->at(index).get();
+        const RecallPlan& recall_plan = flow_config_iter->second.recall_plan();
+        for (const auto& entry : recall_plan) {
+            if (entry.service == nullptr) {
+                continue;
+            }
+            const std::string& service_name = entry.service_name;
+            size_t index = entry.service_id;
+            expression::ExpressionContext* tmp_context = &_cntl->_flow_context_array->at(index);
             std::lock_guard<std::mutex> serv_lock(tmp_context->_outer_mutex);
-            rapidjson::Value* backend_val = top_context->get_variable("backend");
             US_DLOG(INFO) << "top_context:"
                           << json_encode(*(top_context->get_variable("backend"))).c_str();
-            rapidjson::Value copyvalue(*backend_val, tmp_context->allocator());
+            // Service contexts hold own results only, start from the snapshot.
+            rapidjson::Value copyvalue = FlowContextArray::backend_view(
+                    *top_context->parent(), tmp_context->allocator());
             US_DLOG(INFO) << "copyvalue: " << json_encode(copyvalue);
             tmp_context->erase_variable("backend");
             tmp_context->set_variable("backend", copyvalue);
@@ -317,11 +336,16 @@ void GlobalClosure::Run() {
             return;
         }
 
-        for (auto service_name : service_list) {
-            size_t index = _cntl->_service_context_index.find(service_name)
-                                   ->second;  // core dump if service not define
-            expression::ExpressionContext* tmp_context =
-                    _cntl->_flow_context_array->at(index).get();
+        for (const auto& entry : recall_plan) {
+            if (entry.service == nullptr) {
+                continue;
+            }
+            const std::string& service_name = entry.service_name;
+            size_t index = entry.service_id;
+            expression::ExpressionContext* tmp_context = _cntl->_flow_context_array->find(index);
+            if (tmp_context == nullptr || !tmp_context->has_variable("backend")) {
+                continue;
+            }
             std::lock_guard<std::mutex> last_lock(top_context->parent()->_outer_mutex);
             US_DLOG(INFO) << "[Run] tmp_context->_outer_mutex: "
                           << &(top_context->parent()->_outer_mutex);
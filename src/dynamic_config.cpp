@@ -13,6 +13,8 @@
 #include "butil.h"
 #include "dynamic_config.h"
 #include "expression/driver.h"
+#include "intervene_reloader.h"
+#include "request_trace.h"
 #include "utils.h"
 #include "backend_engine.h"
 #include "rank_engine.h"
@@ -49,6 +51,7 @@ int KEMap::init(const google::protobuf::RepeatedPtrField<KVE>& kve_list) {
 }
 
 int KEMap::run_def(expression::ExpressionContext& context) const {
+    ScopedSpan span(current_trace().get(), "def", "");
     // Evaluate definitions in order
     for (const auto& key : _key_order) {
         rapidjson::Value value;
@@ -68,6 +71,7 @@ int KEMap::run(expression::ExpressionContext& context, rapidjson::Document& doc)
         doc.SetNull();
         return 0;
     }
+    ScopedSpan span(current_trace().get(), "kemap", "");
     doc.SetObject();
     for (const auto& key : _key_order) {
         rapidjson::Value value;
@@ -351,19 +355,19 @@ int RedisCommand::run(expression::ExpressionContext& context, rapidjson::Value&
     rapidjson::Value op_value;
     op_value.SetString(_op.c_str(), _op.length(), context.allocator());
     value.AddMember("op", op_value, context.allocator());
-    rapidjson::Value arg_str_value(rapidjson::kArrayType);
+    // Arguments keep their types and are formatted when building request.
+    rapidjson::Value arg_list_value(rapidjson::kArrayType);
     for (auto& v : arg_value.GetArray()) {
-        if (v.IsString()) {
-            arg_str_value.PushBack(v, context.allocator());
+        if (v.IsArray()) {
+            // Arrays are expanded to multiple arguments, i.e. keys of MGET.
+            for (auto& elem : v.GetArray()) {
+                arg_list_value.PushBack(elem, context.allocator());
+            }
         } else {
-            // Serialize value if not string.
-            std::string str = json_encode(v);
-            rapidjson::Value str_value;
-            str_value.SetString(str.c_str(), str.length(), context.allocator());
-            arg_str_value.PushBack(str_value, context.allocator());
+            arg_list_value.PushBack(v, context.allocator());
         }
     }
-    value.AddMember("arg", arg_str_value, context.allocator());
+    value.AddMember("arg", arg_list_value, context.allocator());
     return 0;
 }
 
@@ -399,6 +403,42 @@ int RedisRequestConfig::run(expression::ExpressionContext& context) const {
     return 0;
 }
 
+int ProtobufRequestConfig::init(
+        const RequestConfig& config,
+        const BackendRequestConfig* template_config) {
+    if (BackendRequestConfig::init(config, template_config) != 0) {
+        return -1;
+    }
+    _template = dynamic_cast<const ProtobufRequestConfig*>(template_config);
+    _pb_method = config.pb_method();
+    if (_pb_body.init(config.pb_body()) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int ProtobufRequestConfig::run(expression::ExpressionContext& context) const {
+    if (BackendRequestConfig::run(context) != 0) {
+        return -1;
+    }
+    rapidjson::Document pb_body_doc(&context.allocator());
+    if (_pb_body.run(context, pb_body_doc) != 0) {
+        US_LOG(ERROR) << "Failed to evaluate protobuf body";
+        return -1;
+    }
+    if (!pb_body_doc.IsNull()) {
+        context.merge_variable("pb_body", pb_body_doc);
+    }
+    return 0;
+}
+
+const std::string& ProtobufRequestConfig::pb_method() const {
+    if (_pb_method.empty() && _template != nullptr) {
+        return _template->pb_method();
+    }
+    return _pb_method;
+}
+
 int BaseIfConfig::init(const IfConfig& config) {
     if (_definition.init(config.def()) != 0) {
         return -1;
@@ -712,83 +752,96 @@ int RankConfig::run(
 }
 
 int CallIdsVecThreadSafe::init(std::vector<BRPC_NAMESPACE::CallId>::size_type length) {
-    std::lock_guard<std::mutex> lock(this->_mutex);
-    _is_ready = false;
+    // Called before any call is issued.
+    _is_ready.store(false);
+    _size = length;
+    _call_ids.reset(new std::atomic<uint64_t>[length]);
+    _multi_states.reset(new std::atomic<int>[length]);
+    _multi_call_ids.reset(new std::vector<BRPC_NAMESPACE::CallId>[length]);
     for (size_t i = 0; i != length; ++i) {
-        _call_ids.push_back(BRPC_NAMESPACE::CallId());
-        _multi_call_ids.push_back(std::vector<BRPC_NAMESPACE::CallId>(0));
+        _call_ids[i].store(INVALID_BTHREAD_ID.value, std::memory_order_relaxed);
+        _multi_states[i].store(MULTI_SLOT_EMPTY, std::memory_order_relaxed);
     }
     return 0;
 }
 
 bool CallIdsVecThreadSafe::get_is_ready() {
-    std::lock_guard<std::mutex> lock(this->_mutex);
-    return _is_ready;
+    return _is_ready.load();
 }
 
 int CallIdsVecThreadSafe::set_call_id(
         std::vector<BRPC_NAMESPACE::CallId>::size_type index,
         BRPC_NAMESPACE::CallId service_call_id) {
-    std::lock_guard<std::mutex> lock(this->_mutex);
-    if (index >= _call_ids.size()) {
+    if (index >= _size) {
         US_LOG(ERROR) << "service index exceed callid array";
         return -1;
     }
-    if (_call_ids[index] != INVALID_BTHREAD_ID) {
+    if (_is_ready.load()) {
+        US_LOG(WARNING) << "quit condition is satisfied, no need to request";
+        return 1;
+    }
+    uint64_t expected = INVALID_BTHREAD_ID.value;
+    if (!_call_ids[index].compare_exchange_strong(expected, service_call_id.value)) {
         US_LOG(ERROR) << "call id of service at " << index << "already set";
         return -1;
     }
-    if (_is_ready) {
+    // Check again after publishing, a quitter scanning before the write
+    // must have set the flag already.
+    if (_is_ready.load()) {
         US_LOG(WARNING) << "quit condition is satisfied, no need to request";
         return 1;
     }
-    _call_ids[index] = service_call_id;
     return 0;
 }
 
 int CallIdsVecThreadSafe::set_call_id(
         std::vector<std::vector<BRPC_NAMESPACE::CallId>>::size_type index,
         const std::vector<BRPC_NAMESPACE::CallId>& call_ids_vec) {
-    std::lock_guard<std::mutex> lock(this->_mutex);
-    if (index >= _multi_call_ids.size()) {
+    if (index >= _size) {
         US_LOG(ERROR) << "service index exceed callid array";
         return -1;
     }
-    if (_multi_call_ids[index].size() != 0) {
+    if (_is_ready.load()) {
+        US_LOG(WARNING) << "quit condition is satisfied, no need to request";
+        return 1;
+    }
+    int expected = MULTI_SLOT_EMPTY;
+    if (!_multi_states[index].compare_exchange_strong(expected, MULTI_SLOT_WRITING)) {
         US_LOG(ERROR) << "call id of service at " << index << "already set";
         return -1;
     }
-    if (_is_ready) {
+    _multi_call_ids[index] = call_ids_vec;
+    _multi_states[index].store(MULTI_SLOT_READY);
+    if (_is_ready.load()) {
         US_LOG(WARNING) << "quit condition is satisfied, no need to request";
         return 1;
     }
-    _multi_call_ids[index] = call_ids_vec;
     return 0;
 }
 
 int CallIdsVecThreadSafe::set_ready_to_quite() {
-    std::lock_guard<std::mutex> lock(this->_mutex);
-    _is_ready = true;
+    _is_ready.store(true);
     return 0;
 }
 
 int CallIdsVecThreadSafe::quit_flow() {
-    std::lock_guard<std::mutex> lock(this->_mutex);
-    for (auto call_id : _call_ids) {
+    // Only the first quitter cancels, later writers see the flag.
+    if (_is_ready.exchange(true)) {
+        return 0;
+    }
+    for (size_t i = 0; i != _size; ++i) {
+        BRPC_NAMESPACE::CallId call_id = {_call_ids[i].load()};
         if (call_id != INVALID_BTHREAD_ID) {
             BRPC_NAMESPACE::StartCancel(call_id);
             US_DLOG(INFO) << "quit call id: " << call_id;
         }
-    }
-    for (auto call_id_vec : _multi_call_ids) {
-        if (call_id_vec.size() != 0) {
-            for (auto call_id : call_id_vec) {
-                BRPC_NAMESPACE::StartCancel(call_id);
-                US_DLOG(INFO) << "quit call id: " << call_id;
+        if (_multi_states[i].load() == MULTI_SLOT_READY) {
+            for (const auto& multi_call_id : _multi_call_ids[i]) {
+                BRPC_NAMESPACE::StartCancel(multi_call_id);
+                US_DLOG(INFO) << "quit call id: " << multi_call_id;
             }
         }
     }
-    _is_ready = true;
     return 0;
 }
 
@@ -1009,7 +1062,7 @@ int FlowRecallConfig::run(
 
 int FlowRecallConfig::run(
         const policy::FlowPolicy* flow_policy,
-        std::vector<std::shared_ptr<uskit::expression::ExpressionContext>>& context_vec,
+        FlowContextArray& context_vec,
         std::shared_ptr<policy::FlowPolicyHelper> helper) const {
     if (flow_policy->backend_run(this, context_vec, helper) != 0) {
         US_LOG(ERROR) << "Recall with flow map failed";
@@ -1018,6 +1071,28 @@ int FlowRecallConfig::run(
     return 0;
 }
 
+int FlowRecallConfig::compile_plan(const BackendEngine& backend_engine) {
+    _recall_plan.clear();
+    _recall_plan.reserve(_recall_services.size());
+    for (const auto& rec : _recall_services) {
+        RecallPlanEntry entry;
+        entry.service_name = rec.first;
+        entry.service = backend_engine.get_service(rec.first);
+        entry.service_id = entry.service != nullptr ? backend_engine.get_service_index(rec.first) : 0;
+        entry.priority = rec.second;
+        auto next_iter = _recall_next.find(rec.first);
+        if (next_iter != _recall_next.end()) {
+            entry.next_flow = next_iter->second;
+        }
+        if (entry.service == nullptr) {
+            LOG(WARNING) << "Service [" << rec.first << "] recalled in flow [" << _flow_name
+                         << "] is not defined";
+        }
+        _recall_plan.emplace_back(std::move(entry));
+    }
+    return 0;
+}
+
 const std::string FlowDeliverConfig::_SUFFIX = "__NEXT";
 
 int FlowDeliverConfig::init(const FlowNodeConfig::DeliverConfig& d_config) {
@@ -1051,39 +1126,73 @@ int FlowDeliverConfig::init(const FlowNodeConfig::DeliverConfig& d_config) {
     return 0;
 }
 
+InterveneStats::InterveneStats(const std::string& usid, const std::string& flow_name)
+    : rule_count(0), build_us(0) {
+    const std::string prefix = "us_intervene_" + usid + "_" + flow_name;
+    rule_count.expose(prefix + "_rules");
+    build_us.expose(prefix + "_build_us");
+    reload_count.expose(prefix + "_reload");
+    match_latency.expose(prefix + "_match");
+}
+
+FlowInterveneConfig::~FlowInterveneConfig() {
+    if (_stats) {
+        InterveneReloader::instance().unwatch(this);
+    }
+}
+
 int FlowInterveneConfig::init_by_intervene_file(const InterveneFileConfig& file_config) {
-    for (auto rule : file_config.rule()) {
-        std::string pattern = rule.pattern();
-        std::string target = rule.target();
-        bool is_entire = rule.entire_match();
-        bool is_service = rule.service_intervene();
-        std::string pattern_key = "";
-        try {
-            boost::regex re(pattern);
-            if (is_entire == true) {
-                _match_list.push_back(re);
-                pattern_key = re.str();
-            } else {
-                _search_list.push_back(re);
-                pattern_key = re.str() + "__SEARCH";
+    BUTIL_NAMESPACE::Timer build_tm;
+    build_tm.start();
+    std::shared_ptr<InterveneRules> rules = std::make_shared<InterveneRules>();
+    // Rules of entire match are added first, rules of same kind keep order
+    // in file.
+    for (bool entire_match : {true, false}) {
+        for (const auto& rule : file_config.rule()) {
+            if (rule.entire_match() != entire_match) {
+                continue;
             }
-            if (is_service == true) {
-                _pattern_service_map.emplace(pattern_key, target);
-            } else {
-                _pattern_flow_map.emplace(pattern_key, target);
-            }
-        } catch (boost::bad_expression e) {
-            US_LOG(WARNING) << "patten: [" << pattern << "] compile error, " << e.what();
-            continue;
+            InterveneMatcher& matcher =
+                    rule.service_intervene() ? rules->service_matcher : rules->flow_matcher;
+            // Invalid pattern is skipped.
+            matcher.add_rule(rule.pattern(), entire_match, rule.target());
         }
     }
+    rules->service_matcher.build();
+    rules->flow_matcher.build();
+    build_tm.stop();
 
-    US_DLOG(INFO) << "#match: " << _match_list.size() << " #search: " << _search_list.size()
-                  << " #service: " << _pattern_service_map.size()
-                  << " #flow: " << _pattern_flow_map.size();
+    US_DLOG(INFO) << "#service: " << rules->service_matcher.size()
+                  << " #flow: " << rules->flow_matcher.size();
+    if (_stats) {
+        _stats->rule_count.set_value(
+                rules->service_matcher.size() + rules->flow_matcher.size());
+        _stats->build_us.set_value(build_tm.u_elapsed());
+    }
+    std::atomic_store(&_rules, std::shared_ptr<const InterveneRules>(std::move(rules)));
     return 0;
 }
 
+void FlowInterveneConfig::reload(const InterveneFileConfig& file_config) {
+    init_by_intervene_file(file_config);
+    if (_stats) {
+        _stats->reload_count << 1;
+    }
+}
+
+void FlowInterveneConfig::watch(
+        const std::string& usid, const std::string& flow_name, const std::string& path) {
+    if (_stats) {
+        return;
+    }
+    _stats.reset(new InterveneStats(usid, flow_name));
+    std::shared_ptr<const InterveneRules> rules = std::atomic_load(&_rules);
+    if (rules) {
+        _stats->rule_count.set_value(rules->service_matcher.size() + rules->flow_matcher.size());
+    }
+    InterveneReloader::instance().watch(path, this);
+}
+
 int FlowInterveneConfig::parse_source(const std::string& source) {
     expression::Driver driver;
     if (driver.parse("", source) != 0) {
@@ -1123,53 +1232,48 @@ int FlowInterveneConfig::evaluate_source(
 int FlowInterveneConfig::evaluate_target_service(
         const std::string& in_source,
         std::string& out_target) const {
-    for (auto re : _match_list) {
-        if (_pattern_service_map.find(re.str()) != _pattern_service_map.end() &&
-            boost::regex_match(in_source, re)) {
-            US_DLOG(INFO) << "RE: " << re.str() << "matched in [" << in_source << "]";
-            out_target = _pattern_service_map.at(re.str());
-            return 0;
-        }
+    // Hold the rules, which may be swapped by reloading meanwhile.
+    std::shared_ptr<const InterveneRules> rules = std::atomic_load(&_rules);
+    const int64_t start_ns = BUTIL_NAMESPACE::cpuwide_time_ns();
+    const std::string* target = rules->service_matcher.match(in_source);
+    if (_stats) {
+        _stats->match_latency << BUTIL_NAMESPACE::cpuwide_time_ns() - start_ns;
     }
-    for (auto re : _search_list) {
-        if (_pattern_service_map.find(re.str() + "__SEARCH") != _pattern_service_map.end() &&
-            boost::regex_search(in_source, re)) {
-            US_DLOG(INFO) << "RE: " << re.str() << "searched in [" << in_source << "]";
-            out_target = _pattern_service_map.at(re.str() + "__SEARCH");
-            return 0;
-        }
+    if (target != nullptr) {
+        US_DLOG(INFO) << "Intervene service [" << *target << "] matched in [" << in_source << "]";
+        out_target = *target;
     }
     return 0;
 }
 
 int FlowInterveneConfig::evaluate_target_flow(const std::string& in_source, std::string& out_target)
         const {
-    for (auto re : _match_list) {
-        if (_pattern_flow_map.find(re.str()) != _pattern_flow_map.end() &&
-            boost::regex_match(in_source, re)) {
-            US_DLOG(INFO) << "RE: " << re.str() << "matched in [" << in_source << "]";
-            out_target = _pattern_flow_map.at(re.str());
-            return 0;
-        }
+    std::shared_ptr<const InterveneRules> rules = std::atomic_load(&_rules);
+    const int64_t start_ns = BUTIL_NAMESPACE::cpuwide_time_ns();
+    const std::string* target = rules->flow_matcher.match(in_source);
+    if (_stats) {
+        _stats->match_latency << BUTIL_NAMESPACE::cpuwide_time_ns() - start_ns;
     }
-    for (auto re : _search_list) {
-        if (_pattern_flow_map.find(re.str() + "__SEARCH") != _pattern_flow_map.end() &&
-            boost::regex_search(in_source, re)) {
-            US_DLOG(INFO) << "RE: " << re.str() << "searched in [" << in_source << "]";
-            out_target = _pattern_flow_map.at(re.str() + "__SEARCH");
-            US_DLOG(INFO) << "out_target: [" << out_target << "]";
-            return 0;
-        }
+    if (target != nullptr) {
+        US_DLOG(INFO) << "Intervene flow [" << *target << "] matched in [" << in_source << "]";
+        out_target = *target;
     }
     return 0;
 }
 
-int FlowRecallConfig::intervene_init(const InterveneConfig& config, const InterveneFileConfig& file_config) {
+int FlowRecallConfig::intervene_init(
+        const InterveneConfig& config,
+        const InterveneFileConfig& file_config,
+        const std::string& file_path,
+        const std::string& usid) {
     _intervene_config = std::make_unique<FlowInterveneConfig>();
     if (_intervene_config->init(config, file_config) != 0) {
         US_LOG(ERROR) << "Intervene Config parse error in flow [" << _flow_name;
         return -1;
     }
+    if (!file_path.empty()) {
+        _intervene_config->watch(usid, _flow_name, file_path);
+    }
     return 0;
 }
 
@@ -1276,16 +1380,46 @@ int FlowConfig::recall(
     return 0;
 }
 
+int FlowConfig::recall_except(
+        const policy::FlowPolicy* flow_policy,
+        expression::ExpressionContext& context,
+        const std::vector<std::pair<std::string, int>>& prefetched) const {
+    std::vector<std::pair<std::string, int>> recall_services;
+    for (const auto& service : _recall_config->get_recall_services()) {
+        if (std::find(prefetched.begin(), prefetched.end(), service) == prefetched.end()) {
+            recall_services.push_back(service);
+        }
+    }
+    if (flow_policy->backend_run(recall_services, context, _recall_config->get_cancel_order()) !=
+        0) {
+        US_LOG(ERROR) << "Failed to recall services";
+        return -1;
+    }
+    return 0;
+}
+
 std::vector<std::string> FlowConfig::get_recall_service_list() const {
     std::vector<std::string> service_list;
-    for (auto iter : _recall_config->get_recall_services()) {
+    for (const auto& iter : _recall_config->get_recall_services()) {
         service_list.push_back(iter.first);
     }
     return service_list;
 }
 
-int FlowConfig::set_intervene_config(const InterveneConfig& config, const InterveneFileConfig file_config) {
-    return _recall_config->intervene_init(config, file_config);
+int FlowConfig::compile_recall_plan(const BackendEngine& backend_engine) {
+    if (_recall_config->compile_plan(backend_engine) != 0) {
+        LOG(ERROR) << "Failed to compile recall plan of flow [" << _name << "]";
+        return -1;
+    }
+    return 0;
+}
+
+int FlowConfig::set_intervene_config(
+        const InterveneConfig& config,
+        const InterveneFileConfig file_config,
+        const std::string& file_path,
+        const std::string& usid) {
+    return _recall_config->intervene_init(config, file_config, file_path, usid);
 }
 
 int FlowConfig::get_intervene_flow(expression::ExpressionContext& context, std::string& target_flow)
@@ -1300,15 +1434,14 @@ int FlowConfig::get_intervene_flow(expression::ExpressionContext& context, std::
 
 int FlowConfig::recall(
         const policy::FlowPolicy* flow_policy,
-        std::vector<std::shared_ptr<uskit::expression::ExpressionContext>>& context_vec,
+        FlowContextArray& context_vec,
         std::shared_ptr<policy::FlowPolicyHelper> helper) const {
-    for (auto iter : _recall_config->get_recall_services()) {
-        if (!flow_policy->has_service(iter.first)) {
-            US_LOG(ERROR) << "Service name [" << iter.first << "] not defined";
+    for (const auto& entry : _recall_config->recall_plan()) {
+        if (entry.service == nullptr) {
+            US_LOG(ERROR) << "Service name [" << entry.service_name << "] not defined";
             return -1;
         }
-        size_t service_index = flow_policy->get_service_index(iter.first);
-        if (_definition.run_def(*(context_vec[service_index])) != 0) {
+        if (_definition.run_def(context_vec.at(entry.service_id)) != 0) {
             US_LOG(ERROR) << "Failed to evaluate definition";
             return -1;
         }
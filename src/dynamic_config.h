@@ -14,13 +14,17 @@
 #ifndef USKIT_DYNAMIC_CONFIG_H
 #define USKIT_DYNAMIC_CONFIG_H
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 #include <unordered_map>
-#include <boost/regex.hpp>
 #include "config.pb.h"
+#include "bvar.h"
 #include "common.h"
 #include "expression/expression.h"
+#include "flow_context_array.h"
+#include "intervene_matcher.h"
 
 namespace uskit {
 
@@ -182,6 +186,28 @@ private:
     std::vector<RedisCommand> _redis_command;
 };
 
+// Dynamic configuration of protobuf request.
+class ProtobufRequestConfig : public BackendRequestConfig {
+public:
+    ProtobufRequestConfig() : _template(nullptr) {}
+    ~ProtobufRequestConfig() {}
+    ProtobufRequestConfig(ProtobufRequestConfig&&) = default;
+    // Initialize from configuration and template(optional).
+    // Returns 0 on success, -1 otherwise.
+    int init(const RequestConfig& config, const BackendRequestConfig* template_config);
+    // Evaluate all expressions within given context and generate fields of
+    // request message as variable `pb_body'.
+    // Returns 0 on success, -1 otherwise.
+    int run(expression::ExpressionContext& context) const;
+    // Full name of RPC method, inherited from template if not configured.
+    const std::string& pb_method() const;
+
+private:
+    const ProtobufRequestConfig* _template;
+    std::string _pb_method;
+    KEMap _pb_body;
+};
+
 // Base class for if block
 class BaseIfConfig {
 public:
@@ -302,9 +328,14 @@ private:
     Expr _next;
 };
 
-// vector for call ids w.r.t services. thread-safe
+// Call ids w.r.t services, thread-safe without locking. Each service owns a
+// slot written once, quitting sets the quit flag before scanning slots and
+// writers check the flag after writing, so every call id is either canceled
+// by the quitter or told to quit by `set_call_id'.
 class CallIdsVecThreadSafe {
 public:
+    CallIdsVecThreadSafe() : _is_ready(false), _size(0) {}
+
     int set_ready_to_quite();
     int set_call_id(
             std::vector<BRPC_NAMESPACE::CallId>::size_type index,
@@ -317,10 +348,20 @@ public:
     int quit_flow();
 
 private:
-    bool _is_ready;
-    std::vector<BRPC_NAMESPACE::CallId> _call_ids;
-    std::mutex _mutex;
-    std::vector<std::vector<BRPC_NAMESPACE::CallId>> _multi_call_ids;
+    // State of slots in `_multi_call_ids'
+    enum MultiSlotState {
+        MULTI_SLOT_EMPTY = 0,
+        MULTI_SLOT_WRITING = 1,
+        MULTI_SLOT_READY = 2,
+    };
+
+    std::atomic<bool> _is_ready;
+    size_t _size;
+    // Value of call id of each service, 0 if unset
+    std::unique_ptr<std::atomic<uint64_t>[]> _call_ids;
+    // Call ids of dynamic services, readable once state is MULTI_SLOT_READY
+    std::unique_ptr<std::atomic<int>[]> _multi_states;
+    std::unique_ptr<std::vector<BRPC_NAMESPACE::CallId>[]> _multi_call_ids;
 };
 
 // Dynamic configuration of flow if block.
@@ -377,9 +418,25 @@ private:
 
 // Forward declaration
 class BackendEngine;
+class BackendService;
 class FlowConfig;
 class FlowInterveneConfig;
 
+// Recall entry resolved against backend engine at init, so that recalling
+// does no lookup by service name.
+struct RecallPlanEntry {
+    std::string service_name;
+    // Index of service context, valid only if `service' is not null.
+    size_t service_id;
+    // Null if service is not defined in backend engine.
+    const BackendService* service;
+    int priority;
+    // Next flow of this service, empty if not specified.
+    std::string next_flow;
+};
+
+typedef std::vector<RecallPlanEntry> RecallPlan;
+
 class FlowRecallConfig {
 public:
     FlowRecallConfig() {}
@@ -395,15 +452,20 @@ public:
             const google::protobuf::RepeatedPtrField<FlowNodeConfig::DeliverConfig>&
                     deliver_configs,
             const std::string& flow_name);
-    // Init InterveneConfig
-    int intervene_init(const InterveneConfig& config, const InterveneFileConfig& file_config);
+    // Init InterveneConfig, rules are reloaded when file of `file_path'
+    // changes if it is not empty, and statistics are exposed with `usid'.
+    int intervene_init(
+            const InterveneConfig& config,
+            const InterveneFileConfig& file_config,
+            const std::string& file_path = "",
+            const std::string& usid = "");
     // Evaluate all expressions within given context and generate flow
     // recall block.
     // Returns 0 on success, -1 otherwise.
     int run(const policy::FlowPolicy* flow_policy, expression::ExpressionContext& context) const;
 
     int run(const policy::FlowPolicy* flow_policy,
-            std::vector<std::shared_ptr<uskit::expression::ExpressionContext>>& context_vec,
+            FlowContextArray& context_vec,
             std::shared_ptr<policy::FlowPolicyHelper> helper) const;
 
     int get_intervene_service(expression::ExpressionContext& context, std::string& service) const;
@@ -411,15 +473,22 @@ public:
     const std::string& get_cancel_order() const {
         return _cancel_order;
     }
-    const std::vector<std::pair<std::string, int>> get_recall_services() const {
+    const std::vector<std::pair<std::string, int>>& get_recall_services() const {
         return _recall_services;
     }
-    const std::unordered_map<std::string, std::string> get_recall_next() const {
+    const std::unordered_map<std::string, std::string>& get_recall_next() const {
         return _recall_next;
     }
     const std::string& get_flow_name() const {
         return _flow_name;
     }
+    // Resolve recall services against backend engine, must be called once
+    // after backend engine is initialized.
+    // Returns 0 on success, -1 otherwise.
+    int compile_plan(const BackendEngine& backend_engine);
+    const RecallPlan& recall_plan() const {
+        return _recall_plan;
+    }
 
 private:
     // recall config obj
@@ -427,6 +496,8 @@ private:
     std::vector<std::pair<std::string, int>> _recall_services;
     std::unordered_map<std::string, std::string> _recall_next;
     std::string _flow_name;
+    // Immutable after compile_plan.
+    RecallPlan _recall_plan;
     // Intervene config
     std::unique_ptr<FlowInterveneConfig> _intervene_config;
 };
@@ -467,13 +538,37 @@ private:
     // FlowNodeConfig::DeliverConfig::fieldType _field_type;
 };
 
+// Rules built from an intervene file, immutable once built.
+struct InterveneRules {
+    // Rules of entire match take priority over rules of search
+    InterveneMatcher service_matcher;
+    InterveneMatcher flow_matcher;
+};
+
+// Statistics of intervene rules loaded from file:
+// us_intervene_<usid>_<flow>_rules, _build_us, _reload and _match(latency
+// in ns).
+struct InterveneStats {
+    InterveneStats(const std::string& usid, const std::string& flow_name);
+    BVAR_NAMESPACE::Status<int64_t> rule_count;
+    BVAR_NAMESPACE::Status<int64_t> build_us;
+    BVAR_NAMESPACE::Adder<int64_t> reload_count;
+    BVAR_NAMESPACE::LatencyRecorder match_latency;
+};
+
 class FlowInterveneConfig {
 public:
     FlowInterveneConfig() {};
     FlowInterveneConfig(FlowInterveneConfig&&) = default;
+    ~FlowInterveneConfig();
     int init(const InterveneConfig& config, const InterveneFileConfig& file_config);
     int parse_source(const std::string& source);
     int init_by_intervene_file(const InterveneFileConfig& file_config);
+    // Rebuild rules from reloaded file and swap them in, requests in flight
+    // keep using old rules.
+    void reload(const InterveneFileConfig& file_config);
+    // Reload rules when intervene file of `path' changes.
+    void watch(const std::string& usid, const std::string& flow_name, const std::string& path);
     int evaluate_source(expression::ExpressionContext& context, std::string& out_source) const;
     int evaluate_target_service(const std::string& in_source, std::string& out_target) const;
     int evaluate_target_flow(const std::string& in_source, std::string& out_target) const;
@@ -481,14 +576,10 @@ public:
 private:
     // Intervene Source
     Expr _source;
-    // regexs which use regex_match manner
-    std::vector<boost::regex> _match_list;
-    // regexs which use regex_search manner
-    std::vector<boost::regex> _search_list;
-    // regex-service-map
-    std::unordered_map<std::string, std::string> _pattern_service_map;
-    // regex-flow-map
-    std::unordered_map<std::string, std::string> _pattern_flow_map;
+    // Accessed by std::atomic_load and std::atomic_store only
+    std::shared_ptr<const InterveneRules> _rules;
+    // Set if watched
+    std::unique_ptr<InterveneStats> _stats;
 };
 
 class BackendController;
@@ -526,9 +617,17 @@ public:
 
     int recall(
             const policy::FlowPolicy* flow_policy,
-            std::vector<std::shared_ptr<uskit::expression::ExpressionContext>>& context,
+            FlowContextArray& context,
             std::shared_ptr<policy::FlowPolicyHelper> helper) const;
 
+    // Recall services except `prefetched', which are recalled ahead by a
+    // prefetch, definitions should be evaluated already.
+    // Returns 0 on success, -1 otherwise.
+    int recall_except(
+            const policy::FlowPolicy* flow_policy,
+            expression::ExpressionContext& context,
+            const std::vector<std::pair<std::string, int>>& prefetched) const;
+
     // assign global quit config to flow config.
     int set_quit_conifg(const FlowNodeConfig::GlobalCancelConfig& config);
     // Evaluate quit config condtion.
@@ -543,10 +642,29 @@ public:
     int output(expression::ExpressionContext& context) const;
     // Get all services' name in recall config
     std::vector<std::string> get_recall_service_list() const;
+    // Services and priorities in recall config
+    const std::vector<std::pair<std::string, int>>& get_recall_services() const {
+        return _recall_config->get_recall_services();
+    }
+    const std::string& get_cancel_order() const {
+        return _recall_config->get_cancel_order();
+    }
+    // Compile recall plan against backend engine.
+    // Returns 0 on success, -1 otherwise.
+    int compile_recall_plan(const BackendEngine& backend_engine);
+    // Recall plan compiled by compile_recall_plan
+    const RecallPlan& recall_plan() const {
+        return _recall_config->recall_plan();
+    }
     // Find out needless next services by response and deliver config
     std::vector<std::string> filterout_by_response(const rapidjson::Value& response) const;
-    // Set recall config's intervene config by InterveneConifg & InterveneFileConfig
-    int set_intervene_config(const InterveneConfig& config, const InterveneFileConfig file_config);
+    // Set recall config's intervene config by InterveneConifg & InterveneFileConfig,
+    // which is loaded from `file_path' of `usid' if not empty.
+    int set_intervene_config(
+            const InterveneConfig& config,
+            const InterveneFileConfig file_config,
+            const std::string& file_path = "",
+            const std::string& usid = "");
     // Find out intervene next flow
     int get_intervene_flow(expression::ExpressionContext& context, std::string& target_flow) const;
 
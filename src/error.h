@@ -31,6 +31,7 @@ enum ErrorCode {
     USID_NOT_FOUND = 4003,
 
     INTERNAL_SERVER_ERROR = 5000,
+    SERVICE_UNAVAILABLE = 5003,
 };
 
 // Error message for explaination.
@@ -40,6 +41,7 @@ const std::unordered_map<int, std::string> ErrorMessage {
     {MISSING_PARAM, "Missing parameter"},
     {USID_NOT_FOUND, "usid not found"},
     {INTERNAL_SERVER_ERROR, "Internal server error"},
+    {SERVICE_UNAVAILABLE, "Service unavailable"},
 };
 
 } // namespace uskit
@@ -44,6 +44,20 @@ ExpressionContext::ExpressionContext(const std::string& name,
     _variables(rapidjson::kObjectType, &context.allocator()), _parent(&context) {
 }
 
+ExpressionContext::ExpressionContext(const std::string& name,
+                                     ExpressionContext& parent,
+                                     rapidjson::Document::AllocatorType& allocator)
+    : _name(name), _variables(rapidjson::kObjectType, &allocator), _parent(&parent) {
+    _variables.SetObject();
+}
+
+void ExpressionContext::reset(const std::string& name, ExpressionContext& parent) {
+    _name = name;
+    rapidjson::Document variables(rapidjson::kObjectType, &parent.allocator());
+    _variables.Swap(variables);
+    _parent = &parent;
+}
+
 void ExpressionContext::set_variable(rapidjson::Value& key, rapidjson::Value& value) {
     std::lock_guard<std::mutex> lock(this->_mutex);
     _variables.AddMember(key, value, allocator());
@@ -33,6 +33,12 @@ public:
     ExpressionContext(const std::string& name);
     ExpressionContext(const std::string& name, rapidjson::Document::AllocatorType& allocator);
     ExpressionContext(const std::string& name, ExpressionContext& parent);
+    // Read variables through `parent' but allocate from `allocator'.
+    ExpressionContext(const std::string& name,
+                      ExpressionContext& parent,
+                      rapidjson::Document::AllocatorType& allocator);
+    // Drop all variables and rebind to `parent', used to reuse a context.
+    void reset(const std::string& name, ExpressionContext& parent);
 
     void set_variable(rapidjson::Value& key, rapidjson::Value& value);
     void set_variable(const std::string& key, rapidjson::Value& value, bool check_keyword = false);
@@ -0,0 +1,36 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fanout_stats.h"
+
+namespace uskit {
+
+FanoutRecorder::FanoutRecorder(const std::string& usid, const std::string& name) {
+    const std::string prefix("us_fanout_" + usid + "_" + name);
+    _wall_time.expose(prefix + "_wall");
+    _sub_latency.expose(prefix + "_sub");
+    _failed.expose(prefix + "_failed");
+    _cancelled.expose(prefix + "_cancelled");
+}
+
+void FanoutRecorder::record(const FanoutStats& stats) {
+    _wall_time << stats.wall_us;
+    for (int64_t latency_us : stats.latencies_us) {
+        _sub_latency << latency_us;
+    }
+    _failed << stats.failed;
+    _cancelled << stats.cancelled;
+}
+
+}  // namespace uskit
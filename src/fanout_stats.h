@@ -0,0 +1,64 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_FANOUT_STATS_H
+#define USKIT_FANOUT_STATS_H
+
+#include <string>
+#include <vector>
+#include "bvar.h"
+
+namespace uskit {
+
+// Statistics of a dynamic fan-out call, latencies are in microseconds.
+struct FanoutStats {
+    FanoutStats() :
+            total(0), failed(0), cancelled(0),
+            wall_us(0), max_us(0), p50_us(0), p99_us(0) {}
+    // Number of sub-calls
+    int total;
+    // Number of failed sub-calls, cancelled ones excluded
+    int failed;
+    // Number of sub-calls cancelled by scheduler
+    int cancelled;
+    // Time from the first send to the last completion
+    int64_t wall_us;
+    // Latency distribution of finished sub-calls
+    int64_t max_us;
+    int64_t p50_us;
+    int64_t p99_us;
+    // Latencies of finished sub-calls, cancelled ones excluded
+    std::vector<int64_t> latencies_us;
+};
+
+// Record fan-out statistics of a service of `usid' into bvars:
+//   us_fanout_<usid>_<name>_wall      latency recorder of fan-out wall time
+//   us_fanout_<usid>_<name>_sub       latency recorder of sub-calls
+//   us_fanout_<usid>_<name>_failed    count of failed sub-calls
+//   us_fanout_<usid>_<name>_cancelled count of cancelled sub-calls
+class FanoutRecorder {
+public:
+    FanoutRecorder(const std::string& usid, const std::string& name);
+    void record(const FanoutStats& stats);
+
+private:
+    BVAR_NAMESPACE::LatencyRecorder _wall_time;
+    BVAR_NAMESPACE::LatencyRecorder _sub_latency;
+    BVAR_NAMESPACE::Adder<int64_t> _failed;
+    BVAR_NAMESPACE::Adder<int64_t> _cancelled;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_FANOUT_STATS_H
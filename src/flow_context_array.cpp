@@ -0,0 +1,102 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "flow_context_array.h"
+#include "utils.h"
+
+namespace uskit {
+
+FlowContextArray::Entry::Entry(expression::ExpressionContext& snapshot)
+    : document(rapidjson::kObjectType),
+      context("service context", snapshot, document.GetAllocator()) {
+}
+
+FlowContextArray::FlowContextArray(expression::ExpressionContext& snapshot, size_t service_size)
+    : _snapshot(snapshot), _entries(service_size) {
+}
+
+expression::ExpressionContext& FlowContextArray::at(size_t service_id) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::unique_ptr<Entry>& entry = _entries.at(service_id);
+    if (!entry) {
+        entry.reset(new Entry(_snapshot));
+    }
+    return entry->context;
+}
+
+expression::ExpressionContext* FlowContextArray::find(size_t service_id) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const std::unique_ptr<Entry>& entry = _entries.at(service_id);
+    return entry ? &entry->context : nullptr;
+}
+
+rapidjson::Value& FlowContextArray::local_backend(expression::ExpressionContext& context) {
+    if (!context.has_variable("backend")) {
+        rapidjson::Value backend(rapidjson::kObjectType);
+        context.set_variable("backend", backend);
+    }
+    return *context.get_variable("backend");
+}
+
+rapidjson::Value FlowContextArray::backend_view(
+        expression::ExpressionContext& context,
+        rapidjson::Document::AllocatorType& allocator) {
+    rapidjson::Value backend(rapidjson::kObjectType);
+    rapidjson::Value* snapshot_backend =
+            context.parent() != nullptr ? context.parent()->get_variable("backend") : nullptr;
+    if (snapshot_backend != nullptr) {
+        backend.CopyFrom(*snapshot_backend, allocator);
+    }
+    if (context.has_variable("backend")) {
+        merge_json_objects(backend, *context.get_variable("backend"), allocator);
+    }
+    return backend;
+}
+
+void FlowContextArray::merge_result(
+        const std::string& service_name,
+        const rapidjson::Value& result) {
+    std::lock_guard<std::mutex> lock(_merged_mutex);
+    expression::ExpressionContext& context = merged_context();
+    rapidjson::Value& backend = *context.get_variable("backend");
+    rapidjson::Value::MemberIterator iter = backend.FindMember(service_name.c_str());
+    if (iter != backend.MemberEnd() && iter->value.IsObject() && result.IsObject()) {
+        merge_json_objects(iter->value, result, context.allocator());
+        return;
+    }
+    rapidjson::Value value(result, context.allocator());
+    if (iter != backend.MemberEnd()) {
+        iter->value.Swap(value);
+    } else {
+        backend.AddMember(
+                rapidjson::Value(service_name.c_str(), service_name.length(), context.allocator()),
+                value,
+                context.allocator());
+    }
+}
+
+expression::ExpressionContext& FlowContextArray::merged_context() {
+    if (!_merged) {
+        _merged.reset(new Entry(_snapshot));
+        rapidjson::Value backend(rapidjson::kObjectType);
+        rapidjson::Value* snapshot_backend = _snapshot.get_variable("backend");
+        if (snapshot_backend != nullptr) {
+            backend.CopyFrom(*snapshot_backend, _merged->context.allocator());
+        }
+        _merged->context.set_variable("backend", backend);
+    }
+    return _merged->context;
+}
+
+}  // namespace uskit
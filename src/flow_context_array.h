@@ -0,0 +1,89 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_FLOW_CONTEXT_ARRAY_H
+#define USKIT_FLOW_CONTEXT_ARRAY_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "expression/expression.h"
+
+namespace uskit {
+
+// Per-service expression contexts of an async flow node, indexed by service
+// index of backend engine. A context is created when its service is recalled
+// and reads `request', `backend' and `result' from the shared snapshot
+// context, which must not be modified while the array is in use. Writes of a
+// service, e.g. its own `backend', are held in its context only.
+class FlowContextArray {
+public:
+    FlowContextArray(expression::ExpressionContext& snapshot, size_t service_size);
+
+    // Shared read-only context.
+    expression::ExpressionContext& snapshot() {
+        return _snapshot;
+    }
+    // Number of services.
+    size_t size() const {
+        return _entries.size();
+    }
+    // Context of service `service_id', created on first use.
+    expression::ExpressionContext& at(size_t service_id);
+    // Context of service `service_id', nullptr if never used.
+    expression::ExpressionContext* find(size_t service_id);
+
+    // `backend' written by the service in `context', created on first use.
+    // Callers should hold `_outer_mutex' of `context'.
+    static rapidjson::Value& local_backend(expression::ExpressionContext& context);
+    // `backend' of the snapshot merged with the one written by the service in
+    // `context', i.e. lookups fall through per key to the snapshot. Local
+    // `backend' hides the snapshot's, so conditions of the service are
+    // evaluated against this view. Callers should hold `_outer_mutex' of
+    // `context'.
+    static rapidjson::Value backend_view(
+            expression::ExpressionContext& context,
+            rapidjson::Document::AllocatorType& allocator);
+
+    // Append `result' of service `service_name' to the merged view.
+    void merge_result(const std::string& service_name, const rapidjson::Value& result);
+    // Context whose `backend' merges the snapshot with results of all
+    // services, used to evaluate global conditions. Callers should hold
+    // `merged_mutex()' and evaluate in a child context.
+    expression::ExpressionContext& merged_context();
+    std::mutex& merged_mutex() {
+        return _merged_mutex;
+    }
+
+private:
+    // Context and the document owning its values.
+    struct Entry {
+        explicit Entry(expression::ExpressionContext& snapshot);
+        USResponse document;
+        expression::ExpressionContext context;
+    };
+
+    expression::ExpressionContext& _snapshot;
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<Entry>> _entries;
+    // Merged view, built on first use.
+    std::mutex _merged_mutex;
+    std::unique_ptr<Entry> _merged;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_FLOW_CONTEXT_ARRAY_H
@@ -52,7 +52,7 @@ int FlowEngine::member_init(const USConfig& config) {
         US_LOG(ERROR) << "rank config parsed from json to message error";
         return -1;
     }
-    return member_init_by_message(backend_config, rank_config);
+    return member_init_by_message(backend_config, rank_config, "");
 }
 
 int FlowEngine::member_init(const std::string& root_dir, const std::string& usid) {
@@ -73,16 +73,17 @@ int FlowEngine::member_init(const std::string& root_dir, const std::string& usid
         return -1;
     }
 
-    return member_init_by_message(backend_config, rank_config);
+    return member_init_by_message(backend_config, rank_config, usid);
 }
 
 int FlowEngine::member_init_by_message(
             const BackendEngineConfig& backend_config,
-            const RankEngineConfig& rank_config) {
+            const RankEngineConfig& rank_config,
+            const std::string& usid) {
     _backend_engine = std::make_shared<BackendEngine>();
     // Initialize backend engine.
     LOG(INFO) << "Initializing backend engine";
-    if (_backend_engine->init(backend_config) != 0) {
+    if (_backend_engine->init(backend_config, usid) != 0) {
         LOG(ERROR) << "Failed to initialize backend engine";
         return -1;
     }
@@ -116,6 +117,7 @@ int FlowEngine::init(const USConfig& config) {
         return -1;
     }
     _curr_dir = "";
+    _usid = "";
     auto iter = config.FindMember("intervene");
     if (iter == config.MemberEnd()) {
         _intervene_config_json.SetNull();
@@ -134,6 +136,7 @@ int FlowEngine::init_by_message(const FlowEngineConfig& flow_config) {
     }
 
     _flow_policy->set_curr_dir(_curr_dir);
+    _flow_policy->set_usid(_usid);
 
     if (!_intervene_config_json.IsNull()) {
         if (_flow_policy->init_intervene_by_json(_intervene_config_json) != 0) {
@@ -148,7 +151,11 @@ int FlowEngine::init_by_message(const FlowEngineConfig& flow_config) {
         return -1;
     }
 
-    _flow_policy->set_backend_engine(_backend_engine);
+    if (_flow_policy->set_backend_engine(_backend_engine) != 0) {
+        LOG(ERROR) << "Failed to set backend engine of flow policy [" << flow_config.flow_policy()
+                   << "]";
+        return -1;
+    }
     _flow_policy->set_rank_engine(_rank_engine);
     return 0;
 }
@@ -168,6 +175,7 @@ int FlowEngine::init(const std::string& root_dir, const std::string& usid) {
         return -1;
     }
     _curr_dir = root_dir + "/" + usid + "/";
+    _usid = usid;
     return init_by_message(flow_config);
 }
 
@@ -178,4 +186,10 @@ int FlowEngine::run(USRequest& request, USResponse& response) const {
     return 0;
 }
 
+void FlowEngine::prewarm(ConnectionPrewarmer& prewarmer) const {
+    if (_backend_engine) {
+        _backend_engine->prewarm(prewarmer);
+    }
+}
+
 }  // namespace uskit
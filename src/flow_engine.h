@@ -37,12 +37,17 @@ public:
     int init_by_message(const FlowEngineConfig& flow_config);
     int member_init(const USConfig& config);
     int member_init(const std::string& root_dir, const std::string& usid);
+    // Metrics of backends are exposed with `usid', empty for config carried
+    // by request.
     int member_init_by_message(
             const BackendEngineConfig& backend_config,
-            const RankEngineConfig& rank_config);
+            const RankEngineConfig& rank_config,
+            const std::string& usid);
     // Run chat flow with user reqeust and generate response.
     // Returns 0 on success, -1 otherwise.
     int run(USRequest& request, USResponse& response) const;
+    // Add backends to be prewarmed.
+    void prewarm(ConnectionPrewarmer& prewarmer) const;
 
 private:
     std::unique_ptr<policy::FlowPolicy> _flow_policy;
@@ -50,6 +55,7 @@ private:
     std::shared_ptr<RankEngine> _rank_engine;
     rapidjson::Document _intervene_config_json;
     std::string _curr_dir;
+    std::string _usid;
 };
 
 }  // namespace uskit
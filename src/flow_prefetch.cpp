@@ -0,0 +1,157 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "flow_prefetch.h"
+#include "policy/flow_policy.h"
+#include "thread_data.h"
+#include "utils.h"
+
+namespace uskit {
+
+FlowPrefetchPlan::FlowPrefetchPlan(
+        const std::string& usid, const std::string& next, const FlowConfig* config)
+    : next_flow(next), next_config(config) {
+    if (!usid.empty()) {
+        const std::string prefix = "us_prefetch_" + usid + "_" + next;
+        issued.expose(prefix + "_issued");
+        hit.expose(prefix + "_hit");
+        wasted.expose(prefix + "_wasted");
+    }
+}
+
+FlowPrefetch::FlowPrefetch(FlowPrefetchPlan& plan)
+    : _plan(plan),
+      _flow_policy(nullptr),
+      _document(rapidjson::kObjectType),
+      _context("prefetch context", _document.GetAllocator()),
+      _assigned_data(nullptr),
+      _ret(-1),
+      _tid(0),
+      _started(false),
+      _merged(false) {
+}
+
+FlowPrefetch::~FlowPrefetch() {
+    if (_started && !_merged) {
+        _call_ids->quit_flow();
+    }
+    join();
+    if (_started && !_merged) {
+        _plan.wasted << 1;
+        UnifiedSchedulerThreadData* td =
+                static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
+        if (td != nullptr) {
+            td->add_log_entry("prefetch(" + _plan.next_flow + ")", "wasted");
+        }
+    }
+}
+
+int FlowPrefetch::start(const policy::FlowPolicy* flow_policy, const rapidjson::Value& request) {
+    _flow_policy = flow_policy;
+    rapidjson::Value request_copy(request, _context.allocator());
+    _context.set_variable("request", request_copy);
+    _context.set_variable("backend", rapidjson::Value().SetObject());
+    _context.set_variable("result", rapidjson::Value().SetObject());
+    _call_ids = std::make_shared<CallIdsVecThreadSafe>();
+    _call_ids->init(_plan.services.size());
+    _assigned_data = bthread_get_assigned_data();
+    UnifiedSchedulerThreadData* td =
+            static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
+    if (td != nullptr) {
+        _logid = td->logid();
+        _trace = td->trace();
+    }
+    // Prefetched calls are linked to rpcz span of the request.
+    bthread_attr_t attr = BTHREAD_ATTR_NORMAL;
+    attr.flags |= BTHREAD_INHERIT_SPAN;
+    if (bthread_start_background(&_tid, &attr, run_recall, this) != 0) {
+        US_LOG(WARNING) << "Failed to start prefetch of flow [" << _plan.next_flow << "]";
+        return -1;
+    }
+    _started = true;
+    _plan.issued << 1;
+    return 0;
+}
+
+void* FlowPrefetch::run_recall(void* arg) {
+    FlowPrefetch* prefetch = static_cast<FlowPrefetch*>(arg);
+    // Inherit thread local data of server so that logs are tracked.
+    bthread_assign_data(prefetch->_assigned_data);
+    UnifiedSchedulerThreadData* td =
+            static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
+    if (td != nullptr) {
+        td->reset();
+        td->set_logid(prefetch->_logid);
+        td->set_trace(prefetch->_trace);
+    }
+    ScopedSpan span(prefetch->_trace.get(), "prefetch", prefetch->_plan.next_flow);
+    expression::ExpressionContext flow_context("prefetch flow block", prefetch->_context);
+    if (prefetch->_plan.next_config->recall_run_def(flow_context) != 0) {
+        US_LOG(WARNING) << "Failed in define before prefetch";
+    } else {
+        const FlowPrefetchPlan& plan = prefetch->_plan;
+        prefetch->_ret = prefetch->_flow_policy->backend_run(
+                plan.services, flow_context, plan.next_config->get_cancel_order(),
+                prefetch->_call_ids);
+    }
+    if (td != nullptr) {
+        prefetch->_log_entries = td->log_entries();
+    }
+    return nullptr;
+}
+
+void FlowPrefetch::join() {
+    if (!_started || _tid == 0) {
+        return;
+    }
+    bthread_join(_tid, nullptr);
+    _tid = 0;
+    UnifiedSchedulerThreadData* td =
+            static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
+    if (td != nullptr) {
+        td->add_log_entries(_log_entries);
+    }
+}
+
+int FlowPrefetch::merge_into(expression::ExpressionContext& context) {
+    join();
+    if (_ret != 0) {
+        US_LOG(ERROR) << "Failed to prefetch flow [" << _plan.next_flow << "]";
+        return -1;
+    }
+    _merged = true;
+    _plan.hit << 1;
+    UnifiedSchedulerThreadData* td =
+            static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
+    if (td != nullptr) {
+        td->add_log_entry("prefetch(" + _plan.next_flow + ")", "hit");
+    }
+
+    rapidjson::Document::AllocatorType& allocator = context.allocator();
+    rapidjson::Value* backend = context.get_variable("backend");
+    rapidjson::Value* recall = context.get_variable("recall");
+    for (auto& member : _context.get_variable("backend")->GetObject()) {
+        if (recall != nullptr && recall->IsArray()) {
+            recall->PushBack(rapidjson::Value(member.name, allocator), allocator);
+        }
+        backend->RemoveMember(member.name);
+        backend->AddMember(
+                rapidjson::Value(member.name, allocator),
+                rapidjson::Value(member.value, allocator),
+                allocator);
+    }
+    return 0;
+}
+
+}  // namespace uskit
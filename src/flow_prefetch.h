@@ -0,0 +1,100 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_FLOW_PREFETCH_H
+#define USKIT_FLOW_PREFETCH_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "bthread.h"
+#include "bvar.h"
+#include "common.h"
+#include "dynamic_config.h"
+#include "expression/expression.h"
+#include "request_trace.h"
+
+namespace uskit {
+
+namespace policy {
+class FlowPolicy;
+}  // namespace policy
+
+// Prefetch plan of a flow node, i.e. services of its static next node whose
+// requests and the definitions of next node do not refer to `$backend' or
+// `$result', so they can be built before current node finishes. Statistics
+// are recorded into bvars, not exposed if `usid' is empty:
+//   us_prefetch_<usid>_<next>_issued  count of prefetches issued
+//   us_prefetch_<usid>_<next>_hit     count of prefetches used by next node
+//   us_prefetch_<usid>_<next>_wasted  count of prefetches discarded
+struct FlowPrefetchPlan {
+    FlowPrefetchPlan(const std::string& usid, const std::string& next, const FlowConfig* config);
+
+    std::string next_flow;
+    const FlowConfig* next_config;
+    std::vector<std::pair<std::string, int>> services;
+    BVAR_NAMESPACE::Adder<int64_t> issued;
+    BVAR_NAMESPACE::Adder<int64_t> hit;
+    BVAR_NAMESPACE::Adder<int64_t> wasted;
+};
+
+// Recall of a prefetch plan running in background bthread. Requests are
+// built against a copy of `$request' and results are kept until next node
+// merges them, or discarded when the flow goes elsewhere.
+class FlowPrefetch {
+public:
+    explicit FlowPrefetch(FlowPrefetchPlan& plan);
+    // Cancel and wait for the recall if not merged, counted as wasted.
+    ~FlowPrefetch();
+
+    // Start recall in background.
+    // Returns 0 on success, -1 otherwise.
+    int start(const policy::FlowPolicy* flow_policy, const rapidjson::Value& request);
+    // Wait for the recall and merge results into `backend' and `recall' of
+    // `context'.
+    // Returns 0 on success, -1 otherwise.
+    int merge_into(expression::ExpressionContext& context);
+
+    const std::string& flow_name() const {
+        return _plan.next_flow;
+    }
+    const std::vector<std::pair<std::string, int>>& services() const {
+        return _plan.services;
+    }
+
+private:
+    static void* run_recall(void* arg);
+    // Wait for the recall and append its log entries to current request.
+    void join();
+
+    FlowPrefetchPlan& _plan;
+    const policy::FlowPolicy* _flow_policy;
+    USResponse _document;
+    expression::ExpressionContext _context;
+    // Server thread local options, logid and trace of the request
+    void* _assigned_data;
+    std::string _logid;
+    RequestTracePtr _trace;
+    std::vector<std::string> _log_entries;
+    // Call ids of the recall, cancelled when discarded
+    std::shared_ptr<CallIdsVecThreadSafe> _call_ids;
+    int _ret;
+    bthread_t _tid;
+    bool _started;
+    bool _merged;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_FLOW_PREFETCH_H
@@ -20,10 +20,12 @@
 #include "policy/backend/redis_policy.h"
 #include "policy/backend/dynamic_policy.h"
 #include "policy/backend/host_dyn_http_policy.h"
+#include "policy/backend/protobuf_policy.h"
 #include "policy/flow/default_policy.h"
 #include "policy/flow/recurrent_policy.h"
 #include "policy/flow/global_policy.h"
 #include "policy/flow/levels_policy.h"
+#include "policy/flow/dag_policy.h"
 #include "policy/rank/default_policy.h"
 
 #include "function/builtin.h"
@@ -72,6 +74,7 @@ void register_policy() {
 
     REGISTER_REQUEST_POLICY("dynamic_default", policy::backend::DynamicHttpRequestPolicy);
     REGISTER_REQUEST_POLICY("dynamic_host_default", policy::backend::HostDynHttpRequestPolicy);
+    REGISTER_REQUEST_POLICY("protobuf_default", policy::backend::ProtobufRequestPolicy);
 
     // Response policy
     REGISTER_RESPONSE_POLICY("http_default", policy::backend::HttpResponsePolicy);
@@ -80,6 +83,7 @@ void register_policy() {
     REGISTER_RESPONSE_POLICY("dynamic_default", policy::backend::DynamicHttpResponsePolicy);
 
     REGISTER_RESPONSE_POLICY("dynamic_host_default", policy::backend::HostDynHttpResponsePolicy);
+    REGISTER_RESPONSE_POLICY("protobuf_default", policy::backend::ProtobufResponsePolicy);
 
     // Flow policy
     REGISTER_FLOW_POLICY("default", policy::flow::DefaultPolicy);
@@ -88,6 +92,7 @@ void register_policy() {
     REGISTER_FLOW_POLICY("globalcancel", policy::flow::AsyncGlobalPolicy);
     REGISTER_FLOW_POLICY("global_async", policy::flow::AsyncGlobalPolicy);
     REGISTER_FLOW_POLICY("leveldeliver", policy::flow::CascadeAsyncPolicy);
+    REGISTER_FLOW_POLICY("dag", policy::flow::DagPolicy);
 
     // Rank policy
     REGISTER_RANK_POLICY("default", policy::rank::DefaultPolicy);
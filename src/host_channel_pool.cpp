@@ -0,0 +1,104 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "host_channel_pool.h"
+#include "butil.h"
+#include "channel_registry.h"
+
+namespace uskit {
+
+HostChannelPool::HostChannelPool() :
+        _max_size(0),
+        _idle_timeout_ms(0),
+        _last_evict_ms(0) {}
+
+HostChannelPool::~HostChannelPool() {}
+
+int HostChannelPool::init(
+        const BRPC_NAMESPACE::ChannelOptions& options,
+        size_t max_size,
+        int64_t idle_timeout_ms) {
+    if (max_size == 0 || idle_timeout_ms <= 0) {
+        LOG(ERROR) << "Invalid host channel pool size [" << max_size << "] or idle timeout ["
+                   << idle_timeout_ms << "]";
+        return -1;
+    }
+    _options = options;
+    _max_size = max_size;
+    _idle_timeout_ms = idle_timeout_ms;
+    return 0;
+}
+
+std::shared_ptr<BRPC_NAMESPACE::Channel> HostChannelPool::get(const std::string& host) {
+    const int64_t now_ms = BUTIL_NAMESPACE::monotonic_time_ms();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto iter = _channels.find(host);
+        if (iter != _channels.end()) {
+            iter->second.last_used_ms = now_ms;
+            return iter->second.channel;
+        }
+    }
+
+    // Obtain outside of lock, connecting may take a while.
+    std::shared_ptr<BRPC_NAMESPACE::Channel> channel =
+            ChannelRegistry::instance().get(host, "", _options);
+    if (!channel) {
+        LOG(WARNING) << "Failed to initialize channel to host [" << host << "]";
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto iter = _channels.find(host);
+    if (iter != _channels.end()) {
+        // Created by another request concurrently.
+        iter->second.last_used_ms = now_ms;
+        return iter->second.channel;
+    }
+    evict(now_ms);
+    _channels.emplace(host, Entry{channel, now_ms});
+    return channel;
+}
+
+size_t HostChannelPool::size() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _channels.size();
+}
+
+void HostChannelPool::evict(int64_t now_ms) {
+    // Scan for idle channels at most once per second.
+    if (now_ms - _last_evict_ms >= 1000 || _channels.size() >= _max_size) {
+        _last_evict_ms = now_ms;
+        for (auto iter = _channels.begin(); iter != _channels.end();) {
+            if (now_ms - iter->second.last_used_ms >= _idle_timeout_ms) {
+                iter = _channels.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+    }
+    if (_channels.size() < _max_size) {
+        return;
+    }
+    auto lru = _channels.begin();
+    for (auto iter = _channels.begin(); iter != _channels.end(); ++iter) {
+        if (iter->second.last_used_ms < lru->second.last_used_ms) {
+            lru = iter;
+        }
+    }
+    LOG(INFO) << "Host channel pool is full, evict channel to [" << lru->first << "]";
+    _channels.erase(lru);
+}
+
+}  // namespace uskit
@@ -0,0 +1,63 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_HOST_CHANNEL_POOL_H
+#define USKIT_HOST_CHANNEL_POOL_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "brpc.h"
+
+namespace uskit {
+
+// A bounded pool of channels keyed by `ip:port`, used by backends whose host is
+// decided at runtime. Channels are created on first use and reused afterwards,
+// channels not used for `idle_timeout_ms` are evicted. When the pool is full,
+// the least recently used channel is evicted.
+// Calls issued through an evicted channel are not affected.
+class HostChannelPool {
+public:
+    HostChannelPool();
+    ~HostChannelPool();
+    // Initialize with options shared by all channels.
+    // Returns 0 on success, -1 otherwise.
+    int init(const BRPC_NAMESPACE::ChannelOptions& options, size_t max_size,
+            int64_t idle_timeout_ms);
+    // Obtain channel to given host, which is created if not exists.
+    // Returns nullptr on failure.
+    std::shared_ptr<BRPC_NAMESPACE::Channel> get(const std::string& host);
+    size_t size();
+
+private:
+    struct Entry {
+        std::shared_ptr<BRPC_NAMESPACE::Channel> channel;
+        int64_t last_used_ms;
+    };
+    // Evict idle channels, and the least recently used one if pool is still
+    // full. Must be called with lock held.
+    void evict(int64_t now_ms);
+
+    BRPC_NAMESPACE::ChannelOptions _options;
+    size_t _max_size;
+    int64_t _idle_timeout_ms;
+    std::mutex _mutex;
+    std::unordered_map<std::string, Entry> _channels;
+    int64_t _last_evict_ms;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_HOST_CHANNEL_POOL_H
@@ -0,0 +1,308 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <deque>
+#include "intervene_matcher.h"
+#include "common.h"
+
+namespace uskit {
+
+LiteralAutomaton::LiteralAutomaton()
+    : _fail(1, 0), _output(1, -1), _dict_suffix(1, -1), _literal_num(0) {}
+
+int LiteralAutomaton::add(const std::string& literal) {
+    int state = 0;
+    for (unsigned char c : literal) {
+        auto iter = _edges.find(edge_key(state, c));
+        if (iter != _edges.end()) {
+            state = iter->second;
+            continue;
+        }
+        const int new_state = static_cast<int>(_fail.size());
+        _edges.emplace(edge_key(state, c), new_state);
+        _fail.push_back(0);
+        _output.push_back(-1);
+        _dict_suffix.push_back(-1);
+        state = new_state;
+    }
+    if (_output[state] < 0) {
+        _output[state] = _literal_num++;
+    }
+    return _output[state];
+}
+
+void LiteralAutomaton::build() {
+    std::vector<std::vector<std::pair<unsigned char, int>>> children(_fail.size());
+    for (const auto& edge : _edges) {
+        children[edge.first >> 8].emplace_back(edge.first & 0xff, edge.second);
+    }
+    // States are visited in breadth first order, so that failure links of
+    // shorter states are ready.
+    std::deque<int> queue(1, 0);
+    while (!queue.empty()) {
+        const int state = queue.front();
+        queue.pop_front();
+        for (const auto& child : children[state]) {
+            int fail = 0;
+            if (state != 0) {
+                fail = next(_fail[state], child.first);
+            }
+            _fail[child.second] = fail;
+            _dict_suffix[child.second] = _output[fail] >= 0 ? fail : _dict_suffix[fail];
+            queue.push_back(child.second);
+        }
+    }
+}
+
+int LiteralAutomaton::next(int state, unsigned char c) const {
+    while (true) {
+        auto iter = _edges.find(edge_key(state, c));
+        if (iter != _edges.end()) {
+            return iter->second;
+        }
+        if (state == 0) {
+            return 0;
+        }
+        state = _fail[state];
+    }
+}
+
+// Unescape pattern which matches a literal string only.
+// Returns false if pattern contains any regex operator.
+static bool parse_literal(const std::string& pattern, std::string& literal) {
+    literal.clear();
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        const char c = pattern[i];
+        if (c == '\\') {
+            if (i + 1 >= pattern.size() ||
+                std::isalnum(static_cast<unsigned char>(pattern[i + 1]))) {
+                return false;
+            }
+            literal.push_back(pattern[++i]);
+        } else if (std::strchr("^$.|?*+()[]{}", c) != nullptr) {
+            return false;
+        } else {
+            literal.push_back(c);
+        }
+    }
+    return !literal.empty();
+}
+
+// Returns position after bracket expression starting at `pos', or npos if
+// not terminated.
+static size_t skip_class(const std::string& pattern, size_t pos) {
+    size_t i = pos + 1;
+    if (i < pattern.size() && pattern[i] == '^') {
+        ++i;
+    }
+    if (i < pattern.size() && pattern[i] == ']') {
+        ++i;
+    }
+    while (i < pattern.size()) {
+        if (pattern[i] == '\\') {
+            i += 2;
+        } else if (pattern[i] == '[' && i + 1 < pattern.size() &&
+                   std::strchr(":=.", pattern[i + 1]) != nullptr) {
+            // Character class like [:alpha:]
+            const size_t end = pattern.find(std::string(1, pattern[i + 1]) + "]", i + 2);
+            if (end == std::string::npos) {
+                return std::string::npos;
+            }
+            i = end + 2;
+        } else if (pattern[i] == ']') {
+            return i + 1;
+        } else {
+            ++i;
+        }
+    }
+    return std::string::npos;
+}
+
+// Returns position after group starting at `pos', or npos if not terminated.
+static size_t skip_group(const std::string& pattern, size_t pos) {
+    int depth = 0;
+    size_t i = pos;
+    while (i < pattern.size()) {
+        if (pattern[i] == '\\') {
+            i += 2;
+        } else if (pattern[i] == '[') {
+            i = skip_class(pattern, i);
+            if (i == std::string::npos) {
+                return i;
+            }
+        } else {
+            if (pattern[i] == '(') {
+                ++depth;
+            } else if (pattern[i] == ')' && --depth == 0) {
+                return i + 1;
+            }
+            ++i;
+        }
+    }
+    return std::string::npos;
+}
+
+// Find the longest literal which must occur in any text matching `pattern'.
+// Constructs not understood make the scan give up, which only costs
+// prefiltering. Returns empty string if not found.
+static std::string required_literal(const std::string& pattern) {
+    std::string best;
+    std::string run;
+    auto end_run = [&best, &run]() {
+        if (run.size() > best.size()) {
+            best = run;
+        }
+        run.clear();
+    };
+    size_t i = 0;
+    while (i < pattern.size()) {
+        const char c = pattern[i];
+        if (c == '\\') {
+            if (i + 1 >= pattern.size()) {
+                return "";
+            }
+            const char escaped = pattern[i + 1];
+            if (std::isdigit(static_cast<unsigned char>(escaped)) ||
+                std::strchr("QExcpPNgko", escaped) != nullptr) {
+                // Escapes of variable length
+                return "";
+            }
+            if (std::isalnum(static_cast<unsigned char>(escaped))) {
+                end_run();
+            } else {
+                run.push_back(escaped);
+            }
+            i += 2;
+        } else if (c == '[') {
+            end_run();
+            i = skip_class(pattern, i);
+        } else if (c == '(') {
+            // Inline modifiers like (?i) change meaning of literals.
+            if (i + 2 < pattern.size() && pattern[i + 1] == '?' &&
+                std::strchr(":=!<>", pattern[i + 2]) == nullptr) {
+                return "";
+            }
+            end_run();
+            i = skip_group(pattern, i);
+        } else if (c == '|') {
+            return "";
+        } else if (c == '*' || c == '?' || c == '{') {
+            // Quantified character is optional.
+            if (!run.empty()) {
+                run.pop_back();
+            }
+            end_run();
+            i = c == '{' ? pattern.find('}', i) : i;
+            if (i != std::string::npos) {
+                ++i;
+            }
+        } else if (std::strchr("+.^$)]}", c) != nullptr) {
+            end_run();
+            ++i;
+        } else {
+            run.push_back(c);
+            ++i;
+        }
+        if (i == std::string::npos) {
+            return "";
+        }
+    }
+    end_run();
+    return best;
+}
+
+InterveneMatcher::InterveneMatcher() {}
+
+int InterveneMatcher::add_rule(
+        const std::string& pattern,
+        bool entire_match,
+        const std::string& target) {
+    if (!_patterns.emplace(entire_match ? pattern : pattern + "__SEARCH").second) {
+        return 0;
+    }
+    const size_t priority = _targets.size();
+    std::string literal;
+    if (parse_literal(pattern, literal)) {
+        if (entire_match) {
+            _exact_rules.emplace(literal, priority);
+        } else {
+            const int id = _automaton.add(literal);
+            _literal_rules.resize(std::max<size_t>(_literal_rules.size(), id + 1));
+            _literal_rules[id].search_rules.push_back(priority);
+        }
+        _targets.push_back(target);
+        return 0;
+    }
+
+    try {
+        _regex_rules.push_back(RegexRule{priority, entire_match, boost::regex(pattern)});
+    } catch (boost::bad_expression e) {
+        US_LOG(WARNING) << "patten: [" << pattern << "] compile error, " << e.what();
+        return -1;
+    }
+    const size_t index = _regex_rules.size() - 1;
+    literal = required_literal(pattern);
+    if (literal.empty()) {
+        _unfiltered_rules.push_back(index);
+    } else {
+        const int id = _automaton.add(literal);
+        _literal_rules.resize(std::max<size_t>(_literal_rules.size(), id + 1));
+        _literal_rules[id].regex_rules.push_back(index);
+    }
+    _targets.push_back(target);
+    return 0;
+}
+
+void InterveneMatcher::build() {
+    _automaton.build();
+}
+
+const std::string* InterveneMatcher::match(const std::string& text) const {
+    size_t best = _targets.size();
+    auto exact_iter = _exact_rules.find(text);
+    if (exact_iter != _exact_rules.end()) {
+        best = exact_iter->second;
+    }
+    // Regex rules are indexed in priority order.
+    std::vector<size_t> candidates(_unfiltered_rules);
+    if (!_automaton.empty()) {
+        _automaton.scan(text, [this, &best, &candidates](int id) {
+            const LiteralRules& rules = _literal_rules[id];
+            if (!rules.search_rules.empty()) {
+                best = std::min(best, rules.search_rules.front());
+            }
+            candidates.insert(
+                    candidates.end(), rules.regex_rules.begin(), rules.regex_rules.end());
+        });
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    for (size_t index : candidates) {
+        const RegexRule& rule = _regex_rules[index];
+        if (rule.priority >= best) {
+            break;
+        }
+        if (rule.entire_match ? boost::regex_match(text, rule.re)
+                              : boost::regex_search(text, rule.re)) {
+            best = rule.priority;
+            break;
+        }
+    }
+    return best < _targets.size() ? &_targets[best] : nullptr;
+}
+
+}  // namespace uskit
@@ -0,0 +1,120 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_INTERVENE_MATCHER_H
+#define USKIT_INTERVENE_MATCHER_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <boost/regex.hpp>
+
+namespace uskit {
+
+// Aho-Corasick automaton finding all occurrences of a set of literals in
+// one pass of text.
+class LiteralAutomaton {
+public:
+    LiteralAutomaton();
+    // Add non-empty literal, returns its id, which is the same for
+    // duplicate literals.
+    int add(const std::string& literal);
+    // Compute failure links after all literals are added.
+    void build();
+    // Call `on_hit' with id of every literal found in `text'.
+    template <typename Callback>
+    void scan(const std::string& text, Callback on_hit) const;
+    bool empty() const {
+        return _literal_num == 0;
+    }
+
+private:
+    int next(int state, unsigned char c) const;
+    static uint64_t edge_key(int state, unsigned char c) {
+        return (static_cast<uint64_t>(state) << 8) | c;
+    }
+
+    std::unordered_map<uint64_t, int> _edges;
+    // Longest proper suffix of each state which is also a state
+    std::vector<int> _fail;
+    // Literal ending at each state, -1 if none
+    std::vector<int> _output;
+    // Nearest suffix state with output, -1 if none
+    std::vector<int> _dict_suffix;
+    int _literal_num;
+};
+
+template <typename Callback>
+void LiteralAutomaton::scan(const std::string& text, Callback on_hit) const {
+    int state = 0;
+    for (unsigned char c : text) {
+        state = next(state, c);
+        for (int s = _output[state] >= 0 ? state : _dict_suffix[state]; s > 0;
+             s = _dict_suffix[s]) {
+            on_hit(_output[s]);
+        }
+    }
+}
+
+// Intervene rules compiled into one matcher. Rules added earlier take
+// priority. Literal patterns of entire match are looked up in a hash map,
+// literal patterns of search are found by Aho-Corasick automaton, which
+// also prefilters other regexs by literals they require, so that only
+// regexs whose required literal occurs are run.
+class InterveneMatcher {
+public:
+    InterveneMatcher();
+    // Add rule of `pattern', matching entire text or searching in text.
+    // Returns 0 on success, -1 if pattern is invalid.
+    int add_rule(const std::string& pattern, bool entire_match, const std::string& target);
+    // Build automaton after all rules are added.
+    void build();
+    // Find target of the first rule matching `text'.
+    // Returns nullptr if no rule matches.
+    const std::string* match(const std::string& text) const;
+    size_t size() const {
+        return _targets.size();
+    }
+
+private:
+    struct RegexRule {
+        size_t priority;
+        bool entire_match;
+        boost::regex re;
+    };
+    // Rules found by a literal of automaton
+    struct LiteralRules {
+        std::vector<size_t> search_rules;
+        // Index of regex rules requiring the literal
+        std::vector<size_t> regex_rules;
+    };
+
+    // Targets indexed by priority
+    std::vector<std::string> _targets;
+    std::unordered_map<std::string, size_t> _exact_rules;
+    std::vector<RegexRule> _regex_rules;
+    // Regex rules without required literal, in priority order
+    std::vector<size_t> _unfiltered_rules;
+    // Indexed by literal id of automaton
+    std::vector<LiteralRules> _literal_rules;
+    LiteralAutomaton _automaton;
+    // Patterns added, duplicates are ignored as the first one wins
+    std::unordered_set<std::string> _patterns;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_INTERVENE_MATCHER_H
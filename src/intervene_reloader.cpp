@@ -0,0 +1,131 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sys/stat.h>
+#include <algorithm>
+#include "intervene_reloader.h"
+#include "dynamic_config.h"
+#include "utils.h"
+
+namespace uskit {
+
+// Get modification time and size of file.
+// Returns 0 on success, -1 otherwise.
+static int file_stat(const std::string& path, int64_t& mtime, int64_t& size) {
+    struct stat file_info;
+    if (stat(path.c_str(), &file_info) != 0) {
+        return -1;
+    }
+    mtime = file_info.st_mtime;
+    size = file_info.st_size;
+    return 0;
+}
+
+InterveneReloader& InterveneReloader::instance() {
+    static InterveneReloader reloader;
+    return reloader;
+}
+
+int InterveneReloader::start(int interval_s) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_tid != 0) {
+        return 0;
+    }
+    if (interval_s <= 0) {
+        LOG(ERROR) << "Invalid intervene reload interval [" << interval_s << "]";
+        return -1;
+    }
+    _interval_s = interval_s;
+    if (bthread_start_background(&_tid, nullptr, run, this) != 0) {
+        LOG(ERROR) << "Failed to start intervene reloader";
+        _tid = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void InterveneReloader::watch(const std::string& path, FlowInterveneConfig* config) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto iter = _files.find(path);
+    if (iter == _files.end()) {
+        WatchedFile file{0, 0, {}};
+        file_stat(path, file.mtime, file.size);
+        iter = _files.emplace(path, std::move(file)).first;
+    }
+    iter->second.configs.push_back(config);
+}
+
+void InterveneReloader::unwatch(FlowInterveneConfig* config) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto iter = _files.begin(); iter != _files.end();) {
+        std::vector<FlowInterveneConfig*>& configs = iter->second.configs;
+        configs.erase(std::remove(configs.begin(), configs.end(), config), configs.end());
+        if (configs.empty()) {
+            iter = _files.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+void InterveneReloader::check() {
+    std::vector<std::string> changed_paths;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const auto& file : _files) {
+            int64_t mtime = 0;
+            int64_t size = 0;
+            if (file_stat(file.first, mtime, size) == 0 &&
+                (mtime != file.second.mtime || size != file.second.size)) {
+                changed_paths.push_back(file.first);
+            }
+        }
+    }
+
+    for (const auto& path : changed_paths) {
+        // Parse outside of lock, files may be large.
+        int64_t mtime = 0;
+        int64_t size = 0;
+        InterveneFileConfig file_config;
+        const bool stat_ok = file_stat(path, mtime, size) == 0;
+        const bool parse_ok = stat_ok && ReadProtoFromTextFile(path, &file_config) == 0;
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto iter = _files.find(path);
+        if (iter == _files.end()) {
+            continue;
+        }
+        // Broken file is not retried until it changes again.
+        iter->second.mtime = mtime;
+        iter->second.size = size;
+        if (!parse_ok) {
+            LOG(WARNING) << "Failed to parse intervene file [" << path << "], keep old rules";
+            continue;
+        }
+        for (FlowInterveneConfig* config : iter->second.configs) {
+            config->reload(file_config);
+        }
+        LOG(INFO) << "Reloaded intervene file [" << path << "] for "
+                  << iter->second.configs.size() << " flow node(s)";
+    }
+}
+
+void* InterveneReloader::run(void* arg) {
+    InterveneReloader* reloader = static_cast<InterveneReloader*>(arg);
+    while (bthread_usleep(reloader->_interval_s * 1000000L) == 0) {
+        reloader->check();
+    }
+    return nullptr;
+}
+
+}  // namespace uskit
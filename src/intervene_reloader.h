@@ -0,0 +1,68 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_INTERVENE_RELOADER_H
+#define USKIT_INTERVENE_RELOADER_H
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "bthread.h"
+
+namespace uskit {
+
+class FlowInterveneConfig;
+
+// Process-wide watcher of intervene files. Changed files are parsed in a
+// background bthread and rules of all flow nodes using them are rebuilt,
+// requests in flight keep using the rules they started with.
+class InterveneReloader {
+public:
+    static InterveneReloader& instance();
+
+    // Start checking files every `interval_s' seconds, only the first call
+    // takes effect.
+    // Returns 0 on success, -1 otherwise.
+    int start(int interval_s);
+    // Rebuild rules of `config' when file of `path' changes. `config' must
+    // be removed by `unwatch' before destroyed.
+    void watch(const std::string& path, FlowInterveneConfig* config);
+    void unwatch(FlowInterveneConfig* config);
+    // Reload all changed files.
+    void check();
+
+private:
+    struct WatchedFile {
+        // Modification time and size when loaded
+        int64_t mtime;
+        int64_t size;
+        std::vector<FlowInterveneConfig*> configs;
+    };
+
+    InterveneReloader() : _interval_s(0), _tid(0) {}
+    InterveneReloader(const InterveneReloader&) = delete;
+    InterveneReloader& operator=(const InterveneReloader&) = delete;
+
+    static void* run(void* arg);
+
+    std::mutex _mutex;
+    std::unordered_map<std::string, WatchedFile> _files;
+    int _interval_s;
+    bthread_t _tid;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_INTERVENE_RELOADER_H
@@ -0,0 +1,122 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_OBJECT_POOL_H
+#define USKIT_OBJECT_POOL_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "bvar.h"
+
+namespace uskit {
+
+// Name and reset operation of a pooled type, must be specialized for each
+// type put into ObjectPool:
+//   static const char* name();
+//   static void reset(T* obj);
+template <typename T>
+struct ObjectPoolTraits;
+
+// Object pool with a free list per worker thread, so acquiring and releasing
+// objects neither locks nor touches the allocator in steady state. Released
+// objects are reset and reused by the releasing thread, at most
+// `max_cached_per_thread()` objects are kept per thread.
+//
+// Counters:
+//   us_pool_<name>_new    objects allocated from heap
+//   us_pool_<name>_reuse  objects taken from free list
+template <typename T>
+class ObjectPool {
+public:
+    static ObjectPool& instance() {
+        static ObjectPool pool;
+        return pool;
+    }
+
+    // Take an object from free list of current thread, or allocate a new one.
+    T* get() {
+        std::vector<T*>& objects = local_free_list().objects;
+        if (!objects.empty()) {
+            T* obj = objects.back();
+            objects.pop_back();
+            _reuse_count << 1;
+            return obj;
+        }
+        _new_count << 1;
+        return new T();
+    }
+
+    // Reset `obj' and put it back to free list of current thread.
+    void put(T* obj) {
+        if (obj == nullptr) {
+            return;
+        }
+        ObjectPoolTraits<T>::reset(obj);
+        std::vector<T*>& objects = local_free_list().objects;
+        if (objects.size() >= max_cached_per_thread()) {
+            delete obj;
+            return;
+        }
+        objects.push_back(obj);
+    }
+
+    static size_t max_cached_per_thread() {
+        return 256;
+    }
+
+private:
+    ObjectPool() :
+            _new_count(std::string("us_pool_") + ObjectPoolTraits<T>::name() + "_new"),
+            _reuse_count(std::string("us_pool_") + ObjectPoolTraits<T>::name() + "_reuse") {}
+
+    // Cached objects are deleted when thread exits.
+    struct FreeList {
+        ~FreeList() {
+            for (T* obj : objects) {
+                delete obj;
+            }
+        }
+        std::vector<T*> objects;
+    };
+
+    static FreeList& local_free_list() {
+        static thread_local FreeList free_list;
+        return free_list;
+    }
+
+    BVAR_NAMESPACE::Adder<int64_t> _new_count;
+    BVAR_NAMESPACE::Adder<int64_t> _reuse_count;
+};
+
+// Deleter which returns object to its pool.
+template <typename T>
+struct PoolDeleter {
+    void operator()(T* obj) const {
+        ObjectPool<T>::instance().put(obj);
+    }
+};
+
+template <typename T>
+using PooledPtr = std::unique_ptr<T, PoolDeleter<T>>;
+
+// Take an object from pool of type T.
+template <typename T>
+PooledPtr<T> get_pooled_object() {
+    return PooledPtr<T>(ObjectPool<T>::instance().get());
+}
+
+}  // namespace uskit
+
+#endif  // USKIT_OBJECT_POOL_H
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include "policy/backend/dynamic_policy.h"
 #include "utils.h"
 #include <rapidjson/pointer.h>
@@ -20,8 +21,40 @@ namespace uskit {
 namespace policy {
 namespace backend {
 
+// Placeholder of dynamic arg in serialized body template.
+static const char* kDynamicArgPlaceholder = "__USKIT_DYNAMIC_ARG_PLACEHOLDER__";
+
+// Serialize body with a placeholder at `path` once, and split it into parts
+// before and after the placeholder. Body of each fan-out call is then spliced
+// from the shared parts and the serialized dynamic arg.
+// Returns 0 on success, -1 otherwise.
+static int build_body_template(
+        const rapidjson::Value* http_body,
+        const char* path,
+        rapidjson::Document::AllocatorType& allocator,
+        BUTIL_NAMESPACE::IOBuf& prefix,
+        BUTIL_NAMESPACE::IOBuf& suffix) {
+    rapidjson::Document body_doc(&allocator);
+    if (http_body != nullptr) {
+        rapidjson::Value body_value(*http_body, allocator);
+        json_set_value_by_path("/", body_doc, body_value);
+    }
+    rapidjson::Value placeholder(rapidjson::StringRef(kDynamicArgPlaceholder));
+    json_set_value_by_path(path, body_doc, placeholder);
+    const std::string body = json_encode(body_doc);
+    const std::string token = std::string("\"") + kDynamicArgPlaceholder + "\"";
+    const size_t pos = body.find(token);
+    if (pos == std::string::npos) {
+        US_LOG(ERROR) << "Failed to set dynamic arg at path [" << path << "]";
+        return -1;
+    }
+    prefix.append(body.data(), pos);
+    suffix.append(body.data() + pos + token.size(), body.size() - pos - token.size());
+    return 0;
+}
+
 int DynamicHttpRequestPolicy::init(const RequestConfig& config, const Backend* backend) {
-    _channel = backend->channel();
+    _channel = service_channel(backend);
     const BackendRequestConfig* template_config = nullptr;
     if (config.has_include()) {
         template_config = backend->request_config(config.include());
@@ -30,10 +63,24 @@ int DynamicHttpRequestPolicy::init(const RequestConfig& config, const Backend* b
         LOG(ERROR) << "Failed to init HTTP request config";
         return -1;
     }
+    if (config.max_fanout_concurrency() < 0 || config.dynamic_args_batch_size() <= 0) {
+        LOG(ERROR) << "Invalid max_fanout_concurrency or dynamic_args_batch_size";
+        return -1;
+    }
+    _max_fanout_concurrency = config.max_fanout_concurrency();
+    _dynamic_args_batch_size = config.dynamic_args_batch_size();
 
     return 0;
 }
 
+// Format header or query value, non-string value is serialized.
+static std::string to_param_string(const rapidjson::Value& value) {
+    if (value.IsString()) {
+        return std::string(value.GetString(), value.GetStringLength());
+    }
+    return json_encode(value);
+}
+
 int DynamicHttpRequestPolicy::run(BackendController* cntl) const {
     DynamicHTTPController* dyn_http_cntl = static_cast<DynamicHTTPController*>(cntl);
     expression::ExpressionContext request_context("request block", cntl->context());
@@ -54,6 +101,7 @@ int DynamicHttpRequestPolicy::run(BackendController* cntl) const {
                       << uskit::get_value_type(*dynamic_args_node) << " were given";
         return -1;
     }
+    const std::string args_node = dynamic_args_node->GetString();
     rapidjson::Value* http_method = request_context.get_variable("http_method");
     if (http_method == nullptr) {
         US_LOG(ERROR) << "Required HTTP method";
@@ -70,6 +118,68 @@ int DynamicHttpRequestPolicy::run(BackendController* cntl) const {
         US_LOG(ERROR) << "Required dynamic_args option";
         return -1;
     }
+    rapidjson::Value* dynamic_args_path = nullptr;
+    if (args_node == "body") {
+        dynamic_args_path = request_context.get_variable("dynamic_args_path");
+        if (dynamic_args_path == nullptr) {
+            US_LOG(ERROR) << "Required dynamic_args_path option";
+            return -1;
+        }
+        if (!dynamic_args_path->IsString()) {
+            US_LOG(ERROR) << "Required dynamic_args_path to be string, "
+                          << uskit::get_value_type(*dynamic_args_path) << " were given";
+            return -1;
+        }
+    }
+
+    // Request parts shared by all fan-out calls are evaluated only once.
+    const bool is_post = http_method->GetString() == std::string("post");
+    std::string content_type;
+    std::vector<std::pair<std::string, std::string>> headers;
+    rapidjson::Value* http_header = request_context.get_variable("http_header");
+    if (http_header != nullptr) {
+        const std::string content_type_key("Content-Type");
+        for (auto& m : http_header->GetObject()) {
+            if (m.value.IsNull()) {
+                continue;
+            }
+            if (m.name.GetString() == content_type_key) {
+                content_type = to_param_string(m.value);
+            } else {
+                headers.emplace_back(m.name.GetString(), to_param_string(m.value));
+            }
+        }
+    }
+    std::vector<std::pair<std::string, std::string>> queries;
+    rapidjson::Value* http_query = request_context.get_variable("http_query");
+    if (http_query != nullptr) {
+        for (auto& m : http_query->GetObject()) {
+            if (m.value.IsNull()) {
+                continue;
+            }
+            queries.emplace_back(m.name.GetString(), to_param_string(m.value));
+        }
+    }
+    // Set HTTP Body
+    // Only support JSON format
+    const bool has_json_body = content_type.find("application/json") != std::string::npos;
+    rapidjson::Value* http_body = request_context.get_variable("http_body");
+    BUTIL_NAMESPACE::IOBuf body_prefix;
+    BUTIL_NAMESPACE::IOBuf body_suffix;
+    if (has_json_body) {
+        if (args_node == "body") {
+            US_DLOG(INFO) << "path: " << dynamic_args_path->GetString();
+            if (build_body_template(http_body, dynamic_args_path->GetString(),
+                        request_context.allocator(), body_prefix, body_suffix) != 0) {
+                return -1;
+            }
+        } else if (http_body != nullptr) {
+            json_encode(*http_body, body_prefix);
+        }
+    }
+    // Only JSON body could carry a batch of dynamic args.
+    const size_t batch_size = args_node == "body" ? _dynamic_args_batch_size : 1;
+
     for (auto& dynamic_ele : dynamic_args->GetObject()) {
         if (dynamic_ele.value.IsNull()) {
             continue;
@@ -79,105 +189,60 @@ int DynamicHttpRequestPolicy::run(BackendController* cntl) const {
                           << uskit::get_value_type(dynamic_ele.value) << " were given";
             return -1;
         }
-        // For each element in dynamic args, we build a new brpc controller and push back at the
-        // end.
+        const rapidjson::Value& elements = dynamic_ele.value;
+        // For each element(or batch of elements) in dynamic args, we build a new brpc
+        // controller and push back at the end.
         std::lock_guard<std::mutex> lock(dyn_http_cntl->_outer_mutex);
-        for (size_t index = 0; index < dynamic_ele.value.GetArray().Size(); ++index) {
-            std::unique_ptr<BRPC_NAMESPACE::Controller> brpc_cntl(new BRPC_NAMESPACE::Controller());
-            std::string dynamic_ele_str;
-            if (dynamic_ele.value[index].IsString()) {
-                dynamic_ele_str = dynamic_ele.value[index].GetString();
-            } else {
-                dynamic_ele_str = json_encode(dynamic_ele.value[index]);
+        for (size_t begin = 0; begin < elements.Size(); begin += batch_size) {
+            const size_t end = std::min<size_t>(begin + batch_size, elements.Size());
+            PooledPtr<BRPC_NAMESPACE::Controller> brpc_cntl =
+                    get_pooled_object<BRPC_NAMESPACE::Controller>();
+            BRPC_NAMESPACE::HttpHeader& http_request = brpc_cntl->http_request();
+            if (!content_type.empty()) {
+                http_request.set_content_type(content_type);
             }
-            // Set HTTP Headers
-            rapidjson::Value* http_header = request_context.get_variable("http_header");
-            if (http_header != nullptr) {
-                std::string content_type_key("Content-Type");
-                for (auto& m : http_header->GetObject()) {
-                    if (m.value.IsNull()) {
-                        continue;
-                    }
-                    std::string value;
-                    if (m.value.IsString()) {
-                        value = m.value.GetString();
-                    } else {
-                        value = json_encode(m.value);
-                    }
-                    if (m.name.GetString() == content_type_key) {
-                        brpc_cntl->http_request().set_content_type(value);
-                    } else {
-                        brpc_cntl->http_request().SetHeader(m.name.GetString(), value);
-                    }
-                }
+            for (const auto& header : headers) {
+                http_request.SetHeader(header.first, header.second);
             }
-            // Set HTTP Method is POST
-            if (http_method->GetString() == std::string("post")) {
-                brpc_cntl->http_request().set_method(BRPC_NAMESPACE::HTTP_METHOD_POST);
+            if (is_post) {
+                http_request.set_method(BRPC_NAMESPACE::HTTP_METHOD_POST);
             }
             // Case args node is uri:
-            if (dynamic_args_node->GetString() == std::string("uri")) {
-                brpc_cntl->http_request().uri() = http_uri->GetString() + dynamic_ele_str;
+            if (args_node == "uri") {
+                http_request.uri() = http_uri->GetString() + to_param_string(elements[begin]);
             } else {
-                brpc_cntl->http_request().uri() = http_uri->GetString();
+                http_request.uri() = http_uri->GetString();
             }
-            // Set HTTP query
-            rapidjson::Value* http_query = request_context.get_variable("http_query");
-            if (http_query != nullptr) {
-                for (auto& m : http_query->GetObject()) {
-                    if (m.value.IsNull()) {
-                        continue;
-                    }
-                    std::string value;
-                    if (m.value.IsString()) {
-                        value = m.value.GetString();
-                    } else {
-                        value = json_encode(m.value);
-                    }
-                    brpc_cntl->http_request().uri().SetQuery(m.name.GetString(), value);
-                }
+            for (const auto& query : queries) {
+                http_request.uri().SetQuery(query.first, query.second);
             }
-            if (dynamic_args_node->GetString() == std::string("query")) {
-                brpc_cntl->http_request().uri().SetQuery(
-                        dynamic_ele.name.GetString(), dynamic_ele_str);
+            if (args_node == "query") {
+                http_request.uri().SetQuery(
+                        dynamic_ele.name.GetString(), to_param_string(elements[begin]));
             }
-            // Set HTTP Body
-            // Only support JSON format
-            rapidjson::Value* http_body = request_context.get_variable("http_body");
-            if (dynamic_args_node->GetString() == std::string("body")) {
-                rapidjson::Value* dynamic_args_path =
-                        request_context.get_variable("dynamic_args_path");
-                if (dynamic_args_path == nullptr) {
-                    US_LOG(ERROR) << "Required dynamic_args_path option";
-                    return -1;
-                }
-                if (!dynamic_args_path->IsString()) {
-                    US_LOG(ERROR) << "Required dynamic_args_path to be string, "
-                                  << uskit::get_value_type(*dynamic_args_path) << " were given";
-                    return -1;
-                }
-                rapidjson::Document http_body_doc(&request_context.allocator());
-
-                if (http_body != nullptr) {
-                    rapidjson::Value copyvalue(*http_body, request_context.allocator());
-                    json_set_value_by_path("/", http_body_doc, copyvalue);
-                }
-                US_DLOG(INFO) << "path: " << dynamic_args_path->GetString();
-                json_set_value_by_path(
-                        dynamic_args_path->GetString(), http_body_doc, dynamic_ele.value[index]);
-                const std::string& content_type = brpc_cntl->http_request().content_type();
-                if (content_type.find("application/json") != std::string::npos) {
-                    brpc_cntl->request_attachment().append(json_encode(http_body_doc));
-                }
-            } else if (http_body != nullptr) {
-                const std::string& content_type = brpc_cntl->http_request().content_type();
-                if (content_type.find("application/json") != std::string::npos) {
-                    brpc_cntl->request_attachment().append(json_encode(*http_body));
+            if (has_json_body) {
+                // Blocks of shared parts are referenced rather than copied.
+                BUTIL_NAMESPACE::IOBuf& attachment = brpc_cntl->request_attachment();
+                attachment.append(body_prefix);
+                if (args_node == "body") {
+                    if (batch_size > 1) {
+                        attachment.append("[");
+                        for (size_t index = begin; index < end; ++index) {
+                            if (index != begin) {
+                                attachment.append(",");
+                            }
+                            json_encode(elements[index], attachment);
+                        }
+                        attachment.append("]");
+                    } else {
+                        json_encode(elements[begin], attachment);
+                    }
+                    attachment.append(body_suffix);
                 }
             }
-            _channel->CallMethod(nullptr, brpc_cntl.get(), nullptr, nullptr, cntl->_done.get());
             dyn_http_cntl->brpc_controller_list().push_back(std::move(brpc_cntl));
         }
+        dyn_http_cntl->start_fanout(_channel, _max_fanout_concurrency);
         return 0;
     }
     return 0;
@@ -192,6 +257,9 @@ int DynamicHttpResponsePolicy::init(const ResponseConfig& config, const Backend*
         LOG(ERROR) << "Failed to init HTTP response config";
         return -1;
     }
+    if (parse_http_body_format(config.body_format(), _body_format) != 0) {
+        return -1;
+    }
 
     return 0;
 }
@@ -202,26 +270,15 @@ int DynamicHttpResponsePolicy::run(BackendController* cntl) const {
     expression::ExpressionContext response_context(
             "response block " + cntl->service_name(), cntl->context());
     response.SetArray();
-    rapidjson::Document tmp_doc;
     for (size_t index = 0; index != dyn_http_cntl->brpc_controller_list().size(); ++index) {
         BRPC_NAMESPACE::Controller* brpc_cntl = dyn_http_cntl->brpc_controller_list()[index].get();
-        // Generate response config dynamically.
-        const std::string& content_type = brpc_cntl->http_response().content_type();
-        // JSON Response
         US_DLOG(INFO) << "Response: " << brpc_cntl->response_attachment();
-        if (content_type.find("application/json") != std::string::npos) {
-            tmp_doc.Parse(brpc_cntl->response_attachment().to_string().c_str());
-            if (tmp_doc.HasParseError()) {
-                return -1;
-            }
-            response.PushBack(tmp_doc, response.GetAllocator());
-        } else {
-            std::string raw_response = brpc_cntl->response_attachment().to_string();
-            response.PushBack(
-                    rapidjson::Value().SetString(
-                            raw_response.c_str(), raw_response.length(), response.GetAllocator()),
-                    response.GetAllocator());
+        // Parse into allocator of response, so that no copy is needed when merging.
+        rapidjson::Document sub_response(&response.GetAllocator());
+        if (parse_http_body(*brpc_cntl, _body_format, sub_response) != 0) {
+            return -1;
         }
+        response.PushBack(sub_response, response.GetAllocator());
     }
     response_context.set_variable("response", response);
 
@@ -17,6 +17,7 @@
 
 #include "policy/backend_policy.h"
 #include "dynamic_config.h"
+#include "policy/backend/http_policy.h"
 
 namespace uskit {
 namespace policy {
@@ -25,7 +26,10 @@ namespace backend {
 // Dynamic HTTP request policy.
 class DynamicHttpRequestPolicy : public BackendRequestPolicy {
 public:
-    DynamicHttpRequestPolicy() : BackendRequestPolicy() {}
+    DynamicHttpRequestPolicy() :
+            BackendRequestPolicy(),
+            _max_fanout_concurrency(0),
+            _dynamic_args_batch_size(1) {}
     ~DynamicHttpRequestPolicy() {}
     int init(const RequestConfig& config, const Backend* backend);
     int run(BackendController* cntl) const;
@@ -33,16 +37,22 @@ public:
 private:
     std::shared_ptr<BRPC_NAMESPACE::Channel> _channel;
     DynamicHttpRequestConfig _request_config;
+    // Maximum in-flight calls of one fan-out, 0 means unlimited
+    size_t _max_fanout_concurrency;
+    // Number of dynamic args carried by one call in body mode
+    size_t _dynamic_args_batch_size;
 };
 
 // Dynamic HTTP response policy.
 class DynamicHttpResponsePolicy : public BackendResponsePolicy {
 public:
+    DynamicHttpResponsePolicy() : BackendResponsePolicy(), _body_format(HTTP_BODY_AUTO) {}
     int init(const ResponseConfig& config, const Backend* backend);
     int run(BackendController* cntl) const;
 
 private:
     BackendResponseConfig _response_config;
+    HttpBodyFormat _body_format;
 };
 
 }  // namespace backend
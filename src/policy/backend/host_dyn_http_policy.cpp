@@ -38,8 +38,13 @@ int HostDynHttpRequestPolicy::call_method(
         return -1;
     }
 
-    _channel->Init(host_ip_port->GetString(), &(_backend->channel()->options()));
-    _channel->CallMethod(nullptr, &brpc_cntl, nullptr, nullptr, cntl->_done.get());
+    std::shared_ptr<BRPC_NAMESPACE::Channel> channel =
+            _backend->host_channel_pool()->get(server_address);
+    if (!channel) {
+        US_LOG(ERROR) << "Failed to obtain channel to host [" << server_address << "]";
+        return -1;
+    }
+    channel->CallMethod(nullptr, &brpc_cntl, nullptr, nullptr, cntl->call_done());
     return 0;
 }
 
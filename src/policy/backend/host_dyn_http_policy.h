@@ -25,14 +25,12 @@ namespace backend {
 // Default HTTP request policy.
 class HostDynHttpRequestPolicy : public HttpRequestPolicy {
 public:
-    HostDynHttpRequestPolicy() : HttpRequestPolicy(), _channel(new BRPC_NAMESPACE::Channel) {}
+    HostDynHttpRequestPolicy() : HttpRequestPolicy() {}
+    // Issue call through channel to `host_ip_port` in host channel pool of backend.
     int call_method(
             BRPC_NAMESPACE::Controller& brpc_cntl,
             BackendController* cntl,
             expression::ExpressionContext& request_context) const;
-
-private:
-    std::unique_ptr<BRPC_NAMESPACE::Channel> _channel;
 };
 
 // Default HTTP response policy.
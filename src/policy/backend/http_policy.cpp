@@ -19,9 +19,48 @@ namespace uskit {
 namespace policy {
 namespace backend {
 
+static const std::string kJsonContentType("application/json");
+
+int parse_http_body_format(const std::string& name, HttpBodyFormat& format) {
+    if (name == "auto") {
+        format = HTTP_BODY_AUTO;
+    } else if (name == "json") {
+        format = HTTP_BODY_JSON;
+    } else if (name == "text") {
+        format = HTTP_BODY_TEXT;
+    } else {
+        LOG(ERROR) << "Unknown HTTP body format [" << name << "]";
+        return -1;
+    }
+    return 0;
+}
+
+int parse_http_body(
+        BRPC_NAMESPACE::Controller& brpc_cntl,
+        HttpBodyFormat format,
+        rapidjson::Document& doc) {
+    const BUTIL_NAMESPACE::IOBuf& body = brpc_cntl.response_attachment();
+    if (format == HTTP_BODY_AUTO) {
+        const std::string& content_type = brpc_cntl.http_response().content_type();
+        format = content_type.compare(0, kJsonContentType.size(), kJsonContentType) == 0
+                ? HTTP_BODY_JSON
+                : HTTP_BODY_TEXT;
+    }
+    if (format == HTTP_BODY_JSON) {
+        if (json_decode(body, doc) != 0) {
+            US_LOG(WARNING) << "Failed to parse JSON response, error: " << doc.GetParseError()
+                            << ", offset: " << doc.GetErrorOffset();
+            return -1;
+        }
+    } else {
+        json_set_string(body, doc, doc.GetAllocator());
+    }
+    return 0;
+}
+
 int HttpRequestPolicy::init(const RequestConfig& config, const Backend* backend) {
     _backend = backend;
-    _channel = backend->channel();
+    _channel = service_channel(backend);
     const BackendRequestConfig* template_config = nullptr;
     if (config.has_include()) {
         template_config = backend->request_config(config.include());
@@ -39,7 +78,7 @@ int HttpRequestPolicy::call_method(
         BackendController* cntl,
         expression::ExpressionContext& request_context) const {
     US_DLOG(INFO) << "context name: " << request_context.name();
-    _channel->CallMethod(nullptr, &brpc_cntl, nullptr, nullptr, cntl->_done.get());
+    _channel->CallMethod(nullptr, &brpc_cntl, nullptr, nullptr, cntl->call_done());
     return 0;
 }
 
@@ -116,7 +155,7 @@ int HttpRequestPolicy::run(BackendController* cntl) const {
     if (http_body != nullptr) {
         const std::string& content_type = brpc_cntl.http_request().content_type();
         if (content_type.find("application/json") != std::string::npos) {
-            brpc_cntl.request_attachment().append(json_encode(*http_body));
+            json_encode(*http_body, brpc_cntl.request_attachment());
         }
     }
 
@@ -132,6 +171,9 @@ int HttpResponsePolicy::init(const ResponseConfig& config, const Backend* backen
         LOG(ERROR) << "Failed to init HTTP response config";
         return -1;
     }
+    if (parse_http_body_format(config.body_format(), _body_format) != 0) {
+        return -1;
+    }
 
     return 0;
 }
@@ -142,17 +184,8 @@ int HttpResponsePolicy::run(BackendController* cntl) const {
     expression::ExpressionContext response_context(
             "response block " + cntl->service_name(), cntl->context());
     // Generate response config dynamically.
-    const std::string& content_type = brpc_cntl.http_response().content_type();
-
-    // JSON Response
-    if (content_type.find("application/json") != std::string::npos) {
-        response.Parse(brpc_cntl.response_attachment().to_string().c_str());
-        if (response.HasParseError()) {
-            return -1;
-        }
-    } else {
-        std::string raw_response = brpc_cntl.response_attachment().to_string();
-        response.SetString(raw_response.c_str(), raw_response.length(), response.GetAllocator());
+    if (parse_http_body(brpc_cntl, _body_format, response) != 0) {
+        return -1;
     }
     US_DLOG(INFO) << "Response: " << brpc_cntl.response_attachment();
     response_context.set_variable("response", response);
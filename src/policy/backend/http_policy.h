@@ -22,6 +22,26 @@ namespace uskit {
 namespace policy {
 namespace backend {
 
+// Format of HTTP response body, resolved once per service.
+enum HttpBodyFormat {
+    // Detect by Content-Type of each response
+    HTTP_BODY_AUTO = 0,
+    HTTP_BODY_JSON = 1,
+    HTTP_BODY_TEXT = 2,
+};
+
+// Resolve body format from configuration.
+// Returns 0 on success, -1 otherwise.
+int parse_http_body_format(const std::string& name, HttpBodyFormat& format);
+
+// Parse HTTP response body, JSON body is parsed from IOBuf directly and other
+// body is copied as string once.
+// Returns 0 on success, -1 otherwise.
+int parse_http_body(
+        BRPC_NAMESPACE::Controller& brpc_cntl,
+        HttpBodyFormat format,
+        rapidjson::Document& doc);
+
 // Default HTTP request policy.
 class HttpRequestPolicy : public BackendRequestPolicy {
 public:
@@ -44,11 +64,13 @@ private:
 // Default HTTP response policy.
 class HttpResponsePolicy : public BackendResponsePolicy {
 public:
+    HttpResponsePolicy() : BackendResponsePolicy(), _body_format(HTTP_BODY_AUTO) {}
     int init(const ResponseConfig& config, const Backend* backend);
     int run(BackendController* cntl) const;
 
 protected:
     BackendResponseConfig _response_config;
+    HttpBodyFormat _body_format;
 };
 
 }  // namespace backend
@@ -0,0 +1,139 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "brpc.h"
+#include "policy/backend/protobuf_policy.h"
+#include "protobuf_json.h"
+#include "utils.h"
+
+namespace uskit {
+namespace policy {
+namespace backend {
+
+int ProtobufRequestPolicy::init(const RequestConfig& config, const Backend* backend) {
+    _channel = service_channel(backend);
+    _schema = backend->proto_schema();
+    const BackendRequestConfig* template_config = nullptr;
+    if (config.has_include()) {
+        template_config = backend->request_config(config.include());
+    }
+    if (_request_config.init(config, template_config) != 0) {
+        LOG(ERROR) << "Failed to init protobuf request config";
+        return -1;
+    }
+    if (_schema == nullptr) {
+        LOG(ERROR) << "Required proto_descriptor of backend for protobuf request";
+        return -1;
+    }
+    // Method is resolved once, messages are created from its prototypes.
+    const std::string& method_name = _request_config.pb_method();
+    _method = _schema->find_method(method_name);
+    if (_method == nullptr) {
+        LOG(ERROR) << "Protobuf method [" << method_name << "] not found";
+        return -1;
+    }
+
+    return 0;
+}
+
+int ProtobufRequestPolicy::run(BackendController* cntl) const {
+    ProtobufController* pb_cntl = static_cast<ProtobufController*>(cntl);
+    BRPC_NAMESPACE::Controller& brpc_cntl = pb_cntl->brpc_controller();
+    expression::ExpressionContext request_context(
+            "protobuf request block " + pb_cntl->service_name(), pb_cntl->context());
+
+    // Generate request config dynamically.
+    if (_request_config.run(request_context) != 0) {
+        US_LOG(ERROR) << "Failed to generate protobuf request config";
+        return -1;
+    }
+    US_DLOG(INFO) << "Generated request config: " << request_context.str();
+
+    std::unique_ptr<google::protobuf::Message> request(_schema->new_message(_method->input_type()));
+    std::unique_ptr<google::protobuf::Message> response(
+            _schema->new_message(_method->output_type()));
+    if (!request || !response) {
+        US_LOG(ERROR) << "Failed to create messages of method [" << _method->full_name() << "]";
+        return -1;
+    }
+    rapidjson::Value* pb_body = request_context.get_variable("pb_body");
+    if (pb_body != nullptr) {
+        std::string error;
+        if (json_to_pb(*pb_body, request.get(), &error) != 0) {
+            US_LOG(ERROR) << "Failed to build request of method [" << _method->full_name()
+                          << "]: " << error;
+            return -1;
+        }
+    } else if (!request->IsInitialized()) {
+        US_LOG(ERROR) << "Missing required fields of method [" << _method->full_name()
+                      << "]: " << request->InitializationErrorString();
+        return -1;
+    }
+
+    pb_cntl->set_messages(request.release(), response.release());
+    _channel->CallMethod(
+            _method, &brpc_cntl, pb_cntl->pb_request(), pb_cntl->pb_response(),
+            cntl->call_done());
+
+    return 0;
+}
+
+int ProtobufResponsePolicy::init(const ResponseConfig& config, const Backend* backend) {
+    const BackendResponseConfig* template_config = nullptr;
+    if (config.has_include()) {
+        template_config = backend->response_config(config.include());
+    }
+    if (_response_config.init(config, template_config) != 0) {
+        LOG(ERROR) << "Failed to init response config";
+        return -1;
+    }
+
+    return 0;
+}
+
+int ProtobufResponsePolicy::run(BackendController* cntl) const {
+    ProtobufController* pb_cntl = static_cast<ProtobufController*>(cntl);
+    BackendResponse& response = pb_cntl->response();
+    expression::ExpressionContext response_context(
+            "protobuf response block " + pb_cntl->service_name(), pb_cntl->context());
+
+    if (pb_cntl->pb_response() == nullptr) {
+        US_LOG(ERROR) << "No protobuf response of service [" << pb_cntl->service_name() << "]";
+        return -1;
+    }
+    // Convert fields into response directly, without JSON text in between.
+    pb_to_json(*pb_cntl->pb_response(), response, response.GetAllocator());
+
+    US_DLOG(INFO) << "Response: " << json_encode(response);
+    response_context.set_variable("response", response);
+
+    if (_response_config.run(response_context) != 0) {
+        US_LOG(ERROR) << "Failed to generate protobuf response config";
+        return -1;
+    }
+
+    US_DLOG(INFO) << "Generated respone config: " << response_context.str();
+    rapidjson::Value* output = response_context.get_variable("output");
+    if (output == nullptr) {
+        US_DLOG(ERROR) << "Not output found";
+        return -1;
+    }
+    output->Swap(response);
+
+    return 0;
+}
+
+}  // namespace backend
+}  // namespace policy
+}  // namespace uskit
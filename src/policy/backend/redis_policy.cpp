@@ -12,8 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <deque>
 #include "brpc.h"
 #include "policy/backend/redis_policy.h"
+#include "redis_pipeline.h"
 #include "utils.h"
 
 namespace uskit {
@@ -21,7 +23,7 @@ namespace policy {
 namespace backend {
 
 int RedisRequestPolicy::init(const RequestConfig& config, const Backend* backend) {
-    _channel = backend->channel();
+    _channel = service_channel(backend);
     const BackendRequestConfig* template_config = nullptr;
     if (config.has_include()) {
         template_config = backend->request_config(config.include());
@@ -34,6 +36,28 @@ int RedisRequestPolicy::init(const RequestConfig& config, const Backend* backend
     return 0;
 }
 
+// Append an argument to Redis command components. String arguments are
+// referenced directly, other values are formatted into `buffers`, which
+// must outlive the components.
+static void append_redis_arg(
+        const rapidjson::Value& arg,
+        std::vector<BUTIL_NAMESPACE::StringPiece>& components,
+        std::deque<std::string>& buffers) {
+    if (arg.IsString()) {
+        components.emplace_back(arg.GetString(), arg.GetStringLength());
+        return;
+    }
+    if (arg.IsInt64()) {
+        buffers.emplace_back(std::to_string(arg.GetInt64()));
+    } else if (arg.IsUint64()) {
+        buffers.emplace_back(std::to_string(arg.GetUint64()));
+    } else {
+        // Serialize other values, i.e. double, bool and object.
+        buffers.emplace_back(json_encode(arg));
+    }
+    components.emplace_back(buffers.back());
+}
+
 int RedisRequestPolicy::run(BackendController* cntl) const {
     RedisController* redis_cntl = static_cast<RedisController*>(cntl);
     BRPC_NAMESPACE::Controller& brpc_cntl = redis_cntl->brpc_controller();
@@ -52,21 +76,37 @@ int RedisRequestPolicy::run(BackendController* cntl) const {
         US_LOG(ERROR) << "Required redis command";
         return -1;
     } else {
-        BUTIL_NAMESPACE::StringPiece components[64];
+        std::vector<BUTIL_NAMESPACE::StringPiece> components;
+        std::deque<std::string> buffers;
+        // Commands are built into a request of the call first, so a failed
+        // command leaves nothing in the merged request if pipelined.
         BRPC_NAMESPACE::RedisRequest redis_request;
         // Add Redis commands.
         for (auto& cmd : redis_cmd->GetArray()) {
-            components[0] = cmd["op"].GetString();
-            int size = 1;
-            for (auto& arg : cmd["arg"].GetArray()) {
-                components[size++] = arg.GetString();
+            const rapidjson::Value& op = cmd["op"];
+            const rapidjson::Value& args = cmd["arg"];
+            components.clear();
+            components.reserve(args.Size() + 1);
+            components.emplace_back(op.GetString(), op.GetStringLength());
+            for (auto& arg : args.GetArray()) {
+                append_redis_arg(arg, components, buffers);
+            }
+            if (!redis_request.AddCommandByComponents(components.data(), components.size())) {
+                US_LOG(ERROR) << "Failed to add redis command [" << op.GetString() << "]";
+                return -1;
             }
-            redis_request.AddCommandByComponents(components, size);
         }
 
+        RedisPipeline* pipeline = redis_cntl->pipeline();
+        if (pipeline != nullptr) {
+            const int first_reply = pipeline->request().command_size();
+            pipeline->request().MergeFrom(redis_request);
+            pipeline->add_member(redis_cntl, first_reply);
+            return 0;
+        }
         BRPC_NAMESPACE::RedisResponse& redis_response = redis_cntl->redis_response();
         _channel->CallMethod(
-                nullptr, &brpc_cntl, &redis_request, &redis_response, cntl->_done.get());
+                nullptr, &brpc_cntl, &redis_request, &redis_response, cntl->call_done());
     }
 
     return 0;
@@ -85,28 +125,31 @@ int RedisResponsePolicy::init(const ResponseConfig& config, const Backend* backe
     return 0;
 }
 
-// Parse Redis reply recursively.
-int parse_redis_reply(const BRPC_NAMESPACE::RedisReply& redis_reply, rapidjson::Document& doc) {
-    rapidjson::Document::AllocatorType& allocator = doc.GetAllocator();
+// Parse Redis reply recursively, strings are copied from reply buffers into
+// allocator directly.
+int parse_redis_reply(
+        const BRPC_NAMESPACE::RedisReply& redis_reply,
+        rapidjson::Value& value,
+        rapidjson::Document::AllocatorType& allocator) {
     if (redis_reply.is_nil()) {
-        doc.SetNull();
+        value.SetNull();
     } else if (redis_reply.is_string()) {
-        std::string str = redis_reply.data().as_string();
-        doc.SetString(str.c_str(), str.length(), allocator);
+        const BUTIL_NAMESPACE::StringPiece str = redis_reply.data();
+        value.SetString(str.data(), str.size(), allocator);
     } else if (redis_reply.is_integer()) {
-        doc.SetInt(redis_reply.integer());
+        value.SetInt64(redis_reply.integer());
     } else if (redis_reply.is_array()) {
-        doc.SetArray();
-        rapidjson::Document sub_doc(&allocator);
+        value.SetArray();
+        value.Reserve(static_cast<rapidjson::SizeType>(redis_reply.size()), allocator);
         for (size_t i = 0; i < redis_reply.size(); ++i) {
-            if (parse_redis_reply(redis_reply[i], sub_doc) != 0) {
+            rapidjson::Value sub_value;
+            if (parse_redis_reply(redis_reply[i], sub_value, allocator) != 0) {
                 return -1;
             }
-            doc.PushBack(sub_doc, allocator);
+            value.PushBack(sub_value, allocator);
         }
     } else if (redis_reply.is_error()) {
-        std::string error_str = redis_reply.error_message();
-        doc.SetString(error_str.c_str(), error_str.length(), allocator);
+        value.SetString(redis_reply.error_message(), allocator);
     } else {
         US_LOG(ERROR) << "Unknown redis reply type: [" << redis_reply.type() << "]";
         return -1;
@@ -118,19 +161,20 @@ int parse_redis_reply(const BRPC_NAMESPACE::RedisReply& redis_reply, rapidjson::
 int RedisResponsePolicy::run(BackendController* cntl) const {
     RedisController* redis_cntl = static_cast<RedisController*>(cntl);
     BackendResponse& response = redis_cntl->response();
-    BRPC_NAMESPACE::RedisResponse& redis_response = redis_cntl->redis_response();
     expression::ExpressionContext response_context(
             "redis response block " + redis_cntl->service_name(), redis_cntl->context());
     rapidjson::Document::AllocatorType& allocator = response.GetAllocator();
 
     response.SetArray();
-    for (int i = 0; i < redis_response.reply_size(); ++i) {
+    response.Reserve(redis_cntl->reply_size(), allocator);
+    for (int i = 0; i < redis_cntl->reply_size(); ++i) {
+        const BRPC_NAMESPACE::RedisReply& redis_reply = redis_cntl->reply(i);
         rapidjson::Value error(0);
-        if (redis_response.reply(i).is_error()) {
+        if (redis_reply.is_error()) {
             error.SetInt(1);
         }
-        rapidjson::Document reply_value(&allocator);
-        if (parse_redis_reply(redis_response.reply(i), reply_value) != 0) {
+        rapidjson::Value reply_value;
+        if (parse_redis_reply(redis_reply, reply_value, allocator) != 0) {
             US_LOG(ERROR) << "Failed to parse redis reply";
             return -1;
         }
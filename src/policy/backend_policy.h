@@ -35,6 +35,20 @@ public:
         return 0;
     }
     virtual int run(BackendController* cntl) const = 0;
+    // Set channel of the service, i.e. channel with retry policy of the
+    // service, must be called before init.
+    void set_service_channel(const std::shared_ptr<BRPC_NAMESPACE::Channel>& channel) {
+        _service_channel = channel;
+    }
+
+protected:
+    // Channel to call service with, channel of backend if service has no own channel.
+    std::shared_ptr<BRPC_NAMESPACE::Channel> service_channel(const Backend* backend) const {
+        return _service_channel ? _service_channel : backend->channel();
+    }
+
+private:
+    std::shared_ptr<BRPC_NAMESPACE::Channel> _service_channel;
 };
 
 // Base class of backend response policy.
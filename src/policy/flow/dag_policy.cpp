@@ -0,0 +1,345 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <deque>
+#include <mutex>
+#include <set>
+#include <unordered_set>
+#include <boost/regex.hpp>
+#include "bthread.h"
+#include "policy/flow/dag_policy.h"
+#include "expression/expression.h"
+#include "request_trace.h"
+#include "thread_data.h"
+#include "utils.h"
+
+namespace uskit {
+namespace policy {
+namespace flow {
+
+// State shared by all bthreads running nodes of one request.
+struct DagPolicy::DagRun {
+    struct Task {
+        DagRun* run;
+        size_t node_id;
+    };
+
+    DagRun(const DagPolicy* dag_policy, expression::ExpressionContext& context)
+        : policy(dag_policy), top_context(context), failed(false), assigned_data(nullptr),
+          attr(BTHREAD_ATTR_NORMAL), countdown(static_cast<int>(dag_policy->_nodes.size())) {
+        // Node bthreads inherit rpcz span so that their calls are linked.
+        attr.flags |= BTHREAD_INHERIT_SPAN;
+        for (size_t i = 0; i < policy->_nodes.size(); ++i) {
+            pending.push_back(policy->_nodes[i].depend_count);
+            tasks.push_back(Task{this, i});
+        }
+    }
+
+    const DagPolicy* policy;
+    // Variables `backend' and `result' of top context and `pending', `failed'
+    // and `log_entries' are guarded by `mutex'.
+    expression::ExpressionContext& top_context;
+    BTHREAD_NAMESPACE::Mutex mutex;
+    std::vector<int> pending;
+    bool failed;
+    std::vector<std::string> log_entries;
+    std::vector<Task> tasks;
+    // Server thread local options, logid and trace of the request, inherited
+    // by node bthreads.
+    void* assigned_data;
+    std::string logid;
+    RequestTracePtr trace;
+    bthread_attr_t attr;
+    BTHREAD_NAMESPACE::CountdownEvent countdown;
+};
+
+// First level key of an output path, e.g. "a" of "a/b".
+static std::string output_key(const std::string& key) {
+    return key.substr(0, key.find('/'));
+}
+
+int DagPolicy::init(const google::protobuf::RepeatedPtrField<FlowNodeConfig>& config) {
+    if (DefaultPolicy::init(config) != 0) {
+        return -1;
+    }
+    return build_graph(config);
+}
+
+int DagPolicy::build_graph(const google::protobuf::RepeatedPtrField<FlowNodeConfig>& config) {
+    std::unordered_map<std::string, size_t> node_index;
+    for (const auto& node_config : config) {
+        if (node_index.find(node_config.name()) != node_index.end()) {
+            LOG(ERROR) << "Duplicated flow node [" << node_config.name() << "]";
+            return -1;
+        }
+        node_index.emplace(node_config.name(), _nodes.size());
+        _nodes.push_back(DagNode{node_config.name(), {}, 0});
+    }
+
+    // Nodes recalling each service and generating each result.
+    std::unordered_map<std::string, std::vector<size_t>> backend_producers;
+    std::unordered_map<std::string, std::vector<size_t>> result_producers;
+    for (int i = 0; i < config.size(); ++i) {
+        const FlowNodeConfig& node_config = config.Get(i);
+        for (const auto& service_name : _flow_map.at(node_config.name()).get_recall_service_list()) {
+            backend_producers[service_name].push_back(i);
+        }
+        for (const auto& output : node_config.output()) {
+            result_producers[output_key(output.key())].push_back(i);
+        }
+        for (const auto& if_config : node_config.if_()) {
+            for (const auto& output : if_config.output()) {
+                result_producers[output_key(output.key())].push_back(i);
+            }
+        }
+    }
+
+    static const boost::regex reference_regex("\\$(backend|result)\\b(\\s*,\\s*'([^'/]*))?");
+    std::vector<std::set<size_t>> depends(_nodes.size());
+    for (int i = 0; i < config.size(); ++i) {
+        const FlowNodeConfig& node_config = config.Get(i);
+        for (const auto& depend : node_config.depend()) {
+            auto iter = node_index.find(depend);
+            if (iter == node_index.end()) {
+                LOG(ERROR) << "Flow node [" << depend << "] depended by ["
+                           << node_config.name() << "] not found";
+                return -1;
+            }
+            depends[i].insert(iter->second);
+        }
+        if (node_config.has_next()) {
+            depends[node_index.at(node_config.next())].insert(i);
+        }
+        std::vector<std::string> strings;
+        collect_proto_strings(node_config, strings);
+        for (const auto& str : strings) {
+            for (boost::sregex_iterator iter(str.begin(), str.end(), reference_regex), end;
+                 iter != end;
+                 ++iter) {
+                const auto& producers =
+                        (*iter)[1] == "backend" ? backend_producers : result_producers;
+                if ((*iter)[3].matched) {
+                    auto producer_iter = producers.find((*iter)[3].str());
+                    if (producer_iter != producers.end()) {
+                        depends[i].insert(
+                                producer_iter->second.begin(), producer_iter->second.end());
+                    }
+                    continue;
+                }
+                // Whole variable is referred, depend on all producers before.
+                for (const auto& producer : producers) {
+                    for (size_t node_id : producer.second) {
+                        if (node_id < static_cast<size_t>(i)) {
+                            depends[i].insert(node_id);
+                        }
+                    }
+                }
+            }
+        }
+        depends[i].erase(i);
+    }
+
+    for (size_t i = 0; i < _nodes.size(); ++i) {
+        _nodes[i].depend_count = static_cast<int>(depends[i].size());
+        for (size_t depend : depends[i]) {
+            _nodes[depend].children.push_back(i);
+        }
+        if (depends[i].empty()) {
+            _roots.push_back(i);
+        }
+    }
+
+    // Make sure the graph is acyclic.
+    std::vector<int> pending;
+    for (const auto& node : _nodes) {
+        pending.push_back(node.depend_count);
+    }
+    std::deque<size_t> ready(_roots.begin(), _roots.end());
+    size_t visited = 0;
+    while (!ready.empty()) {
+        size_t node_id = ready.front();
+        ready.pop_front();
+        ++visited;
+        for (size_t child : _nodes[node_id].children) {
+            if (--pending[child] == 0) {
+                ready.push_back(child);
+            }
+        }
+    }
+    if (visited != _nodes.size()) {
+        LOG(ERROR) << "Dependency cycle found among flow nodes";
+        return -1;
+    }
+
+    return 0;
+}
+
+int DagPolicy::run(USRequest& request, USResponse& response) const {
+    expression::ExpressionContext top_context("top context", response.GetAllocator());
+    top_context.set_variable("request", request);
+    top_context.set_variable("backend", rapidjson::Value().SetObject());
+    top_context.set_variable("result", rapidjson::Value().SetObject());
+
+    UnifiedSchedulerThreadData* td =
+            static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
+    DagRun run(this, top_context);
+    run.assigned_data = bthread_get_assigned_data();
+    if (td != nullptr) {
+        run.logid = td->logid();
+        run.trace = td->trace();
+    }
+
+    // Start all roots but the last in bthreads, run the last one in place.
+    for (size_t i = 0; i + 1 < _roots.size(); ++i) {
+        bthread_t tid;
+        if (bthread_start_background(
+                    &tid, &run.attr, run_chain_in_bthread, &run.tasks[_roots[i]]) != 0) {
+            US_LOG(WARNING) << "Failed to start bthread, run flow node ["
+                            << _nodes[_roots[i]].name << "] in place";
+            run.countdown.signal(run_chain(run, _roots[i]));
+        }
+    }
+    run.countdown.signal(run_chain(run, _roots.back()));
+    run.countdown.wait();
+
+    if (td != nullptr) {
+        td->add_log_entries(run.log_entries);
+    }
+    if (run.failed) {
+        return -1;
+    }
+    rapidjson::Value* result = top_context.get_variable("result");
+    result->Swap(response);
+    return 0;
+}
+
+void* DagPolicy::run_chain_in_bthread(void* arg) {
+    DagRun::Task* task = static_cast<DagRun::Task*>(arg);
+    DagRun& run = *task->run;
+    // Inherit thread local data of server so that logs are tracked.
+    bthread_assign_data(run.assigned_data);
+    UnifiedSchedulerThreadData* td =
+            static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
+    if (td != nullptr) {
+        td->reset();
+        td->set_logid(run.logid);
+        td->set_trace(run.trace);
+    }
+    int finished = run.policy->run_chain(run, task->node_id);
+    if (td != nullptr) {
+        std::lock_guard<BTHREAD_NAMESPACE::Mutex> lock(run.mutex);
+        run.log_entries.insert(
+                run.log_entries.end(), td->log_entries().begin(), td->log_entries().end());
+    }
+    // `run' may be destroyed once signaled.
+    run.countdown.signal(finished);
+    return nullptr;
+}
+
+int DagPolicy::run_chain(DagRun& run, size_t node_id) const {
+    int finished = 0;
+    while (true) {
+        bool failed = false;
+        {
+            std::lock_guard<BTHREAD_NAMESPACE::Mutex> lock(run.mutex);
+            failed = run.failed;
+        }
+        // Nodes after a failed one only finish without running.
+        if (!failed && run_node(run, node_id) != 0) {
+            US_LOG(ERROR) << "Flow node [" << _nodes[node_id].name << "] running error";
+            failed = true;
+        }
+        ++finished;
+
+        std::vector<size_t> ready;
+        {
+            std::lock_guard<BTHREAD_NAMESPACE::Mutex> lock(run.mutex);
+            if (failed) {
+                run.failed = true;
+            }
+            for (size_t child : _nodes[node_id].children) {
+                if (--run.pending[child] == 0) {
+                    ready.push_back(child);
+                }
+            }
+        }
+        if (ready.empty()) {
+            break;
+        }
+        // Continue with the last ready node in current bthread.
+        for (size_t i = 0; i + 1 < ready.size(); ++i) {
+            bthread_t tid;
+            if (bthread_start_background(
+                        &tid, &run.attr, run_chain_in_bthread, &run.tasks[ready[i]]) != 0) {
+                US_LOG(WARNING) << "Failed to start bthread, run flow node ["
+                                << _nodes[ready[i]].name << "] in place";
+                finished += run_chain(run, ready[i]);
+            }
+        }
+        node_id = ready.back();
+    }
+    return finished;
+}
+
+int DagPolicy::run_node(DagRun& run, size_t node_id) const {
+    const DagNode& node = _nodes[node_id];
+    US_DLOG(INFO) << "Running flow node [" << node.name << "]";
+    TRACEPRINTF("flow node %s", node.name.c_str());
+    ScopedSpan span(current_trace().get(), "flow", node.name);
+    // Node context reads `request' from top context, while `backend' and
+    // `result' are snapshots allocated from its own document.
+    USResponse node_doc(rapidjson::kObjectType);
+    expression::ExpressionContext node_context(
+            "dag node " + node.name, run.top_context, node_doc.GetAllocator());
+    {
+        std::lock_guard<BTHREAD_NAMESPACE::Mutex> lock(run.mutex);
+        rapidjson::Value backend(*run.top_context.get_variable("backend"), node_context.allocator());
+        node_context.set_variable("backend", backend);
+        rapidjson::Value result(*run.top_context.get_variable("result"), node_context.allocator());
+        node_context.set_variable("result", result);
+    }
+
+    HelperPtr helper = std::make_shared<FlowPolicyHelper>();
+    helper->_curr_flow = node.name;
+    expression::ExpressionContext flow_context("flow block", node_context);
+    if (kernel_process(flow_context, _flow_map.at(node.name), helper) != 0) {
+        return -1;
+    }
+
+    std::lock_guard<BTHREAD_NAMESPACE::Mutex> lock(run.mutex);
+    rapidjson::Document::AllocatorType& allocator = run.top_context.allocator();
+    // Services recalled by this node are those missing in top context.
+    rapidjson::Value* backend = run.top_context.get_variable("backend");
+    for (auto& member : node_context.get_variable("backend")->GetObject()) {
+        if (!backend->HasMember(member.name)) {
+            backend->AddMember(
+                    rapidjson::Value(member.name, allocator),
+                    rapidjson::Value(member.value, allocator),
+                    allocator);
+        }
+    }
+    rapidjson::Value* flow_output = flow_context.get_variable("output");
+    rapidjson::Value* result = run.top_context.get_variable("result");
+    if (flow_output != nullptr && flow_output->IsObject()) {
+        if (merge_json_objects(*result, *flow_output, allocator) != 0) {
+            US_LOG(ERROR) << "flow output merge error";
+            return -1;
+        }
+    }
+    return 0;
+}
+
+}  // namespace flow
+}  // namespace policy
+}  // namespace uskit
@@ -0,0 +1,64 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_POLICY_FLOW_DAG_POLICY_H
+#define USKIT_POLICY_FLOW_DAG_POLICY_H
+
+#include "policy/flow/default_policy.h"
+
+namespace uskit {
+namespace policy {
+namespace flow {
+
+// Flow policy running flow nodes as a dependency graph, set policy name as
+// "dag". A node depends on nodes listed in `depend', the node whose static
+// `next' is it, and nodes recalling services or generating results it
+// refers to by `get($backend, '<name>')' or `get($result, '<name>')'.
+// Independent nodes run concurrently in bthreads and every node runs once,
+// dynamic `next' and intervene flow are ignored.
+class DagPolicy : public DefaultPolicy {
+public:
+    int init(const google::protobuf::RepeatedPtrField<FlowNodeConfig>& config) override;
+    int run(USRequest& request, USResponse& response) const override;
+
+protected:
+    bool support_prefetch() const override {
+        return false;
+    }
+
+private:
+    struct DagNode {
+        std::string name;
+        // Nodes depending on this node
+        std::vector<size_t> children;
+        int depend_count;
+    };
+    struct DagRun;
+
+    int build_graph(const google::protobuf::RepeatedPtrField<FlowNodeConfig>& config);
+    // Run node `node_id' and the nodes it makes ready in current bthread,
+    // returns number of finished nodes.
+    int run_chain(DagRun& run, size_t node_id) const;
+    int run_node(DagRun& run, size_t node_id) const;
+    static void* run_chain_in_bthread(void* arg);
+
+    std::vector<DagNode> _nodes;
+    std::vector<size_t> _roots;
+};
+
+}  // namespace flow
+}  // namespace policy
+}  // namespace uskit
+
+#endif  // USKIT_POLICY_FLOW_DAG_POLICY_H
@@ -13,6 +13,8 @@
 
 #include "policy/flow/default_policy.h"
 #include "expression/expression.h"
+#include "request_trace.h"
+#include "utils.h"
 
 namespace uskit {
 namespace policy {
@@ -25,6 +27,9 @@ int DefaultPolicy::init(const google::protobuf::RepeatedPtrField<FlowNodeConfig>
     if (flow_check(config) != 0) {
         return -1;
     }
+    if (prefetch_init(config) != 0) {
+        return -1;
+    }
     return 0;
 }
 
@@ -67,6 +72,8 @@ int DefaultPolicy::config_parser(const google::protobuf::RepeatedPtrField<FlowNo
             const InterveneConfig inter_config = flow_node_config.intervene_config();
             std::string file_name = inter_config.intervene_file();
             InterveneFileConfig intervene_file;
+            // Only intervene files on disk are reloaded.
+            std::string intervene_config_file;
             if (_curr_dir == "") {
                 auto iter = _intervene_map.find(file_name);
                 if (iter == _intervene_map.end()) {
@@ -76,14 +83,15 @@ int DefaultPolicy::config_parser(const google::protobuf::RepeatedPtrField<FlowNo
                     intervene_file = iter->second;
                 }
             } else {
-                std::string intervene_config_file(_curr_dir + file_name);
+                intervene_config_file = _curr_dir + file_name;
                 if (ReadProtoFromTextFile(intervene_config_file, &intervene_file) != 0) {
                     US_LOG(ERROR) << "Failed to parse file: " << _curr_dir
                                   << file_name;
                     return -1;
                 };
             }
-            if (flow_config.set_intervene_config(inter_config, intervene_file) != 0) {
+            if (flow_config.set_intervene_config(
+                        inter_config, intervene_file, intervene_config_file, _usid) != 0) {
                 US_LOG(ERROR) << "Failed to initialize intervene by file: ["
                               << file_name << "]";
                 return -1;
@@ -106,6 +114,62 @@ int DefaultPolicy::flow_check(const google::protobuf::RepeatedPtrField<FlowNodeC
     return 0;
 }
 
+int DefaultPolicy::prefetch_init(
+        const google::protobuf::RepeatedPtrField<FlowNodeConfig>& config) {
+    std::unordered_map<std::string, const FlowNodeConfig*> node_configs;
+    for (const auto& flow_node_config : config) {
+        node_configs.emplace(flow_node_config.name(), &flow_node_config);
+    }
+    for (const auto& flow_node_config : config) {
+        if (!flow_node_config.prefetch_next()) {
+            continue;
+        }
+        if (!support_prefetch() || !flow_node_config.has_next()) {
+            LOG(WARNING) << "prefetch_next of flow node [" << flow_node_config.name()
+                         << "] is ignored, static next and default flow policy are required";
+            continue;
+        }
+        // Definitions of next node are evaluated before current node
+        // finishes, and cancelling is not supported across prefetched
+        // services and the others.
+        const FlowNodeConfig& next_config = *node_configs.at(flow_node_config.next());
+        const std::string& cancel_order = _flow_map.at(next_config.name()).get_cancel_order();
+        bool prefetchable = !next_config.has_intervene_config() &&
+                (cancel_order.empty() || cancel_order == "NONE");
+        for (const auto& def : next_config.def()) {
+            if (refers_flow_results(def)) {
+                prefetchable = false;
+            }
+        }
+        if (!prefetchable) {
+            LOG(WARNING) << "Flow node [" << next_config.name() << "] can not be prefetched, "
+                         << "definitions refer to $backend or $result, or intervene or "
+                         << "cancel order is configured";
+            continue;
+        }
+        _prefetch_next.emplace(flow_node_config.name(), next_config.name());
+    }
+    return 0;
+}
+
+std::shared_ptr<FlowPrefetch> DefaultPolicy::start_prefetch(
+        const std::string& curr_flow,
+        expression::ExpressionContext& top_context) const {
+    auto next_iter = _prefetch_next.find(curr_flow);
+    if (next_iter == _prefetch_next.end()) {
+        return nullptr;
+    }
+    auto plan_iter = _prefetch_plans.find(next_iter->second);
+    if (plan_iter == _prefetch_plans.end()) {
+        return nullptr;
+    }
+    auto prefetch = std::make_shared<FlowPrefetch>(*plan_iter->second);
+    if (prefetch->start(this, *top_context.get_variable("request")) != 0) {
+        return nullptr;
+    }
+    return prefetch;
+}
+
 int DefaultPolicy::kernel_process(
         expression::ExpressionContext& flow_context,
         const FlowConfig& flow_config,
@@ -118,7 +182,15 @@ int DefaultPolicy::kernel_process(
         US_LOG(ERROR) << "Failed in define before recall";
         return -1;
     }
-    if (flow_config.recall(this, flow_context) != 0) {
+    FlowPrefetch* prefetch = helper->_prefetch.get();
+    if (prefetch != nullptr && prefetch->flow_name() == curr_flow) {
+        // Recall the others while prefetched services may be in flight.
+        if (flow_config.recall_except(this, flow_context, prefetch->services()) != 0 ||
+            prefetch->merge_into(flow_context) != 0) {
+            US_LOG(ERROR) << "Failed to recall for flow [" << curr_flow << "]";
+            return -1;
+        }
+    } else if (flow_config.recall(this, flow_context) != 0) {
         US_LOG(ERROR) << "Failed to recall for flow [" << curr_flow << "]";
         return -1;
     }
@@ -201,8 +273,17 @@ int DefaultPolicy::inner_run(USRequest& request, USResponse& response, HelperPtr
             return -1;
         }
         helper->_curr_flow = curr_flow;
+        // Recall of next node is prefetched while this node is running.
+        std::shared_ptr<FlowPrefetch> next_prefetch = start_prefetch(curr_flow, top_context);
         expression::ExpressionContext flow_context("flow block", top_context);
-        if (single_node(flow_context, top_context, helper) != 0) {
+        TRACEPRINTF("flow node %s", curr_flow.c_str());
+        int ret = 0;
+        {
+            ScopedSpan span(current_trace().get(), "flow", curr_flow);
+            ret = single_node(flow_context, top_context, helper);
+        }
+        helper->_prefetch = next_prefetch;
+        if (ret != 0) {
             US_LOG(ERROR) << "Flow node [" << curr_flow << "] running error";
             return -1;
         }
@@ -214,6 +295,8 @@ int DefaultPolicy::inner_run(USRequest& request, USResponse& response, HelperPtr
             break;
         }
     }
+    // Prefetch not used by last node is wasted.
+    helper->_prefetch.reset();
     rapidjson::Value* result = top_context.get_variable("result");
     result->Swap(response);
     return 0;
@@ -221,6 +304,35 @@ int DefaultPolicy::inner_run(USRequest& request, USResponse& response, HelperPtr
 
 int DefaultPolicy::set_backend_engine(std::shared_ptr<BackendEngine> backend_engine) {
     _backend_engine = backend_engine;
+    // Resolve recall services of every flow node once.
+    for (auto& iter : _flow_map) {
+        if (iter.second.compile_recall_plan(*_backend_engine) != 0) {
+            return -1;
+        }
+    }
+    // Only services whose requests do not refer to results of nodes before
+    // are prefetched.
+    _prefetch_plans.clear();
+    for (const auto& iter : _prefetch_next) {
+        const std::string& next_flow = iter.second;
+        if (_prefetch_plans.find(next_flow) != _prefetch_plans.end()) {
+            continue;
+        }
+        const FlowConfig& next_config = _flow_map.at(next_flow);
+        std::unique_ptr<FlowPrefetchPlan> plan(
+                new FlowPrefetchPlan(_usid, next_flow, &next_config));
+        for (const auto& service : next_config.get_recall_services()) {
+            const BackendService* backend_service = _backend_engine->get_service(service.first);
+            if (backend_service != nullptr && !backend_service->request_reads_flow()) {
+                plan->services.push_back(service);
+            }
+        }
+        if (plan->services.empty()) {
+            LOG(WARNING) << "No service of flow node [" << next_flow << "] can be prefetched";
+            continue;
+        }
+        _prefetch_plans.emplace(next_flow, std::move(plan));
+    }
     return 0;
 }
 
@@ -235,12 +347,13 @@ int DefaultPolicy::set_rank_engine(std::shared_ptr<RankEngine> rank_engine) {
 int DefaultPolicy::backend_run(
         const std::vector<std::pair<std::string, int>>& recall_services,
         expression::ExpressionContext& context,
-        const std::string& cancel_order) const {
-    return _backend_engine->run(recall_services, context, cancel_order);
+        const std::string& cancel_order,
+        std::shared_ptr<CallIdsVecThreadSafe> call_ids) const {
+    return _backend_engine->run(recall_services, context, cancel_order, call_ids);
 }
 int DefaultPolicy::backend_run(
         const FlowRecallConfig* recall_config,
-        std::vector<std::shared_ptr<uskit::expression::ExpressionContext>>& context_vec,
+        FlowContextArray& context_vec,
         std::shared_ptr<policy::FlowPolicyHelper> helper) const {
     return _backend_engine->run(this, recall_config, context_vec, helper);
 }
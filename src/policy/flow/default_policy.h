@@ -17,6 +17,7 @@
 
 #include "policy/flow_policy.h"
 #include "dynamic_config.h"
+#include "flow_prefetch.h"
 
 namespace uskit {
 namespace policy {
@@ -48,10 +49,11 @@ public:
     int backend_run(
             const std::vector<std::pair<std::string, int>>& recall_services,
             expression::ExpressionContext& context,
-            const std::string& cancel_order) const override;
+            const std::string& cancel_order,
+            std::shared_ptr<CallIdsVecThreadSafe> call_ids = nullptr) const override;
     int backend_run(
             const FlowRecallConfig* recall_config,
-            std::vector<std::shared_ptr<uskit::expression::ExpressionContext>>& context_vec,
+            FlowContextArray& context_vec,
             std::shared_ptr<policy::FlowPolicyHelper> helper) const override;
     int rank_run(
             const std::string& name,
@@ -67,9 +69,25 @@ public:
             const rapidjson::Value& response,
             std::shared_ptr<policy::FlowPolicyHelper> helper) const override;
 protected:
+    // Whether `prefetch_next' of flow nodes is supported, prefetched results
+    // are merged by recall of `kernel_process' of this class only.
+    virtual bool support_prefetch() const {
+        return true;
+    }
+    int prefetch_init(const google::protobuf::RepeatedPtrField<FlowNodeConfig>& config);
+    // Start prefetch of next node of `curr_flow', returns nullptr if not
+    // configured or failed to start.
+    std::shared_ptr<FlowPrefetch> start_prefetch(
+            const std::string& curr_flow,
+            expression::ExpressionContext& top_context) const;
+
     std::unordered_map<std::string, FlowConfig> _flow_map;
     std::string _start_flow;
     std::unordered_map<std::string, InterveneFileConfig> _intervene_map;
+    // Next node to prefetch of each flow node
+    std::unordered_map<std::string, std::string> _prefetch_next;
+    // Prefetch plans of prefetched flow nodes, built with backend engine
+    std::unordered_map<std::string, std::unique_ptr<FlowPrefetchPlan>> _prefetch_plans;
 };
 
 }  // namespace flow
@@ -24,36 +24,6 @@ int AsyncInsideNodePolicy::kernel_process(
         const FlowConfig& flow_config,
         HelperPtr helper) const {
     std::string curr_flow = helper->_curr_flow;
-    // define local context, allocator should be DIFFERENT between services.
-    size_t _service_size = _backend_engine->get_service_size();
-    std::vector<std::shared_ptr<expression::ExpressionContext>> flow_context_array;
-    std::vector<std::shared_ptr<USResponse>> toy_document_vector;
-    for (size_t i = 0; i < _service_size; i++) {
-        toy_document_vector.push_back(std::make_shared<USResponse>(rapidjson::kObjectType));
-        flow_context_array.push_back(std::make_shared<expression::ExpressionContext>(
-                "top_context", toy_document_vector[i]->GetAllocator()));
-
-        rapidjson::Value* request_val = flow_context.get_variable("request");
-        rapidjson::Value copyvalue(*request_val, flow_context_array[i]->allocator());
-        flow_context_array[i]->set_variable("request", copyvalue);
-
-        rapidjson::Value* backend_val = flow_context.get_variable("backend");
-        if (backend_val) {
-            rapidjson::Value back_copyvalue(*backend_val, flow_context_array[i]->allocator());
-            flow_context_array[i]->set_variable("backend", back_copyvalue);
-        } else {
-            flow_context_array[i]->set_variable("backend", rapidjson::Value().SetObject());
-        }
-
-        rapidjson::Value* result_val = flow_context.get_variable("result");
-        if (result_val) {
-            rapidjson::Value result_copyvalue(*result_val, flow_context_array[i]->allocator());
-            flow_context_array[i]->set_variable("result", result_copyvalue);
-        } else {
-            flow_context_array[i]->set_variable("result", rapidjson::Value().SetObject());
-        }
-    }
-
     // General routin in one flow node:
     // 1. def; 2. recall; 3. merge recall results; 4. rank; 5. output
     if (flow_config.recall_run_def(flow_context) != 0) {
@@ -61,6 +31,10 @@ int AsyncInsideNodePolicy::kernel_process(
         return -1;
     }
 
+    // Service contexts read the flow context as a shared snapshot, which is
+    // not modified until recall finishes, and are created only for recalled
+    // services.
+    FlowContextArray flow_context_array(flow_context, _backend_engine->get_service_size());
     if (flow_config.recall(this, flow_context_array, helper) != 0) {
         US_LOG(ERROR) << "Failed to recall for flow [" << curr_flow << "]";
         return -1;
@@ -80,16 +54,18 @@ int AsyncInsideNodePolicy::kernel_process(
             continue;
         }
         size_t index = _backend_engine->get_service_index(service_name);
-        auto tmp_context = flow_context_array[index];
+        // Only services writing their results have own `backend'.
+        expression::ExpressionContext* tmp_context = flow_context_array.find(index);
+        if (tmp_context == nullptr || !tmp_context->has_variable("backend")) {
+            continue;
+        }
         rapidjson::Value* backend_val = tmp_context->get_variable("backend");
         US_DLOG(INFO) << "service [" << service_name
                       << "] backend res: " << json_encode(*backend_val);
-        if (!backend_val->IsNull()) {
-            flow_context.merge_variable("backend", *backend_val);
-            success_recall_services.PushBack(
-                    rapidjson::Value(service_name.c_str(), flow_context.allocator()).Move(),
-                    flow_context.allocator());
-        }
+        flow_context.merge_variable("backend", *backend_val);
+        success_recall_services.PushBack(
+                rapidjson::Value(service_name.c_str(), flow_context.allocator()).Move(),
+                flow_context.allocator());
     }
     flow_context.set_variable("recall", success_recall_services);
     US_DLOG(INFO) << "after recall: " << flow_context.str();
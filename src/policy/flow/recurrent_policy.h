@@ -29,6 +29,11 @@ public:
             expression::ExpressionContext& flow_context,
             const FlowConfig& flow_config,
             HelperPtr helper) const override;
+
+protected:
+    bool support_prefetch() const override {
+        return false;
+    }
 };
 
 }  // namespace flow
@@ -23,6 +23,9 @@
 #include <json2pb/json_to_pb.h>
 
 namespace uskit {
+
+class FlowPrefetch;
+
 namespace policy {
 
 // Helper calss for flow policy
@@ -35,6 +38,8 @@ public:
     std::vector<std::string> _filterout_services;
     std::shared_ptr<CallIdsVecThreadSafe> _call_ids_ptr;
     std::shared_ptr<std::unordered_set<std::string>> _target_service_set;
+    // Prefetched recall of the flow node to run next
+    std::shared_ptr<FlowPrefetch> _prefetch;
     inline FlowPolicyHelper() :
             _policy_name(""), _intervene_service(""), _call_ids_ptr(nullptr), _target_service_set(nullptr) {}
 };
@@ -46,6 +51,7 @@ class FlowPolicy {
 public:
     FlowPolicy() :
             _curr_dir(""),
+            _usid(""),
             _backend_engine(std::make_shared<BackendEngine>()),
             _rank_engine(std::make_shared<RankEngine>()) {}
     virtual ~FlowPolicy() {}
@@ -58,16 +64,22 @@ public:
         _curr_dir = curr_dir;
         return 0;
     }
+    // Metrics are exposed with `usid', empty for config carried by request.
+    virtual int set_usid(std::string usid) {
+        _usid = usid;
+        return 0;
+    }
     virtual int run(USRequest& request, USResponse& response) const = 0;
     virtual int set_backend_engine(std::shared_ptr<BackendEngine> backend_engine) = 0;
     virtual int set_rank_engine(std::shared_ptr<RankEngine> rank_engine) = 0;
     virtual int backend_run(
             const std::vector<std::pair<std::string, int>>& recall_services,
             expression::ExpressionContext& context,
-            const std::string& cancel_order) const = 0;
+            const std::string& cancel_order,
+            std::shared_ptr<CallIdsVecThreadSafe> call_ids = nullptr) const = 0;
     virtual int backend_run(
             const FlowRecallConfig* recall_config,
-            std::vector<std::shared_ptr<uskit::expression::ExpressionContext>>& context_vec,
+            FlowContextArray& context_vec,
             std::shared_ptr<policy::FlowPolicyHelper> helper) const = 0;
     virtual int rank_run(
             const std::string& name,
@@ -86,6 +98,7 @@ public:
 
 protected:
     std::string _curr_dir;
+    std::string _usid;
     std::shared_ptr<BackendEngine> _backend_engine;
     std::shared_ptr<RankEngine> _rank_engine;
 };
@@ -0,0 +1,65 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fstream>
+#include <google/protobuf/descriptor.pb.h>
+#include "proto_schema.h"
+#include "butil.h"
+
+namespace uskit {
+
+int ProtoSchema::init(const google::protobuf::RepeatedPtrField<std::string>& descriptor_files) {
+    for (const auto& file_name : descriptor_files) {
+        std::ifstream input(file_name, std::ios::binary);
+        if (!input) {
+            LOG(ERROR) << "Failed to open proto descriptor [" << file_name << "]";
+            return -1;
+        }
+        google::protobuf::FileDescriptorSet file_set;
+        if (!file_set.ParseFromIstream(&input)) {
+            LOG(ERROR) << "Failed to parse proto descriptor [" << file_name << "]";
+            return -1;
+        }
+        // Dependencies precede dependents with --include_imports.
+        for (const auto& file_proto : file_set.file()) {
+            if (_pool.FindFileByName(file_proto.name()) != nullptr) {
+                continue;
+            }
+            if (_pool.BuildFile(file_proto) == nullptr) {
+                LOG(ERROR) << "Failed to build proto file [" << file_proto.name()
+                           << "] in descriptor [" << file_name << "]";
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+const google::protobuf::MethodDescriptor* ProtoSchema::find_method(
+        const std::string& full_name) const {
+    return _pool.FindMethodByName(full_name);
+}
+
+google::protobuf::Message* ProtoSchema::new_message(
+        const google::protobuf::Descriptor* descriptor) {
+    // Prototypes are cached by factory, which is thread-safe.
+    const google::protobuf::Message* prototype = _factory.GetPrototype(descriptor);
+    if (prototype == nullptr) {
+        return nullptr;
+    }
+    return prototype->New();
+}
+
+}  // namespace uskit
@@ -0,0 +1,50 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_PROTO_SCHEMA_H
+#define USKIT_PROTO_SCHEMA_H
+
+#include <string>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/dynamic_message.h>
+#include "config.pb.h"
+
+namespace uskit {
+
+// Protobuf schema of a backend, loaded from descriptor sets at runtime, so that
+// services can be called without generated code.
+class ProtoSchema {
+public:
+    ProtoSchema() {}
+    // Load descriptor sets generated by `protoc --include_imports --descriptor_set_out`.
+    // Returns 0 on success, -1 otherwise.
+    int init(const google::protobuf::RepeatedPtrField<std::string>& descriptor_files);
+    // Find RPC method by full name, i.e. package.Service.Method.
+    // Returns nullptr if not found.
+    const google::protobuf::MethodDescriptor* find_method(const std::string& full_name) const;
+    // Create an empty message of given type, which is owned by caller.
+    google::protobuf::Message* new_message(const google::protobuf::Descriptor* descriptor);
+
+private:
+    ProtoSchema(const ProtoSchema&) = delete;
+    ProtoSchema& operator=(const ProtoSchema&) = delete;
+
+    google::protobuf::DescriptorPool _pool;
+    // Factory of dynamic messages, must be destroyed before pool
+    google::protobuf::DynamicMessageFactory _factory;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_PROTO_SCHEMA_H
@@ -0,0 +1,373 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <stdlib.h>
+#include <limits>
+#include <vector>
+#include <google/protobuf/descriptor.h>
+#include "protobuf_json.h"
+#include "utils.h"
+
+namespace uskit {
+
+using google::protobuf::Descriptor;
+using google::protobuf::EnumValueDescriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Message;
+using google::protobuf::Reflection;
+
+static bool parse_int64(const rapidjson::Value& value, int64_t& result) {
+    if (value.IsInt64()) {
+        result = value.GetInt64();
+        return true;
+    }
+    if (value.IsString() && value.GetStringLength() > 0) {
+        char* end = nullptr;
+        errno = 0;
+        result = strtoll(value.GetString(), &end, 10);
+        return errno == 0 && *end == '\0';
+    }
+    return false;
+}
+
+static bool parse_uint64(const rapidjson::Value& value, uint64_t& result) {
+    if (value.IsUint64()) {
+        result = value.GetUint64();
+        return true;
+    }
+    if (value.IsString() && value.GetStringLength() > 0 && value.GetString()[0] != '-') {
+        char* end = nullptr;
+        errno = 0;
+        result = strtoull(value.GetString(), &end, 10);
+        return errno == 0 && *end == '\0';
+    }
+    return false;
+}
+
+static int type_error(
+        const FieldDescriptor* field,
+        const rapidjson::Value& value,
+        std::string* error) {
+    *error = "Invalid value of field [" + field->full_name() + "] with type "
+             + field->cpp_type_name() + ", " + get_value_type(value) + " were given";
+    return -1;
+}
+
+static int fill_message(const rapidjson::Value& value, Message* message, std::string* error);
+
+// Set a single value of field, which is appended if field is repeated.
+static int set_field(
+        const rapidjson::Value& value,
+        Message* message,
+        const FieldDescriptor* field,
+        std::string* error) {
+    const Reflection* reflection = message->GetReflection();
+    const bool repeated = field->is_repeated();
+    switch (field->cpp_type()) {
+    case FieldDescriptor::CPPTYPE_INT32: {
+        int64_t v = 0;
+        if (!parse_int64(value, v) || v < std::numeric_limits<int32_t>::min()
+                || v > std::numeric_limits<int32_t>::max()) {
+            return type_error(field, value, error);
+        }
+        if (repeated) {
+            reflection->AddInt32(message, field, static_cast<int32_t>(v));
+        } else {
+            reflection->SetInt32(message, field, static_cast<int32_t>(v));
+        }
+        break;
+    }
+    case FieldDescriptor::CPPTYPE_INT64: {
+        int64_t v = 0;
+        if (!parse_int64(value, v)) {
+            return type_error(field, value, error);
+        }
+        if (repeated) {
+            reflection->AddInt64(message, field, v);
+        } else {
+            reflection->SetInt64(message, field, v);
+        }
+        break;
+    }
+    case FieldDescriptor::CPPTYPE_UINT32: {
+        uint64_t v = 0;
+        if (!parse_uint64(value, v) || v > std::numeric_limits<uint32_t>::max()) {
+            return type_error(field, value, error);
+        }
+        if (repeated) {
+            reflection->AddUInt32(message, field, static_cast<uint32_t>(v));
+        } else {
+            reflection->SetUInt32(message, field, static_cast<uint32_t>(v));
+        }
+        break;
+    }
+    case FieldDescriptor::CPPTYPE_UINT64: {
+        uint64_t v = 0;
+        if (!parse_uint64(value, v)) {
+            return type_error(field, value, error);
+        }
+        if (repeated) {
+            reflection->AddUInt64(message, field, v);
+        } else {
+            reflection->SetUInt64(message, field, v);
+        }
+        break;
+    }
+    case FieldDescriptor::CPPTYPE_DOUBLE:
+    case FieldDescriptor::CPPTYPE_FLOAT: {
+        if (!value.IsNumber()) {
+            return type_error(field, value, error);
+        }
+        const double v = value.GetDouble();
+        if (field->cpp_type() == FieldDescriptor::CPPTYPE_DOUBLE) {
+            if (repeated) {
+                reflection->AddDouble(message, field, v);
+            } else {
+                reflection->SetDouble(message, field, v);
+            }
+        } else if (repeated) {
+            reflection->AddFloat(message, field, static_cast<float>(v));
+        } else {
+            reflection->SetFloat(message, field, static_cast<float>(v));
+        }
+        break;
+    }
+    case FieldDescriptor::CPPTYPE_BOOL: {
+        bool v = false;
+        if (value.IsBool()) {
+            v = value.GetBool();
+        } else if (value.IsString() && value.GetString() == std::string("true")) {
+            // Key of map is always string
+            v = true;
+        } else if (!value.IsString() || value.GetString() != std::string("false")) {
+            return type_error(field, value, error);
+        }
+        if (repeated) {
+            reflection->AddBool(message, field, v);
+        } else {
+            reflection->SetBool(message, field, v);
+        }
+        break;
+    }
+    case FieldDescriptor::CPPTYPE_STRING: {
+        if (!value.IsString()) {
+            return type_error(field, value, error);
+        }
+        std::string v(value.GetString(), value.GetStringLength());
+        if (repeated) {
+            reflection->AddString(message, field, std::move(v));
+        } else {
+            reflection->SetString(message, field, std::move(v));
+        }
+        break;
+    }
+    case FieldDescriptor::CPPTYPE_ENUM: {
+        const EnumValueDescriptor* enum_value = nullptr;
+        if (value.IsString()) {
+            enum_value = field->enum_type()->FindValueByName(value.GetString());
+        } else if (value.IsInt()) {
+            enum_value = field->enum_type()->FindValueByNumber(value.GetInt());
+        }
+        if (enum_value == nullptr) {
+            return type_error(field, value, error);
+        }
+        if (repeated) {
+            reflection->AddEnum(message, field, enum_value);
+        } else {
+            reflection->SetEnum(message, field, enum_value);
+        }
+        break;
+    }
+    case FieldDescriptor::CPPTYPE_MESSAGE: {
+        Message* sub_message = repeated ?
+                reflection->AddMessage(message, field) :
+                reflection->MutableMessage(message, field);
+        if (fill_message(value, sub_message, error) != 0) {
+            return -1;
+        }
+        break;
+    }
+    }
+    return 0;
+}
+
+static int fill_message(const rapidjson::Value& value, Message* message, std::string* error) {
+    const Descriptor* descriptor = message->GetDescriptor();
+    if (!value.IsObject()) {
+        *error = "Required object for message [" + descriptor->full_name() + "], "
+                 + get_value_type(value) + " were given";
+        return -1;
+    }
+    const Reflection* reflection = message->GetReflection();
+    for (auto& m : value.GetObject()) {
+        const FieldDescriptor* field = descriptor->FindFieldByName(
+                std::string(m.name.GetString(), m.name.GetStringLength()));
+        if (field == nullptr || m.value.IsNull()) {
+            continue;
+        }
+        if (field->is_map()) {
+            if (!m.value.IsObject()) {
+                return type_error(field, m.value, error);
+            }
+            const FieldDescriptor* key_field = field->message_type()->map_key();
+            const FieldDescriptor* value_field = field->message_type()->map_value();
+            for (auto& entry : m.value.GetObject()) {
+                Message* entry_message = reflection->AddMessage(message, field);
+                if (set_field(entry.name, entry_message, key_field, error) != 0
+                        || set_field(entry.value, entry_message, value_field, error) != 0) {
+                    return -1;
+                }
+            }
+        } else if (field->is_repeated()) {
+            if (!m.value.IsArray()) {
+                return type_error(field, m.value, error);
+            }
+            for (auto& element : m.value.GetArray()) {
+                if (set_field(element, message, field, error) != 0) {
+                    return -1;
+                }
+            }
+        } else if (set_field(m.value, message, field, error) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int json_to_pb(const rapidjson::Value& value, Message* message, std::string* error) {
+    if (fill_message(value, message, error) != 0) {
+        return -1;
+    }
+    if (!message->IsInitialized()) {
+        *error = "Missing required fields: " + message->InitializationErrorString();
+        return -1;
+    }
+    return 0;
+}
+
+// Get a single value of field, `index' is ignored unless field is repeated.
+static void get_field(
+        const Message& message,
+        const FieldDescriptor* field,
+        int index,
+        rapidjson::Value& value,
+        rapidjson::Document::AllocatorType& allocator) {
+    const Reflection* reflection = message.GetReflection();
+    const bool repeated = field->is_repeated();
+    switch (field->cpp_type()) {
+    case FieldDescriptor::CPPTYPE_INT32:
+        value.SetInt(repeated ?
+                reflection->GetRepeatedInt32(message, field, index) :
+                reflection->GetInt32(message, field));
+        break;
+    case FieldDescriptor::CPPTYPE_INT64:
+        value.SetInt64(repeated ?
+                reflection->GetRepeatedInt64(message, field, index) :
+                reflection->GetInt64(message, field));
+        break;
+    case FieldDescriptor::CPPTYPE_UINT32:
+        value.SetUint(repeated ?
+                reflection->GetRepeatedUInt32(message, field, index) :
+                reflection->GetUInt32(message, field));
+        break;
+    case FieldDescriptor::CPPTYPE_UINT64:
+        value.SetUint64(repeated ?
+                reflection->GetRepeatedUInt64(message, field, index) :
+                reflection->GetUInt64(message, field));
+        break;
+    case FieldDescriptor::CPPTYPE_DOUBLE:
+        value.SetDouble(repeated ?
+                reflection->GetRepeatedDouble(message, field, index) :
+                reflection->GetDouble(message, field));
+        break;
+    case FieldDescriptor::CPPTYPE_FLOAT:
+        value.SetDouble(repeated ?
+                reflection->GetRepeatedFloat(message, field, index) :
+                reflection->GetFloat(message, field));
+        break;
+    case FieldDescriptor::CPPTYPE_BOOL:
+        value.SetBool(repeated ?
+                reflection->GetRepeatedBool(message, field, index) :
+                reflection->GetBool(message, field));
+        break;
+    case FieldDescriptor::CPPTYPE_STRING: {
+        std::string scratch;
+        const std::string& str = repeated ?
+                reflection->GetRepeatedStringReference(message, field, index, &scratch) :
+                reflection->GetStringReference(message, field, &scratch);
+        value.SetString(str.data(), str.size(), allocator);
+        break;
+    }
+    case FieldDescriptor::CPPTYPE_ENUM: {
+        const EnumValueDescriptor* enum_value = repeated ?
+                reflection->GetRepeatedEnum(message, field, index) :
+                reflection->GetEnum(message, field);
+        value.SetString(enum_value->name().data(), enum_value->name().size(), allocator);
+        break;
+    }
+    case FieldDescriptor::CPPTYPE_MESSAGE:
+        pb_to_json(repeated ?
+                reflection->GetRepeatedMessage(message, field, index) :
+                reflection->GetMessage(message, field),
+                value, allocator);
+        break;
+    }
+}
+
+void pb_to_json(
+        const Message& message,
+        rapidjson::Value& value,
+        rapidjson::Document::AllocatorType& allocator) {
+    value.SetObject();
+    const Reflection* reflection = message.GetReflection();
+    std::vector<const FieldDescriptor*> fields;
+    reflection->ListFields(message, &fields);
+    for (const FieldDescriptor* field : fields) {
+        rapidjson::Value field_value;
+        if (field->is_map()) {
+            field_value.SetObject();
+            const FieldDescriptor* key_field = field->message_type()->map_key();
+            const FieldDescriptor* value_field = field->message_type()->map_value();
+            const int size = reflection->FieldSize(message, field);
+            for (int i = 0; i < size; ++i) {
+                const Message& entry = reflection->GetRepeatedMessage(message, field, i);
+                rapidjson::Value key;
+                get_field(entry, key_field, -1, key, allocator);
+                if (!key.IsString()) {
+                    const std::string key_str = json_encode(key);
+                    key.SetString(key_str.data(), key_str.size(), allocator);
+                }
+                rapidjson::Value entry_value;
+                get_field(entry, value_field, -1, entry_value, allocator);
+                field_value.AddMember(key, entry_value, allocator);
+            }
+        } else if (field->is_repeated()) {
+            const int size = reflection->FieldSize(message, field);
+            field_value.SetArray();
+            field_value.Reserve(size, allocator);
+            for (int i = 0; i < size; ++i) {
+                rapidjson::Value element;
+                get_field(message, field, i, element, allocator);
+                field_value.PushBack(element, allocator);
+            }
+        } else {
+            get_field(message, field, -1, field_value, allocator);
+        }
+        rapidjson::Value name(field->name().data(), field->name().size(), allocator);
+        value.AddMember(name, field_value, allocator);
+    }
+}
+
+}  // namespace uskit
@@ -0,0 +1,51 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_PROTOBUF_JSON_H
+#define USKIT_PROTOBUF_JSON_H
+
+#include <string>
+#include <google/protobuf/message.h>
+#include <rapidjson/document.h>
+
+namespace uskit {
+
+// Conversion between JSON value and protobuf message by reflection, without
+// intermediate JSON text. Mapping of field types:
+//   int32/uint32/int64/uint64  number, 64-bit integer also accepts string
+//   float/double               number
+//   bool                       bool
+//   string/bytes               string, bytes is not base64 encoded
+//   enum                       name of enum value, number is also accepted
+//   message                    object
+//   map                        object, key is formatted as string
+//   repeated                   array
+// Members of JSON object not defined in message are ignored.
+
+// Fill message with JSON object.
+// Returns 0 on success, -1 otherwise and reason is set to `error'.
+int json_to_pb(
+        const rapidjson::Value& value,
+        google::protobuf::Message* message,
+        std::string* error);
+
+// Convert message into JSON object, strings are copied into allocator.
+void pb_to_json(
+        const google::protobuf::Message& message,
+        rapidjson::Value& value,
+        rapidjson::Document::AllocatorType& allocator);
+
+}  // namespace uskit
+
+#endif  // USKIT_PROTOBUF_JSON_H
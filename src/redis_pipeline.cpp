@@ -0,0 +1,73 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "redis_pipeline.h"
+#include "backend_controller.h"
+#include "utils.h"
+
+namespace uskit {
+
+RedisPipeline::RedisPipeline(std::shared_ptr<BRPC_NAMESPACE::Channel> channel) :
+        _channel(channel),
+        _done(this),
+        _flushed(false) {}
+
+RedisPipeline::~RedisPipeline() {}
+
+BRPC_NAMESPACE::RedisRequest& RedisPipeline::request() {
+    return _request;
+}
+
+void RedisPipeline::add_member(RedisController* cntl, int first_reply) {
+    cntl->set_reply_range(first_reply, _request.command_size() - first_reply);
+    _members.push_back(cntl);
+}
+
+void RedisPipeline::flush() {
+    if (_members.empty()) {
+        return;
+    }
+    US_DLOG(INFO) << "Flush redis pipeline of " << _members.size() << " services, "
+                  << _request.command_size() << " commands";
+    _flushed = true;
+    _channel->CallMethod(nullptr, &_brpc_cntl, &_request, &_response, &_done);
+}
+
+BRPC_NAMESPACE::CallId RedisPipeline::call_id() {
+    return _brpc_cntl.call_id();
+}
+
+int64_t RedisPipeline::latency_us() const {
+    return _brpc_cntl.latency_us();
+}
+
+const BRPC_NAMESPACE::RedisResponse& RedisPipeline::response() const {
+    return _response;
+}
+
+void RedisPipeline::on_done() {
+    for (auto cntl : _members) {
+        if (_brpc_cntl.Failed()) {
+            cntl->brpc_controller().SetFailed(_brpc_cntl.ErrorCode(), "%s",
+                    _brpc_cntl.ErrorText().c_str());
+        }
+        cntl->call_done()->Run();
+    }
+}
+
+void RedisPipeline::PipelineClosure::Run() {
+    _pipeline->on_done();
+}
+
+}  // namespace uskit
@@ -0,0 +1,78 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_REDIS_PIPELINE_H
+#define USKIT_REDIS_PIPELINE_H
+
+#include <vector>
+#include <memory>
+#include "brpc.h"
+
+namespace uskit {
+
+// Forward declaration
+class RedisController;
+
+// A Redis pipeline merges commands of all services on the same Redis backend
+// within one recall into a single RedisRequest, which is sent by one RPC.
+// Replies are split back to each member controller by command order, closures
+// of members are run once the merged RPC finishes.
+class RedisPipeline {
+public:
+    explicit RedisPipeline(std::shared_ptr<BRPC_NAMESPACE::Channel> channel);
+    ~RedisPipeline();
+
+    // Merged request that members append commands to.
+    BRPC_NAMESPACE::RedisRequest& request();
+    // Register a member whose commands have been appended to request(), replies
+    // starting from `first_reply` up to the current command size belong to it.
+    void add_member(RedisController* cntl, int first_reply);
+    // Issue the merged request if any member has been added.
+    void flush();
+    // Whether the merged request has been issued.
+    bool flushed() const {
+        return _flushed;
+    }
+
+    // Call id of the merged RPC, members are joined and canceled by it.
+    BRPC_NAMESPACE::CallId call_id();
+    int64_t latency_us() const;
+    const BRPC_NAMESPACE::RedisResponse& response() const;
+
+private:
+    // Closure of the merged RPC
+    class PipelineClosure : public google::protobuf::Closure {
+    public:
+        explicit PipelineClosure(RedisPipeline* pipeline) : _pipeline(pipeline) {}
+        void Run() override;
+
+    private:
+        RedisPipeline* _pipeline;
+    };
+
+    // Propagate RPC status to members and run their closures.
+    void on_done();
+
+    std::shared_ptr<BRPC_NAMESPACE::Channel> _channel;
+    BRPC_NAMESPACE::Controller _brpc_cntl;
+    BRPC_NAMESPACE::RedisRequest _request;
+    BRPC_NAMESPACE::RedisResponse _response;
+    PipelineClosure _done;
+    std::vector<RedisController*> _members;
+    bool _flushed;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_REDIS_PIPELINE_H
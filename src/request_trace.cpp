@@ -0,0 +1,174 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "request_trace.h"
+#include "brpc.h"
+#include "bthread.h"
+#include "thread_data.h"
+#include "utils.h"
+
+namespace uskit {
+
+RequestTrace::RequestTrace() : _start_us(BUTIL_NAMESPACE::gettimeofday_us()) {}
+
+void RequestTrace::set_logid(const std::string& logid) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _logid = logid;
+}
+
+void RequestTrace::add_span(TraceSpan&& span) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _spans.push_back(std::move(span));
+}
+
+static void add_string_member(
+        rapidjson::Value& object,
+        const char* name,
+        const std::string& value,
+        rapidjson::Document::AllocatorType& allocator) {
+    object.AddMember(
+            rapidjson::StringRef(name),
+            rapidjson::Value(value.c_str(), value.size(), allocator),
+            allocator);
+}
+
+void RequestTrace::dump(
+        int pid,
+        rapidjson::Value& events,
+        rapidjson::Document::AllocatorType& allocator) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Name the process after logid of the request.
+    rapidjson::Value meta(rapidjson::kObjectType);
+    meta.AddMember("name", "process_name", allocator);
+    meta.AddMember("ph", "M", allocator);
+    meta.AddMember("pid", pid, allocator);
+    rapidjson::Value meta_args(rapidjson::kObjectType);
+    add_string_member(meta_args, "name", "logid=" + _logid, allocator);
+    if (!_rpcz_trace_id.empty()) {
+        add_string_member(meta_args, "rpcz_trace_id", _rpcz_trace_id, allocator);
+    }
+    meta.AddMember("args", meta_args, allocator);
+    events.PushBack(meta, allocator);
+
+    for (const auto& span : _spans) {
+        rapidjson::Value event(rapidjson::kObjectType);
+        add_string_member(event, "name", span.name, allocator);
+        add_string_member(event, "cat", span.category, allocator);
+        event.AddMember("ph", "X", allocator);
+        event.AddMember("ts", span.start_us, allocator);
+        event.AddMember("dur", span.end_us - span.start_us, allocator);
+        event.AddMember("pid", pid, allocator);
+        event.AddMember("tid", span.tid, allocator);
+        if (!span.args.empty()) {
+            rapidjson::Value args(rapidjson::kObjectType);
+            for (const auto& arg : span.args) {
+                args.AddMember(
+                        rapidjson::Value(arg.first.c_str(), arg.first.size(), allocator),
+                        rapidjson::Value(arg.second.c_str(), arg.second.size(), allocator),
+                        allocator);
+            }
+            event.AddMember("args", args, allocator);
+        }
+        events.PushBack(event, allocator);
+    }
+}
+
+const RequestTracePtr& current_trace() {
+    static const RequestTracePtr untraced;
+    UnifiedSchedulerThreadData* td =
+            static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
+    if (td == nullptr) {
+        return untraced;
+    }
+    return td->trace();
+}
+
+ScopedSpan::ScopedSpan(RequestTrace* trace, const char* category, const std::string& object)
+        : _trace(trace) {
+    if (_trace == nullptr) {
+        return;
+    }
+    _span.category = category;
+    _span.name = object.empty() ? _span.category : _span.category + "(" + object + ")";
+    _span.tid = bthread_self();
+    _span.start_us = BUTIL_NAMESPACE::gettimeofday_us();
+}
+
+ScopedSpan::~ScopedSpan() {
+    if (_trace == nullptr) {
+        return;
+    }
+    _span.end_us = BUTIL_NAMESPACE::gettimeofday_us();
+    _trace->add_span(std::move(_span));
+}
+
+void ScopedSpan::add_arg(const std::string& key, const std::string& value) {
+    if (_trace != nullptr) {
+        _span.args.emplace_back(key, value);
+    }
+}
+
+TraceCollector::TraceCollector() : _sample_rate(0), _capacity(0) {}
+
+int TraceCollector::init(double sample_rate, int capacity) {
+    if (sample_rate < 0 || sample_rate > 1) {
+        LOG(ERROR) << "Trace sample rate should be in [0, 1], got " << sample_rate;
+        return -1;
+    }
+    if (capacity < 0) {
+        LOG(ERROR) << "Trace buffer size should not be negative, got " << capacity;
+        return -1;
+    }
+    _sample_rate = sample_rate;
+    _capacity = capacity;
+    _sampled.expose("us_trace_sampled");
+    return 0;
+}
+
+bool TraceCollector::sample(bool forced) const {
+    if (_capacity == 0) {
+        return false;
+    }
+    return forced || (_sample_rate > 0 && BUTIL_NAMESPACE::fast_rand_double() < _sample_rate);
+}
+
+void TraceCollector::add(RequestTracePtr trace) {
+    _sampled << 1;
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_traces.size() >= _capacity) {
+        _traces.pop_front();
+    }
+    _traces.push_back(std::move(trace));
+}
+
+void TraceCollector::dump(const std::string& logid, BUTIL_NAMESPACE::IOBuf& out) const {
+    std::vector<RequestTracePtr> traces;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const auto& trace : _traces) {
+            if (logid.empty() || trace->logid() == logid) {
+                traces.push_back(trace);
+            }
+        }
+    }
+    rapidjson::Document doc(rapidjson::kObjectType);
+    rapidjson::Value events(rapidjson::kArrayType);
+    for (size_t i = 0; i < traces.size(); ++i) {
+        traces[i]->dump(static_cast<int>(i + 1), events, doc.GetAllocator());
+    }
+    doc.AddMember("traceEvents", events, doc.GetAllocator());
+    doc.AddMember("displayTimeUnit", "ms", doc.GetAllocator());
+    json_encode(doc, out);
+}
+
+}  // namespace uskit
@@ -0,0 +1,111 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef USKIT_REQUEST_TRACE_H
+#define USKIT_REQUEST_TRACE_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <rapidjson/document.h>
+#include "butil.h"
+#include "bvar.h"
+
+namespace uskit {
+
+// A timed step of a request, e.g. a flow node or a backend call.
+struct TraceSpan {
+    std::string name;
+    std::string category;
+    int64_t start_us;
+    int64_t end_us;
+    // Bthread which runs the step, spans of a bthread are shown in one row.
+    uint64_t tid;
+    std::vector<std::pair<std::string, std::string>> args;
+};
+
+// Spans of a sampled request, recorded by all bthreads and closures serving it.
+class RequestTrace {
+public:
+    RequestTrace();
+    void set_logid(const std::string& logid);
+    const std::string& logid() const {
+        return _logid;
+    }
+    // Trace id of the request in rpcz, empty if not traced by rpcz.
+    void set_rpcz_trace_id(const std::string& trace_id) {
+        _rpcz_trace_id = trace_id;
+    }
+    int64_t start_us() const {
+        return _start_us;
+    }
+    void add_span(TraceSpan&& span);
+    // Append spans as Chrome trace events of process `pid' into `events'.
+    void dump(int pid, rapidjson::Value& events,
+              rapidjson::Document::AllocatorType& allocator) const;
+
+private:
+    mutable std::mutex _mutex;
+    std::string _logid;
+    std::string _rpcz_trace_id;
+    int64_t _start_us;
+    std::vector<TraceSpan> _spans;
+};
+
+typedef std::shared_ptr<RequestTrace> RequestTracePtr;
+
+// Trace of the request served by current bthread, nullptr if not sampled.
+const RequestTracePtr& current_trace();
+
+// Record a span from construction to destruction, does nothing if `trace'
+// is null so that untraced requests pay for a pointer check only. Name of
+// the span is `category(object)', or `category' if object is empty.
+class ScopedSpan {
+public:
+    ScopedSpan(RequestTrace* trace, const char* category, const std::string& object);
+    ~ScopedSpan();
+    void add_arg(const std::string& key, const std::string& value);
+
+private:
+    RequestTrace* _trace;
+    TraceSpan _span;
+};
+
+// Sampling of requests and buffer of recently finished traces for export.
+class TraceCollector {
+public:
+    TraceCollector();
+    // Returns 0 on success, -1 otherwise.
+    int init(double sample_rate, int capacity);
+    // Whether to trace a request, always true if `forced'.
+    bool sample(bool forced) const;
+    // Keep finished trace, the oldest one is dropped if buffer is full.
+    void add(RequestTracePtr trace);
+    // Serialize traces of `logid', or all buffered ones if empty, in Chrome
+    // trace-event format, which is loaded by chrome://tracing or Perfetto.
+    void dump(const std::string& logid, BUTIL_NAMESPACE::IOBuf& out) const;
+
+private:
+    double _sample_rate;
+    size_t _capacity;
+    mutable std::mutex _mutex;
+    std::deque<RequestTracePtr> _traces;
+    BVAR_NAMESPACE::Adder<int64_t> _sampled;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_REQUEST_TRACE_H
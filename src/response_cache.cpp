@@ -0,0 +1,213 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "response_cache.h"
+#include "expression/driver.h"
+#include "utils.h"
+
+namespace uskit {
+
+FrequencySketch::FrequencySketch() : _mask(0), _additions(0), _sample_size(0) {}
+
+void FrequencySketch::init(size_t width) {
+    size_t size = 64;
+    while (size < width) {
+        size <<= 1;
+    }
+    _counters.assign(size * 4, 0);
+    _mask = size - 1;
+    _additions = 0;
+    _sample_size = size * 10;
+}
+
+size_t FrequencySketch::index(size_t hash, int row) const {
+    static const uint64_t SEEDS[] = {
+            0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL,
+            0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+    uint64_t h = (static_cast<uint64_t>(hash) + SEEDS[row]) * SEEDS[(row + 1) % 4];
+    h ^= h >> 32;
+    return row * (_mask + 1) + (h & _mask);
+}
+
+void FrequencySketch::increment(size_t hash) {
+    for (int row = 0; row < 4; ++row) {
+        uint8_t& counter = _counters[index(hash, row)];
+        if (counter < 15) {
+            ++counter;
+        }
+    }
+    if (++_additions >= _sample_size) {
+        // Age all counters so that keys popular long ago could be evicted.
+        for (auto& counter : _counters) {
+            counter >>= 1;
+        }
+        _additions /= 2;
+    }
+}
+
+int FrequencySketch::estimate(size_t hash) const {
+    int frequency = 15;
+    for (int row = 0; row < 4; ++row) {
+        frequency = std::min(frequency, static_cast<int>(_counters[index(hash, row)]));
+    }
+    return frequency;
+}
+
+ResponseCache::ResponseCache()
+    : _ttl_us(0), _stale_us(0), _shard_capacity(0), _admission(true) {}
+
+ResponseCache::~ResponseCache() {}
+
+int ResponseCache::init(const ResponseCacheConfig& config) {
+    if (config.key_size() == 0) {
+        LOG(ERROR) << "Response cache of usid [" << config.usid() << "] requires key";
+        return -1;
+    }
+    if (config.ttl_ms() <= 0 || config.stale_ms() < 0 ||
+        config.max_memory_bytes() < static_cast<int64_t>(SHARD_NUM)) {
+        LOG(ERROR) << "Invalid ttl_ms, stale_ms or max_memory_bytes of response cache of usid ["
+                   << config.usid() << "]";
+        return -1;
+    }
+    for (const auto& key : config.key()) {
+        expression::Driver driver;
+        if (driver.parse("", key) != 0) {
+            LOG(ERROR) << "Failed to parse response cache key expression: " << key;
+            return -1;
+        }
+        _key_exprs.emplace_back(driver.get_expression());
+    }
+    _ttl_us = config.ttl_ms() * 1000L;
+    _stale_us = config.stale_ms() * 1000L;
+    _shard_capacity = config.max_memory_bytes() / SHARD_NUM;
+    _admission = config.admission();
+    _shards.reset(new Shard[SHARD_NUM]);
+    // Size sketch for responses of about 1KB.
+    const size_t width = std::min<size_t>(std::max<size_t>(_shard_capacity / 1024, 64), 65536);
+    for (size_t i = 0; i < SHARD_NUM; ++i) {
+        _shards[i].sketch.init(width);
+        _shards[i].memory = 0;
+    }
+
+    const std::string prefix = "us_response_cache_" + config.usid();
+    _hit.expose(prefix + "_hit");
+    _stale.expose(prefix + "_stale");
+    _miss.expose(prefix + "_miss");
+    _rejected.expose(prefix + "_rejected");
+    _evicted.expose(prefix + "_evicted");
+    _memory.expose(prefix + "_memory");
+    return 0;
+}
+
+int ResponseCache::make_key(const USRequest& request, std::string& key) const {
+    rapidjson::Document doc;
+    expression::ExpressionContext context("response cache key", doc.GetAllocator());
+    rapidjson::Value request_copy(request, doc.GetAllocator());
+    context.set_variable("request", request_copy);
+    key.clear();
+    for (const auto& expr : _key_exprs) {
+        rapidjson::Value value;
+        if (expr->run(context, value) != 0 || value.IsNull()) {
+            return -1;
+        }
+        key.append(json_encode(value));
+        key.push_back('\n');
+    }
+    return 0;
+}
+
+ResponseCacheStatus ResponseCache::get(const std::string& key, BUTIL_NAMESPACE::IOBuf& body) {
+    const size_t hash = std::hash<std::string>()(key);
+    Shard& curr_shard = shard(hash);
+    const int64_t now_us = BUTIL_NAMESPACE::monotonic_time_us();
+    std::lock_guard<std::mutex> lock(curr_shard.mutex);
+    curr_shard.sketch.increment(hash);
+    auto iter = curr_shard.index.find(key);
+    if (iter == curr_shard.index.end()) {
+        _miss << 1;
+        return RESPONSE_CACHE_MISS;
+    }
+    Entry& entry = *iter->second;
+    if (now_us >= entry.stale_until_us) {
+        erase(curr_shard, iter->second);
+        _miss << 1;
+        return RESPONSE_CACHE_MISS;
+    }
+    curr_shard.lru.splice(curr_shard.lru.begin(), curr_shard.lru, iter->second);
+    body = entry.body;
+    if (now_us < entry.fresh_until_us) {
+        _hit << 1;
+        return RESPONSE_CACHE_HIT;
+    }
+    _stale << 1;
+    if (entry.refreshing) {
+        return RESPONSE_CACHE_HIT;
+    }
+    entry.refreshing = true;
+    return RESPONSE_CACHE_STALE;
+}
+
+void ResponseCache::put(const std::string& key, const BUTIL_NAMESPACE::IOBuf& body) {
+    const size_t hash = std::hash<std::string>()(key);
+    const size_t size = entry_size(key, body);
+    Shard& curr_shard = shard(hash);
+    const int64_t now_us = BUTIL_NAMESPACE::monotonic_time_us();
+    std::lock_guard<std::mutex> lock(curr_shard.mutex);
+    auto iter = curr_shard.index.find(key);
+    if (iter != curr_shard.index.end()) {
+        erase(curr_shard, iter->second);
+    }
+    if (size > _shard_capacity) {
+        _rejected << 1;
+        return;
+    }
+    const int candidate = curr_shard.sketch.estimate(hash);
+    while (curr_shard.memory + size > _shard_capacity) {
+        auto victim = std::prev(curr_shard.lru.end());
+        if (_admission && now_us < victim->stale_until_us &&
+            candidate <= curr_shard.sketch.estimate(victim->hash)) {
+            _rejected << 1;
+            return;
+        }
+        erase(curr_shard, victim);
+        _evicted << 1;
+    }
+    const int64_t fresh_until_us = now_us + _ttl_us;
+    curr_shard.lru.push_front(
+            Entry{key, hash, body, fresh_until_us, fresh_until_us + _stale_us, false});
+    curr_shard.index.emplace(key, curr_shard.lru.begin());
+    curr_shard.memory += size;
+    _memory << size;
+}
+
+void ResponseCache::refresh_failed(const std::string& key) {
+    const size_t hash = std::hash<std::string>()(key);
+    Shard& curr_shard = shard(hash);
+    std::lock_guard<std::mutex> lock(curr_shard.mutex);
+    auto iter = curr_shard.index.find(key);
+    if (iter != curr_shard.index.end()) {
+        iter->second->refreshing = false;
+    }
+}
+
+void ResponseCache::erase(Shard& curr_shard, std::list<Entry>::iterator iter) {
+    const size_t size = entry_size(iter->key, iter->body);
+    curr_shard.memory -= size;
+    _memory << -static_cast<int64_t>(size);
+    curr_shard.index.erase(iter->key);
+    curr_shard.lru.erase(iter);
+}
+
+}  // namespace uskit
@@ -0,0 +1,125 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_RESPONSE_CACHE_H
+#define USKIT_RESPONSE_CACHE_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "butil.h"
+#include "bvar.h"
+#include "common.h"
+#include "config.pb.h"
+#include "expression/expression.h"
+
+namespace uskit {
+
+enum ResponseCacheStatus {
+    RESPONSE_CACHE_MISS = 0,
+    RESPONSE_CACHE_HIT = 1,
+    // Expired response is returned, the caller is responsible to refresh it
+    RESPONSE_CACHE_STALE = 2,
+};
+
+// Approximate access frequency of keys, a count-min sketch with 4-bit
+// counters which are halved periodically so that old popularity fades.
+class FrequencySketch {
+public:
+    FrequencySketch();
+    void init(size_t width);
+    void increment(size_t hash);
+    int estimate(size_t hash) const;
+
+private:
+    size_t index(size_t hash, int row) const;
+
+    std::vector<uint8_t> _counters;
+    size_t _mask;
+    size_t _additions;
+    size_t _sample_size;
+};
+
+// Cache of serialized final responses of one unified scheduler, entries are
+// evicted in LRU order under memory limit. With admission enabled, a new
+// response replaces the LRU entry only if its key is estimated to be
+// requested more frequently, so one-off queries do not flush popular ones.
+class ResponseCache {
+public:
+    ResponseCache();
+    ~ResponseCache();
+    // Initialize from configuration.
+    // Returns 0 on success, -1 otherwise.
+    int init(const ResponseCacheConfig& config);
+    // Generate cache key from user request.
+    // Returns 0 on success, -1 if any key expression fails or is null, in
+    // which case the request bypasses cache.
+    int make_key(const USRequest& request, std::string& key) const;
+    // Look up response of `key', the serialized response is shared into
+    // `body' on hit. Only one caller gets RESPONSE_CACHE_STALE for an
+    // expired entry, others get the stale response as hit until refreshed.
+    ResponseCacheStatus get(const std::string& key, BUTIL_NAMESPACE::IOBuf& body);
+    // Store serialized response of `key', which may be rejected by admission.
+    void put(const std::string& key, const BUTIL_NAMESPACE::IOBuf& body);
+    // Give up refreshing of `key' so that another request could retry.
+    void refresh_failed(const std::string& key);
+
+private:
+    struct Entry {
+        std::string key;
+        size_t hash;
+        BUTIL_NAMESPACE::IOBuf body;
+        int64_t fresh_until_us;
+        int64_t stale_until_us;
+        bool refreshing;
+    };
+    struct Shard {
+        std::mutex mutex;
+        // Most recently used entry in front
+        std::list<Entry> lru;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        FrequencySketch sketch;
+        size_t memory;
+    };
+    static const size_t SHARD_NUM = 16;
+
+    Shard& shard(size_t hash) {
+        return _shards[hash % SHARD_NUM];
+    }
+    static size_t entry_size(const std::string& key, const BUTIL_NAMESPACE::IOBuf& body) {
+        return key.size() * 2 + body.size() + sizeof(Entry);
+    }
+    // Remove entry from shard. Must be called with lock held.
+    void erase(Shard& curr_shard, std::list<Entry>::iterator iter);
+
+    std::vector<std::unique_ptr<expression::Expression>> _key_exprs;
+    int64_t _ttl_us;
+    int64_t _stale_us;
+    size_t _shard_capacity;
+    bool _admission;
+    std::unique_ptr<Shard[]> _shards;
+    BVAR_NAMESPACE::Adder<int64_t> _hit;
+    BVAR_NAMESPACE::Adder<int64_t> _stale;
+    BVAR_NAMESPACE::Adder<int64_t> _miss;
+    BVAR_NAMESPACE::Adder<int64_t> _rejected;
+    BVAR_NAMESPACE::Adder<int64_t> _evicted;
+    BVAR_NAMESPACE::Adder<int64_t> _memory;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_RESPONSE_CACHE_H
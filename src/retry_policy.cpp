@@ -0,0 +1,154 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <algorithm>
+#include "retry_policy.h"
+#include "bthread.h"
+#include "butil.h"
+
+namespace uskit {
+
+// Errors which guarantee the request was not processed by server, calls of
+// non-idempotent services are retried only on these errors.
+static const int kNotProcessedErrors[] = {
+        ECONNREFUSED,
+        BRPC_NAMESPACE::ELOGOFF,
+        BRPC_NAMESPACE::ELIMIT,
+        BRPC_NAMESPACE::EREJECT,
+};
+
+// Connection errors retried by default.
+static const int kConnectionErrors[] = {
+        ECONNREFUSED,
+        ECONNRESET,
+        ETIMEDOUT,
+        BRPC_NAMESPACE::EFAILEDSOCKET,
+        BRPC_NAMESPACE::EEOF,
+        BRPC_NAMESPACE::ELOGOFF,
+        BRPC_NAMESPACE::ELIMIT,
+        BRPC_NAMESPACE::EREJECT,
+};
+
+static const int64_t kTokenUnit = 100;
+
+RetryBudget::RetryBudget() : _deposit(0), _capacity(0), _tokens(0) {}
+
+int RetryBudget::init(const std::string& name, const RetryBudgetConfig& config) {
+    if (config.ratio_percent() < 0 || config.ratio_percent() > 100 || config.max_tokens() <= 0) {
+        LOG(ERROR) << "Invalid retry budget config of backend [" << name << "]";
+        return -1;
+    }
+    _deposit = config.ratio_percent();
+    _capacity = config.max_tokens() * kTokenUnit;
+    _tokens.store(_capacity, std::memory_order_relaxed);
+    return 0;
+}
+
+void RetryBudget::on_request(int count) {
+    int64_t tokens = _tokens.load(std::memory_order_relaxed);
+    while (tokens < _capacity) {
+        int64_t next = std::min(_capacity, tokens + _deposit * count);
+        if (_tokens.compare_exchange_weak(tokens, next, std::memory_order_relaxed)) {
+            return;
+        }
+    }
+}
+
+bool RetryBudget::try_retry() {
+    int64_t tokens = _tokens.load(std::memory_order_relaxed);
+    while (tokens >= kTokenUnit) {
+        if (_tokens.compare_exchange_weak(tokens, tokens - kTokenUnit, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ServiceRetryPolicy::ServiceRetryPolicy() :
+        _max_retry(0),
+        _idempotent(false),
+        _backoff_us(0),
+        _max_backoff_us(0),
+        _budget(nullptr) {}
+
+int ServiceRetryPolicy::init(
+        const std::string& usid,
+        const std::string& name,
+        const RetryConfig& config,
+        RetryBudget* budget) {
+    if (config.max_retry() < 0 || config.backoff_ms() < 0 || config.max_backoff_ms() < 0) {
+        LOG(ERROR) << "Invalid retry config of service [" << name << "]";
+        return -1;
+    }
+    _max_retry = config.max_retry();
+    _idempotent = config.idempotent();
+    if (config.retry_on_error_size() > 0) {
+        _retry_errors.insert(config.retry_on_error().begin(), config.retry_on_error().end());
+    } else {
+        _retry_errors.insert(std::begin(kConnectionErrors), std::end(kConnectionErrors));
+    }
+    if (!_idempotent) {
+        // Keep errors on which the request is not processed only.
+        std::unordered_set<int> retry_errors;
+        for (int error : kNotProcessedErrors) {
+            if (_retry_errors.count(error) > 0) {
+                retry_errors.insert(error);
+            }
+        }
+        _retry_errors.swap(retry_errors);
+        if (config.retry_on_http_status_size() > 0) {
+            LOG(WARNING) << "retry_on_http_status of non-idempotent service [" << name
+                         << "] is ignored";
+        }
+    } else {
+        _retry_http_status.insert(
+                config.retry_on_http_status().begin(), config.retry_on_http_status().end());
+    }
+    _backoff_us = config.backoff_ms() * 1000L;
+    _max_backoff_us = std::max(config.max_backoff_ms() * 1000L, _backoff_us);
+    _budget = budget;
+    if (!usid.empty()) {
+        _issued.expose("us_retry_" + usid + "_" + name + "_issued");
+        _denied.expose("us_retry_" + usid + "_" + name + "_denied");
+    }
+    return 0;
+}
+
+bool ServiceRetryPolicy::retryable(const BRPC_NAMESPACE::Controller* cntl) const {
+    const int error_code = cntl->ErrorCode();
+    if (error_code == BRPC_NAMESPACE::EHTTP) {
+        return _retry_http_status.count(cntl->http_response().status_code()) > 0;
+    }
+    return _retry_errors.count(error_code) > 0;
+}
+
+bool ServiceRetryPolicy::DoRetry(const BRPC_NAMESPACE::Controller* cntl) const {
+    if (!retryable(cntl)) {
+        return false;
+    }
+    if (_budget != nullptr && !_budget->try_retry()) {
+        _denied << 1;
+        return false;
+    }
+    _issued << 1;
+    if (_backoff_us > 0) {
+        // Exponential backoff, the retry is issued when this call returns.
+        int64_t backoff_us = _backoff_us << std::min(cntl->retried_count(), 20);
+        bthread_usleep(std::min(backoff_us, _max_backoff_us));
+    }
+    return true;
+}
+
+}  // namespace uskit
@@ -0,0 +1,85 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef USKIT_RETRY_POLICY_H
+#define USKIT_RETRY_POLICY_H
+
+#include <atomic>
+#include <string>
+#include <unordered_set>
+#include "brpc.h"
+#include "bvar.h"
+#include "config.pb.h"
+
+namespace uskit {
+
+// Token bucket which limits retries of a backend to a ratio of its requests.
+// Every request deposits `ratio_percent' hundredths of a token and every retry
+// takes one token, at most `max_tokens' tokens are kept, so retries cannot
+// multiply load on a backend that is failing.
+class RetryBudget {
+public:
+    RetryBudget();
+    // Initialize from configuration.
+    // Returns 0 on success, -1 otherwise.
+    int init(const std::string& name, const RetryBudgetConfig& config);
+    // Called for every request sent to backend.
+    void on_request(int count);
+    // Take a token for a retry.
+    // Returns true if the retry is allowed, false otherwise.
+    bool try_retry();
+
+private:
+    // Tokens are counted in hundredths.
+    int64_t _deposit;
+    int64_t _capacity;
+    std::atomic<int64_t> _tokens;
+};
+
+// Retry policy of a service, decides whether a failed call is retried by its
+// error, idempotency of the service and retry budget of the backend.
+// Retries are counted in bvar `us_retry_<usid>_<name>_issued' and
+// `us_retry_<usid>_<name>_denied'(denied by budget).
+class ServiceRetryPolicy : public BRPC_NAMESPACE::RetryPolicy {
+public:
+    ServiceRetryPolicy();
+    // Initialize from configuration, `budget' can be nullptr. Counters are
+    // not exposed if `usid' is empty.
+    // Returns 0 on success, -1 otherwise.
+    int init(const std::string& usid, const std::string& name, const RetryConfig& config,
+            RetryBudget* budget);
+    int max_retry() const {
+        return _max_retry;
+    }
+    // Called by brpc when a call failed and retry count is not exhausted.
+    // Backoff is slept within this call before the retry is issued.
+    bool DoRetry(const BRPC_NAMESPACE::Controller* cntl) const override;
+
+private:
+    bool retryable(const BRPC_NAMESPACE::Controller* cntl) const;
+
+    int _max_retry;
+    bool _idempotent;
+    std::unordered_set<int> _retry_errors;
+    std::unordered_set<int> _retry_http_status;
+    int64_t _backoff_us;
+    int64_t _max_backoff_us;
+    RetryBudget* _budget;
+    mutable BVAR_NAMESPACE::Adder<int64_t> _issued;
+    mutable BVAR_NAMESPACE::Adder<int64_t> _denied;
+};
+
+}  // namespace uskit
+
+#endif  // USKIT_RETRY_POLICY_H
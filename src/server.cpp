@@ -18,6 +18,7 @@
 #include "config.pb.h"
 #include "thread_data.h"
 #include "unified_scheduler_manager.h"
+#include "channel_registry.h"
 #include "utils.h"
 #include "common.h"
 
@@ -28,10 +29,17 @@ DEFINE_int32(
         -1,
         "Connection will be closed if there is no "
         "read/write operations during the last `idle_timeout_s'");
+DEFINE_int32(
+        channel_idle_timeout_s,
+        60,
+        "Channel to backend is closed if it is not used by any configuration "
+        "during the last `channel_idle_timeout_s'");
 DEFINE_string(conf_dir, "./conf", "Directory of configuration file");
 DEFINE_string(us_conf, "./conf/us.conf", "Path of unified scheduler configuration file");
 DEFINE_string(unit_log_conf, "unit_log.conf", "Path of unit log configuration file");
 DEFINE_string(url_path, "/us", "URL path of unified scheduler service");
+DEFINE_string(health_path, "/health", "URL path of readiness report");
+DEFINE_string(trace_path, "/trace", "URL path of recent request traces");
 
 namespace uskit {
 
@@ -49,6 +57,7 @@ public:
 
         BRPC_NAMESPACE::Controller* cntl = static_cast<BRPC_NAMESPACE::Controller*>(cntl_base);
 
+        _us_manager.begin_trace(cntl);
         Timer total_tm("total_t_ms");
         total_tm.start();
 
@@ -57,6 +66,7 @@ public:
         }
 
         total_tm.stop();
+        _us_manager.end_trace();
 
         UnifiedSchedulerThreadData* td =
                 static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
@@ -64,6 +74,24 @@ public:
         td->reset();
     }
 
+    virtual void health(
+            google::protobuf::RpcController* cntl_base,
+            const HttpRequest*,
+            HttpResponse*,
+            google::protobuf::Closure* done) {
+        BRPC_NAMESPACE::ClosureGuard done_guard(done);
+        _us_manager.health(static_cast<BRPC_NAMESPACE::Controller*>(cntl_base));
+    }
+
+    virtual void trace(
+            google::protobuf::RpcController* cntl_base,
+            const HttpRequest*,
+            HttpResponse*,
+            google::protobuf::Closure* done) {
+        BRPC_NAMESPACE::ClosureGuard done_guard(done);
+        _us_manager.trace(static_cast<BRPC_NAMESPACE::Controller*>(cntl_base));
+    }
+
     int init(const UnifiedSchedulerConfig& config) {
         if (_us_manager.init(config) != 0) {
             return -1;
@@ -72,6 +100,10 @@ public:
         return 0;
     }
 
+    void prewarm() {
+        _us_manager.prewarm();
+    }
+
 private:
     UnifiedSchedulerManager _us_manager;
 };
@@ -88,6 +120,7 @@ int main(int argc, char* argv[]) {
         LOG(ERROR) << "Failed to parse unified scheduler config";
         return -1;
     }
+    uskit::ChannelRegistry::instance().set_idle_timeout_ms(FLAGS_channel_idle_timeout_s * 1000L);
     // Instance of your service.
     uskit::UnifiedSchedulerServiceImpl us_service;
 
@@ -102,7 +135,8 @@ int main(int argc, char* argv[]) {
     // Add the service into server. Notice the second parameter, because the
     // service is put on stack, we don't want server to delete it, otherwise
     // use BRPC_NAMESPACE::SERVER_OWNS_SERVICE.
-    std::string url_path = FLAGS_url_path + " => run";
+    std::string url_path = FLAGS_url_path + " => run, " + FLAGS_health_path + " => health, " +
+                           FLAGS_trace_path + " => trace";
     if (server.AddService(&us_service, BRPC_NAMESPACE::SERVER_DOESNT_OWN_SERVICE, url_path) != 0) {
         LOG(ERROR) << "Failed to add unified scheduler service";
         return -1;
@@ -120,6 +154,9 @@ int main(int argc, char* argv[]) {
         LOG(ERROR) << "Failed to start server";
         return -1;
     }
+    // Health check and requests are answered with 503 until backend
+    // connections are prewarmed.
+    us_service.prewarm();
 
     // Wait until Ctrl-C is pressed, then Stop() and Join() the server.
     server.RunUntilAskedToQuit();
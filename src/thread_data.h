@@ -20,6 +20,7 @@
 
 #include "brpc.h"
 #include "butil.h"
+#include "request_trace.h"
 
 namespace uskit {
 
@@ -28,6 +29,7 @@ class UnifiedSchedulerThreadData {
 public:
     void reset() {
         _log_entries.clear();
+        _trace.reset();
     }
 
     void set_logid(std::string& logid) {
@@ -50,13 +52,32 @@ public:
         add_log_entry(key, JoinString(value, ','));
     }
 
+    // Append entries collected by another bthread of the same request.
+    void add_log_entries(const std::vector<std::string>& entries) {
+        _log_entries.insert(_log_entries.end(), entries.begin(), entries.end());
+    }
+
+    const std::vector<std::string>& log_entries() const {
+        return _log_entries;
+    }
+
     const std::string get_log() {
         return JoinString(_log_entries, ' ');
     }
 
+    // Trace of the request, shared with bthreads serving the same request.
+    void set_trace(const RequestTracePtr& trace) {
+        _trace = trace;
+    }
+
+    const RequestTracePtr& trace() const {
+        return _trace;
+    }
+
 private:
     std::string _logid;
     std::vector<std::string> _log_entries;
+    RequestTracePtr _trace;
 };
 
 // Thread local data factory.
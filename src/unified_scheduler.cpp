@@ -46,4 +46,8 @@ int UnifiedScheduler::run(USRequest& request, USResponse& response) const {
     return 0;
 }
 
+void UnifiedScheduler::prewarm(ConnectionPrewarmer& prewarmer) const {
+    _flow_engine.prewarm(prewarmer);
+}
+
 } // namespace uskit
@@ -40,6 +40,8 @@ public:
     // Process user request and generate response.
     // Returns 0 on success, -1 otherwise.
     int run(USRequest& request, USResponse& response) const;
+    // Add backends to be prewarmed.
+    void prewarm(ConnectionPrewarmer& prewarmer) const;
 
 private:
     FlowEngine _flow_engine;
@@ -17,12 +17,37 @@
 #include "unified_scheduler_manager.h"
 #include "utils.h"
 #include "global.h"
+#include "intervene_reloader.h"
 #include "thread_data.h"
 #include "rapidjson/pointer.h"
+#include "bthread.h"
 
 namespace uskit {
 
-UnifiedSchedulerManager::UnifiedSchedulerManager() {}
+// Task to refresh an expired cached response in background.
+struct UnifiedSchedulerManager::CacheRefresh {
+    const UnifiedSchedulerManager* manager;
+    const UnifiedScheduler* us;
+    ResponseCache* cache;
+    std::string key;
+    USRequest request;
+    std::string logid;
+    void* assigned_data;
+};
+
+// Only responses without business error are cached.
+static bool is_cacheable_response(const USResponse& response) {
+    auto iter = response.FindMember("error_code");
+    if (iter == response.MemberEnd()) {
+        return true;
+    }
+    if (iter->value.IsInt()) {
+        return iter->value.GetInt() == 0;
+    }
+    return iter->value.IsString() && std::atoi(iter->value.GetString()) == 0;
+}
+
+UnifiedSchedulerManager::UnifiedSchedulerManager() : _ready(false) {}
 
 UnifiedSchedulerManager::~UnifiedSchedulerManager() {}
 
@@ -81,10 +106,95 @@ int UnifiedSchedulerManager::init(const UnifiedSchedulerConfig& config) {
     }
     _editable_response = config.editable_response();
 
+    for (const auto& cache_config : config.response_cache()) {
+        if (_us_map.find(cache_config.usid()) == _us_map.end()) {
+            LOG(ERROR) << "Response cache of usid [" << cache_config.usid()
+                       << "] requires the app to be loaded";
+            return -1;
+        }
+        std::unique_ptr<ResponseCache> cache(new ResponseCache());
+        if (cache->init(cache_config) != 0) {
+            LOG(ERROR) << "Failed to init response cache of usid [" << cache_config.usid() << "]";
+            return -1;
+        }
+        _response_caches[cache_config.usid()] = std::move(cache);
+    }
+
+    if (_trace_collector.init(config.trace_sample_rate(), config.trace_buffer_size()) != 0) {
+        return -1;
+    }
+
+    if (config.intervene_reload_interval_s() > 0 &&
+        InterveneReloader::instance().start(config.intervene_reload_interval_s()) != 0) {
+        return -1;
+    }
+
+    // Probes are issued by prewarm() once server is started.
+    for (const auto& us : _us_map) {
+        us.second.prewarm(_prewarmer);
+    }
+
     return 0;
 }
 
+void UnifiedSchedulerManager::prewarm() {
+    _prewarmer.run();
+    _ready = true;
+}
+
+void UnifiedSchedulerManager::health(BRPC_NAMESPACE::Controller* cntl) const {
+    rapidjson::Document doc(rapidjson::kObjectType);
+    const bool ready = _ready;
+    doc.AddMember("status", rapidjson::StringRef(ready ? "ready" : "starting"), doc.GetAllocator());
+    // Results are being updated until prewarm is finished.
+    if (ready) {
+        rapidjson::Value prewarm;
+        _prewarmer.dump(prewarm, doc.GetAllocator());
+        doc.AddMember("prewarm", prewarm, doc.GetAllocator());
+    }
+    cntl->http_response().set_content_type("application/json;charset=UTF-8");
+    cntl->http_response().set_status_code(ready ? 200 : 503);
+    json_encode(doc, cntl->response_attachment());
+}
+
+void UnifiedSchedulerManager::begin_trace(BRPC_NAMESPACE::Controller* cntl) {
+    UnifiedSchedulerThreadData* td =
+            static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
+    if (!_trace_collector.sample(cntl->http_request().GetHeader("X-US-Trace") != nullptr)) {
+        td->set_trace(nullptr);
+        return;
+    }
+    RequestTracePtr trace = std::make_shared<RequestTrace>();
+    const std::string* rpcz_trace_id = cntl->http_request().GetHeader("x-bd-trace-id");
+    if (rpcz_trace_id != nullptr) {
+        trace->set_rpcz_trace_id(*rpcz_trace_id);
+    }
+    td->set_trace(trace);
+}
+
+void UnifiedSchedulerManager::end_trace() {
+    UnifiedSchedulerThreadData* td =
+            static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
+    if (!td->trace()) {
+        return;
+    }
+    td->trace()->set_logid(td->logid());
+    _trace_collector.add(td->trace());
+    td->set_trace(nullptr);
+}
+
+void UnifiedSchedulerManager::trace(BRPC_NAMESPACE::Controller* cntl) const {
+    const std::string* logid = cntl->http_request().uri().GetQuery("logid");
+    cntl->http_response().set_content_type("application/json;charset=UTF-8");
+    _trace_collector.dump(logid != nullptr ? *logid : "", cntl->response_attachment());
+}
+
 int UnifiedSchedulerManager::run(BRPC_NAMESPACE::Controller* cntl) {
+    // Reject traffic until backend connections are prewarmed.
+    if (!_ready) {
+        send_response(cntl, nullptr, ErrorCode::SERVICE_UNAVAILABLE);
+        return -1;
+    }
     Timer parse_request_tm("parse_request_t_ms");
     parse_request_tm.start();
 
@@ -115,10 +225,22 @@ int UnifiedSchedulerManager::run(BRPC_NAMESPACE::Controller* cntl) {
 
     UnifiedScheduler us;
     if (us_iter != _us_map.end()) {
+        auto cache_iter = _response_caches.find(usid);
+        std::string cache_key;
+        if (cache_iter != _response_caches.end() &&
+            serve_from_cache(cntl, *cache_iter->second, us_iter->second, request, cache_key)) {
+            return 0;
+        }
         if (us_iter->second.run(request, response) != 0) {
             send_response(cntl, nullptr, ErrorCode::INTERNAL_SERVER_ERROR);
             return -1;
         }
+        if (!cache_key.empty() && is_cacheable_response(response)) {
+            send_response(cntl, &response);
+            // Blocks of attachment are shared with cache, not copied.
+            cache_iter->second->put(cache_key, cntl->response_attachment());
+            return 0;
+        }
     } else if (_input_config_path != "") {
         if (_input_config_path == "/") {
             _input_config_path = "";
@@ -283,6 +405,68 @@ int UnifiedSchedulerManager::parse_request(BRPC_NAMESPACE::Controller* cntl, USR
     return 0;
 }
 
+bool UnifiedSchedulerManager::serve_from_cache(
+        BRPC_NAMESPACE::Controller* cntl,
+        ResponseCache& cache,
+        const UnifiedScheduler& us,
+        USRequest& request,
+        std::string& key) {
+    UnifiedSchedulerThreadData* td =
+            static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
+    if (cache.make_key(request, key) != 0) {
+        key.clear();
+        td->add_log_entry("cache", "bypass");
+        return false;
+    }
+    BUTIL_NAMESPACE::IOBuf body;
+    ResponseCacheStatus status = cache.get(key, body);
+    if (status == RESPONSE_CACHE_MISS) {
+        td->add_log_entry("cache", "miss");
+        return false;
+    }
+    if (status == RESPONSE_CACHE_STALE) {
+        td->add_log_entry("cache", "stale");
+        CacheRefresh* refresh = new CacheRefresh{
+                this, &us, &cache, key, USRequest(), td->logid(), bthread_get_assigned_data()};
+        refresh->request.Swap(request);
+        bthread_t tid;
+        if (bthread_start_background(&tid, nullptr, run_cache_refresh, refresh) != 0) {
+            US_LOG(WARNING) << "Failed to start refresh of cached response";
+            cache.refresh_failed(key);
+            delete refresh;
+        }
+    } else {
+        td->add_log_entry("cache", "hit");
+    }
+    cntl->http_response().set_content_type("application/json;charset=UTF-8");
+    cntl->http_response().set_status_code(200);
+    cntl->response_attachment().append(body);
+    return true;
+}
+
+void* UnifiedSchedulerManager::run_cache_refresh(void* arg) {
+    std::unique_ptr<CacheRefresh> refresh(static_cast<CacheRefresh*>(arg));
+    // Thread local data is created from server so that logs are tracked.
+    bthread_assign_data(refresh->assigned_data);
+    UnifiedSchedulerThreadData* td =
+            static_cast<UnifiedSchedulerThreadData*>(BRPC_NAMESPACE::thread_local_data());
+    td->set_logid(refresh->logid);
+    td->add_log_entry("cache", "refresh");
+
+    USResponse response(rapidjson::kObjectType);
+    BUTIL_NAMESPACE::IOBuf body;
+    if (refresh->us->run(refresh->request, response) == 0 && is_cacheable_response(response) &&
+        refresh->manager->encode_response(&response, ErrorCode::OK, "", body) == 0) {
+        refresh->cache->put(refresh->key, body);
+    } else {
+        US_LOG(WARNING) << "Failed to refresh cached response";
+        refresh->cache->refresh_failed(refresh->key);
+    }
+    US_LOG(NOTICE) << td->get_log();
+    td->reset();
+    return nullptr;
+}
+
 int UnifiedSchedulerManager::send_response(
         BRPC_NAMESPACE::Controller* cntl,
         USResponse* response,
@@ -290,11 +474,21 @@ int UnifiedSchedulerManager::send_response(
         const std::string& error_msg) {
     cntl->http_response().set_content_type("application/json;charset=UTF-8");
     int http_status_code = 200;
-    if (error_code != 0) {
+    if (error_code == ErrorCode::SERVICE_UNAVAILABLE) {
+        http_status_code = 503;
+    } else if (error_code != 0) {
         http_status_code = error_code / 1000 * 100;
     }
     // Setup HTTP status.
     cntl->http_response().set_status_code(http_status_code);
+    return encode_response(response, error_code, error_msg, cntl->response_attachment());
+}
+
+int UnifiedSchedulerManager::encode_response(
+        USResponse* response,
+        ErrorCode error_code,
+        const std::string& error_msg,
+        BUTIL_NAMESPACE::IOBuf& body) const {
     if (response != nullptr) {
         for (rapidjson::Value::MemberIterator itr = response->MemberBegin();
              itr != response->MemberEnd();) {
@@ -307,7 +501,7 @@ int UnifiedSchedulerManager::send_response(
     }
     if (_editable_response && error_code == 0 && response != nullptr) {
         std::string response_json = json_encode(*response);
-        cntl->response_attachment().append(response_json);
+        body.append(response_json);
         return 0;
     }
 
@@ -346,7 +540,7 @@ int UnifiedSchedulerManager::send_response(
     }
 
     std::string final_response_json = json_encode(final_response);
-    cntl->response_attachment().append(final_response_json);
+    body.append(final_response_json);
 
     return 0;
 }
@@ -16,11 +16,16 @@
 #define USKIT_REUSABLE_UNIFIED_SCHEDULER_MANAGER_H
 
 #include <string>
+#include <atomic>
+#include <memory>
 #include <unordered_map>
 
 #include "common.h"
 #include "error.h"
 #include "unified_scheduler.h"
+#include "connection_prewarmer.h"
+#include "request_trace.h"
+#include "response_cache.h"
 #include "config.pb.h"
 #include "us.pb.h"
 #include "expression/driver.h"
@@ -39,6 +44,19 @@ public:
     // Process user request.
     // Returns 0 on success, -1 otherwise.
     int run(BRPC_NAMESPACE::Controller* cntl);
+    // Establish backend connections after server is started, and report
+    // ready once finished.
+    void prewarm();
+    // Report readiness and prewarm results, HTTP 503 is returned until
+    // backend connections are prewarmed.
+    void health(BRPC_NAMESPACE::Controller* cntl) const;
+    // Start trace of request served by current bthread if it is sampled.
+    void begin_trace(BRPC_NAMESPACE::Controller* cntl);
+    // Keep trace of finished request for export.
+    void end_trace();
+    // Export recent traces in Chrome trace-event format, filtered by query
+    // parameter `logid' if given.
+    void trace(BRPC_NAMESPACE::Controller* cntl) const;
 
 private:
     // Parse user request from HTTP POST body(JSON format).
@@ -48,6 +66,17 @@ private:
     // Returns 0 on success, -1 otherwise.
     int send_response(BRPC_NAMESPACE::Controller* cntl, USResponse* response,
                       ErrorCode error_code = ErrorCode::OK, const std::string& error_msg = "");
+    // Serialize final response into `body'.
+    // Returns 0 on success, -1 otherwise.
+    int encode_response(USResponse* response, ErrorCode error_code, const std::string& error_msg,
+                        BUTIL_NAMESPACE::IOBuf& body) const;
+    // Serve cached response of request, expired response is refreshed in
+    // background. `key' is set if response of request should be cached.
+    // Returns true if response is served from cache.
+    bool serve_from_cache(BRPC_NAMESPACE::Controller* cntl, ResponseCache& cache,
+                          const UnifiedScheduler& us, USRequest& request, std::string& key);
+    struct CacheRefresh;
+    static void* run_cache_refresh(void* arg);
 
     std::unordered_map<std::string, UnifiedScheduler> _us_map;
     std::vector<std::string> _required_params;
@@ -57,6 +86,10 @@ private:
     bool _editable_response;
     std::string _root_dir;
     std::string _input_config_path;
+    ConnectionPrewarmer _prewarmer;
+    std::unordered_map<std::string, std::unique_ptr<ResponseCache>> _response_caches;
+    TraceCollector _trace_collector;
+    std::atomic<bool> _ready;
 };
 
 } // namespace uskit
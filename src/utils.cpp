@@ -12,10 +12,12 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cctype>
 #include <rapidjson/writer.h>
 #include <rapidjson/pointer.h>
 #include "utils.h"
 #include "thread_data.h"
+#include "bthread.h"
 #include "common.h"
 #include <iconv.h>
 #include <openssl/evp.h>
@@ -29,6 +31,116 @@ std::string json_encode(const rapidjson::Value &json) {
     return buffer.GetString();
 }
 
+// Rapidjson output stream appending to IOBuf.
+class IOBufOutputStream {
+public:
+    typedef char Ch;
+
+    void Put(Ch c) {
+        _appender.push_back(c);
+    }
+    void Flush() {}
+    void move_to(BUTIL_NAMESPACE::IOBuf& buf) {
+        BUTIL_NAMESPACE::IOBuf data;
+        _appender.move_to(data);
+        buf.append(data);
+    }
+
+private:
+    BUTIL_NAMESPACE::IOBufAppender _appender;
+};
+
+void json_encode(const rapidjson::Value& json, BUTIL_NAMESPACE::IOBuf& buf) {
+    IOBufOutputStream stream;
+    rapidjson::Writer<IOBufOutputStream> writer(stream);
+    json.Accept(writer);
+    stream.move_to(buf);
+}
+
+// Rapidjson input stream over IOBuf blocks.
+class IOBufInputStream {
+public:
+    typedef char Ch;
+
+    explicit IOBufInputStream(const BUTIL_NAMESPACE::IOBuf& buf) :
+            _buf(buf),
+            _block_index(0),
+            _cur(nullptr),
+            _end(nullptr),
+            _consumed(0) {
+        next_block();
+    }
+
+    Ch Peek() const {
+        return _cur != _end ? *_cur : '\0';
+    }
+
+    Ch Take() {
+        if (_cur == _end) {
+            return '\0';
+        }
+        Ch c = *_cur++;
+        ++_consumed;
+        if (_cur == _end) {
+            next_block();
+        }
+        return c;
+    }
+
+    size_t Tell() const {
+        return _consumed;
+    }
+
+    // Write functions are not required by parsing.
+    Ch* PutBegin() {
+        return nullptr;
+    }
+    void Put(Ch) {}
+    void Flush() {}
+    size_t PutEnd(Ch*) {
+        return 0;
+    }
+
+private:
+    void next_block() {
+        _cur = _end = nullptr;
+        while (_block_index < _buf.backing_block_num()) {
+            BUTIL_NAMESPACE::StringPiece block = _buf.backing_block(_block_index++);
+            if (!block.empty()) {
+                _cur = block.data();
+                _end = block.data() + block.size();
+                return;
+            }
+        }
+    }
+
+    const BUTIL_NAMESPACE::IOBuf& _buf;
+    size_t _block_index;
+    const Ch* _cur;
+    const Ch* _end;
+    size_t _consumed;
+};
+
+int json_decode(const BUTIL_NAMESPACE::IOBuf& buf, rapidjson::Document& doc) {
+    IOBufInputStream stream(buf);
+    doc.ParseStream(stream);
+    if (doc.HasParseError()) {
+        return -1;
+    }
+    return 0;
+}
+
+void json_set_string(
+        const BUTIL_NAMESPACE::IOBuf& buf,
+        rapidjson::Value& value,
+        rapidjson::Document::AllocatorType& allocator) {
+    const size_t size = buf.size();
+    char* str = static_cast<char*>(allocator.Malloc(size + 1));
+    buf.copy_to(str, size);
+    str[size] = '\0';
+    value.SetString(rapidjson::StringRef(str, size));
+}
+
 int json_set_value_by_path(
         const std::string &path,
         rapidjson::Document &doc,
@@ -108,6 +220,63 @@ int ReadProtoFromTextFile(const std::string &file_name, google::protobuf::Messag
     }
 }
 
+void collect_proto_strings(
+        const google::protobuf::Message& message,
+        std::vector<std::string>& strings) {
+    const google::protobuf::Reflection* reflection = message.GetReflection();
+    std::vector<const google::protobuf::FieldDescriptor*> fields;
+    reflection->ListFields(message, &fields);
+    for (const auto* field : fields) {
+        if (field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_STRING) {
+            if (field->is_repeated()) {
+                for (int i = 0; i < reflection->FieldSize(message, field); ++i) {
+                    strings.push_back(reflection->GetRepeatedString(message, field, i));
+                }
+            } else {
+                strings.push_back(reflection->GetString(message, field));
+            }
+        } else if (field->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+            if (field->is_repeated()) {
+                for (int i = 0; i < reflection->FieldSize(message, field); ++i) {
+                    collect_proto_strings(
+                            reflection->GetRepeatedMessage(message, field, i), strings);
+                }
+            } else {
+                collect_proto_strings(reflection->GetMessage(message, field), strings);
+            }
+        }
+    }
+}
+
+// Whether `str' contains `$backend' or `$result' as a whole word.
+static bool contains_flow_variable(const std::string& str) {
+    static const std::string variables[] = {"backend", "result"};
+    for (size_t pos = str.find('$'); pos != std::string::npos; pos = str.find('$', pos + 1)) {
+        for (const auto& variable : variables) {
+            if (str.compare(pos + 1, variable.size(), variable) != 0) {
+                continue;
+            }
+            size_t end = pos + 1 + variable.size();
+            if (end == str.size() ||
+                !(std::isalnum(static_cast<unsigned char>(str[end])) || str[end] == '_')) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool refers_flow_results(const google::protobuf::Message& message) {
+    std::vector<std::string> strings;
+    collect_proto_strings(message, strings);
+    for (const auto& str : strings) {
+        if (contains_flow_variable(str)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 int replace_all(std::string &str, const std::string &from, const std::string &to) {
     size_t start_pos = 0;
     if (str.size() == 0) {
@@ -133,6 +302,12 @@ void Timer::stop() {
             static_cast<UnifiedSchedulerThreadData *>(BRPC_NAMESPACE::thread_local_data());
     if (td != nullptr) {
         td->add_log_entry(_name, std::to_string(_timer.m_elapsed()));
+        // Timed steps are spans of sampled requests as well.
+        if (td->trace()) {
+            const int64_t end_us = BUTIL_NAMESPACE::gettimeofday_us();
+            td->trace()->add_span(TraceSpan{
+                    _name, "timer", end_us - _timer.u_elapsed(), end_us, bthread_self(), {}});
+        }
     }
 }
 
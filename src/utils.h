@@ -16,6 +16,7 @@
 #define USKIT_UTILS_H
 
 #include <string>
+#include <vector>
 #include <rapidjson/document.h>
 
 #include <fcntl.h>
@@ -30,6 +31,19 @@ namespace uskit {
 // Serialize JSON object to string.
 std::string json_encode(const rapidjson::Value& json);
 
+// Serialize JSON object and append to IOBuf without intermediate string.
+void json_encode(const rapidjson::Value& json, BUTIL_NAMESPACE::IOBuf& buf);
+
+// Parse JSON from IOBuf block by block, without flattening it into a string.
+// Returns 0 on success, -1 otherwise.
+int json_decode(const BUTIL_NAMESPACE::IOBuf& buf, rapidjson::Document& doc);
+
+// Set string value with content of IOBuf, which is copied into allocator once.
+void json_set_string(
+        const BUTIL_NAMESPACE::IOBuf& buf,
+        rapidjson::Value& value,
+        rapidjson::Document::AllocatorType& allocator);
+
 // Set JSON value by Unix-like path, reference: http://rapidjson.org/md_doc_pointer.html
 // Returns 0 on success, -1 otherwise.
 int json_set_value_by_path(
@@ -55,6 +69,16 @@ int merge_json_objects(
 // Returns 0 on success, -1 otherwise.
 int ReadProtoFromTextFile(const std::string& file_name, google::protobuf::Message* proto);
 
+// Collect all string fields of `message' recursively, e.g. expressions of a
+// config.
+void collect_proto_strings(
+        const google::protobuf::Message& message,
+        std::vector<std::string>& strings);
+
+// Whether any string field of `message' refers to `$backend' or `$result',
+// i.e. depends on results of flow nodes before.
+bool refers_flow_results(const google::protobuf::Message& message);
+
 // ReplaceAll
 int replace_all(std::string &str, const std::string& from, const std::string& to);
 
@@ -64,7 +88,8 @@ public:
     Timer(const std::string& name);
     // Start the timer.
     void start();
-    // Stop the timer and add the elapsed time to thread data for logging.
+    // Stop the timer and add the elapsed time to thread data for logging, as
+    // well as a span to trace of sampled request.
     void stop();
 
 private:
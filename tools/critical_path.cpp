@@ -0,0 +1,632 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// Offline critical path analyzer of unified scheduler requests.
+//
+// Input is either traces exported from `--trace_path' (Chrome trace-event
+// JSON) or server logs containing NOTICE lines of UnifiedSchedulerThreadData.
+// Spans of each request are nested by time containment, and a span depends on
+// earlier siblings which finished before it started. Latency of a request is
+// replayed on this graph, so that what-if estimates account for other paths
+// becoming critical.
+//
+// Usage: us_critical_path [--what_if=svc:20,svc2:50%] [--what_if_ms=20] file...
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <gflags/gflags.h>
+#include <rapidjson/document.h>
+
+DEFINE_string(format, "auto", "Format of input files, `trace', `log' or `auto'");
+DEFINE_string(
+        what_if,
+        "",
+        "Comma separated what-if scenarios `service:ms' or `service:percent%', "
+        "calls of service are faster by given time or ratio");
+DEFINE_int32(what_if_ms, 20, "Estimate latency if each service is faster by this, 0 to disable");
+DEFINE_int32(top, 20, "Max number of rows of each table");
+
+namespace uskit {
+
+struct Span {
+    std::string name;
+    std::string category;
+    int64_t start_us;
+    int64_t end_us;
+    uint64_t tid;
+    int parent;
+    std::vector<int> children;
+    // Earlier siblings which finished before this span started
+    std::vector<int> preds;
+};
+
+struct Request {
+    std::string id;
+    std::vector<Span> spans;
+    int root;
+};
+
+// Replayed times of spans of one request.
+struct Replay {
+    std::vector<int64_t> start_us;
+    std::vector<int64_t> end_us;
+};
+
+// Calls of `service' are faster by `delta_us', or by `ratio' of their time.
+struct Scenario {
+    std::string label;
+    std::string service;
+    int64_t delta_us;
+    double ratio;
+};
+
+// Service of a span named e.g. `rpc(a)' or `parse_response_t_ms(a)', empty
+// if the span is not a step of a single backend call.
+static std::string span_service(const std::string& name) {
+    static const char* kServicePrefixes[] = {
+            "rpc(", "closure(", "cancel(", "build_request_t_ms(", "parse_response_t_ms("};
+    for (const char* prefix : kServicePrefixes) {
+        const size_t len = strlen(prefix);
+        if (name.size() > len + 1 && name.compare(0, len, prefix) == 0 && name.back() == ')') {
+            return name.substr(len, name.size() - len - 1);
+        }
+    }
+    return "";
+}
+
+// Whether `outer' may enclose `inner'. Calls are leaves, and steps of the
+// same kind in different bthreads run in parallel rather than nested.
+static bool may_enclose(const Span& outer, const Span& inner) {
+    if (outer.category == "rpc") {
+        return false;
+    }
+    return outer.category != inner.category || outer.tid == inner.tid;
+}
+
+// Nest spans by time containment, the longest span is the root.
+// Returns 0 on success, -1 if request has no span.
+static int build_graph(Request& request) {
+    std::vector<Span>& spans = request.spans;
+    if (spans.empty()) {
+        return -1;
+    }
+    std::stable_sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) {
+        if (a.start_us != b.start_us) {
+            return a.start_us < b.start_us;
+        }
+        return a.end_us > b.end_us;
+    });
+    request.root = 0;
+    for (size_t i = 1; i < spans.size(); ++i) {
+        if (spans[i].end_us - spans[i].start_us >
+            spans[request.root].end_us - spans[request.root].start_us) {
+            request.root = i;
+        }
+    }
+    for (size_t i = 0; i < spans.size(); ++i) {
+        Span& span = spans[i];
+        span.parent = -1;
+        span.children.clear();
+        span.preds.clear();
+        if (static_cast<int>(i) == request.root) {
+            continue;
+        }
+        // Tightest enclosing span, spans with equal range nest in sorted order.
+        int64_t best_duration = -1;
+        for (size_t j = 0; j < spans.size(); ++j) {
+            const Span& outer = spans[j];
+            const int64_t duration = outer.end_us - outer.start_us;
+            if (j == i || outer.start_us > span.start_us || outer.end_us < span.end_us ||
+                !may_enclose(outer, span)) {
+                continue;
+            }
+            if (duration == span.end_us - span.start_us && j > i) {
+                continue;
+            }
+            if (best_duration < 0 || duration < best_duration) {
+                best_duration = duration;
+                span.parent = j;
+            }
+        }
+        // Spans outside the root, e.g. callbacks after response, hang on root.
+        if (span.parent < 0) {
+            span.parent = request.root;
+        }
+        spans[span.parent].children.push_back(i);
+    }
+    for (auto& span : spans) {
+        for (size_t k = 0; k < span.children.size(); ++k) {
+            Span& child = spans[span.children[k]];
+            for (size_t m = 0; m < k; ++m) {
+                if (spans[span.children[m]].end_us <= child.start_us) {
+                    child.preds.push_back(span.children[m]);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// Duration of a leaf span under `scenario'.
+static int64_t replay_duration(const Span& span, const Scenario* scenario) {
+    const int64_t duration = span.end_us - span.start_us;
+    if (scenario == nullptr || span.category != "rpc" || span_service(span.name) != scenario->service) {
+        return duration;
+    }
+    int64_t faster = scenario->delta_us + static_cast<int64_t>(duration * scenario->ratio);
+    return std::max<int64_t>(0, duration - faster);
+}
+
+// Replay span `index' starting at `start_us'. A span starts after its latest
+// predecessor, or its parent, with the same gap as recorded, and ends after
+// its last child with the same tail.
+static void replay_span(
+        const Request& request,
+        int index,
+        int64_t start_us,
+        const Scenario* scenario,
+        Replay& replay) {
+    const Span& span = request.spans[index];
+    replay.start_us[index] = start_us;
+    if (span.children.empty()) {
+        replay.end_us[index] = start_us + replay_duration(span, scenario);
+        return;
+    }
+    int64_t last_end_us = span.start_us;
+    int64_t replay_last_end_us = start_us;
+    for (int child_index : span.children) {
+        const Span& child = request.spans[child_index];
+        int64_t child_start_us = start_us + (child.start_us - span.start_us);
+        if (!child.preds.empty()) {
+            int64_t pred_end_us = 0;
+            int64_t replay_pred_end_us = 0;
+            for (int pred : child.preds) {
+                pred_end_us = std::max(pred_end_us, request.spans[pred].end_us);
+                replay_pred_end_us = std::max(replay_pred_end_us, replay.end_us[pred]);
+            }
+            child_start_us = replay_pred_end_us + (child.start_us - pred_end_us);
+        }
+        replay_span(request, child_index, child_start_us, scenario, replay);
+        last_end_us = std::max(last_end_us, child.end_us);
+        replay_last_end_us = std::max(replay_last_end_us, replay.end_us[child_index]);
+    }
+    replay.end_us[index] = replay_last_end_us + (span.end_us - last_end_us);
+}
+
+static int64_t replay_request(const Request& request, const Scenario* scenario, Replay& replay) {
+    replay.start_us.assign(request.spans.size(), 0);
+    replay.end_us.assign(request.spans.size(), 0);
+    const Span& root = request.spans[request.root];
+    replay_span(request, request.root, root.start_us, scenario, replay);
+    return replay.end_us[request.root] - root.start_us;
+}
+
+// Attribute time on critical path within span `index' to spans, the time a
+// span waits for nothing but itself is its own.
+static void walk_critical_path(
+        const Request& request,
+        const Replay& replay,
+        int index,
+        std::unordered_map<std::string, int64_t>& critical_us) {
+    const Span& span = request.spans[index];
+    int64_t& self_us = critical_us[span.name];
+    if (span.children.empty()) {
+        self_us += replay.end_us[index] - replay.start_us[index];
+        return;
+    }
+    int last = -1;
+    for (int child : span.children) {
+        if (last < 0 || replay.end_us[child] > replay.end_us[last]) {
+            last = child;
+        }
+    }
+    self_us += replay.end_us[index] - replay.end_us[last];
+    int curr = last;
+    while (curr >= 0) {
+        walk_critical_path(request, replay, curr, critical_us);
+        int gate = -1;
+        for (int pred : request.spans[curr].preds) {
+            if (gate < 0 || replay.end_us[pred] > replay.end_us[gate]) {
+                gate = pred;
+            }
+        }
+        const int64_t wait_from_us = gate < 0 ? replay.start_us[index] : replay.end_us[gate];
+        critical_us[span.name] += replay.start_us[curr] - wait_from_us;
+        curr = gate;
+    }
+}
+
+// Returns 0 on success, -1 otherwise.
+static int read_file(const std::string& path, std::string& content) {
+    std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+    if (!in.good()) {
+        return -1;
+    }
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    content = buffer.str();
+    return 0;
+}
+
+// Parse Chrome trace-event JSON, each process is a request.
+// Returns 0 on success, -1 otherwise.
+static int parse_trace(const std::string& path, const std::string& content,
+                       std::vector<Request>& requests) {
+    rapidjson::Document doc;
+    doc.Parse(content.c_str(), content.size());
+    if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("traceEvents") ||
+        !doc["traceEvents"].IsArray()) {
+        fprintf(stderr, "Invalid trace file [%s]\n", path.c_str());
+        return -1;
+    }
+    std::map<int64_t, Request> by_pid;
+    for (const auto& event : doc["traceEvents"].GetArray()) {
+        if (!event.IsObject() || !event.HasMember("ph") || !event.HasMember("pid") ||
+            !event["pid"].IsInt64()) {
+            continue;
+        }
+        Request& request = by_pid[event["pid"].GetInt64()];
+        const std::string ph = event["ph"].GetString();
+        if (ph == "M" && event.HasMember("args") && event["args"].HasMember("name")) {
+            request.id = event["args"]["name"].GetString();
+        } else if (ph == "X" && event.HasMember("ts") && event.HasMember("dur")) {
+            Span span;
+            span.name = event.HasMember("name") ? event["name"].GetString() : "";
+            span.category = event.HasMember("cat") ? event["cat"].GetString() : "";
+            span.start_us = event["ts"].GetInt64();
+            span.end_us = span.start_us + event["dur"].GetInt64();
+            span.tid = event.HasMember("tid") && event["tid"].IsUint64() ? event["tid"].GetUint64()
+                                                                         : 0;
+            request.spans.push_back(span);
+        }
+    }
+    for (auto& item : by_pid) {
+        if (item.second.id.empty()) {
+            item.second.id = path + ":" + std::to_string(item.first);
+        }
+        requests.push_back(std::move(item.second));
+    }
+    return 0;
+}
+
+// Rebuild spans from timers of one NOTICE log line, which only has elapsed
+// milliseconds in stop order. Flow nodes are assumed to run in sequence and
+// calls of a recall are sent together once their requests are built.
+// Returns 0 on success, -1 if the line has no total time.
+static int parse_log_line(const std::string& line, Request& request) {
+    std::istringstream tokens(line);
+    std::string token;
+    Span root{"total_t_ms", "timer", 0, -1, 0, -1, {}, {}};
+    int64_t cursor_us = 0;
+    // Recall being parsed, closed by recall_total_t_ms
+    int64_t recall_start_us = -1;
+    int64_t build_end_us = -1;
+    int64_t calls_end_us = 0;
+    std::vector<Span> spans;
+    while (tokens >> token) {
+        const size_t eq = token.find('=');
+        if (eq == std::string::npos) {
+            continue;
+        }
+        const std::string key = token.substr(0, eq);
+        const std::string value = token.substr(eq + 1);
+        if (key == "logid") {
+            request.id = value;
+            continue;
+        }
+        const size_t paren = key.find('(');
+        const std::string timer = key.substr(0, paren);
+        const std::string object =
+                paren == std::string::npos ? "" : key.substr(paren + 1, key.size() - paren - 2);
+        char* end = nullptr;
+        errno = 0;
+        const int64_t value_us = strtoll(value.c_str(), &end, 10) * 1000;
+        if (timer.size() < 5 || timer.compare(timer.size() - 5, 5, "_t_ms") != 0 ||
+            errno != 0 || end == value.c_str() || *end != '\0') {
+            continue;
+        }
+        if (timer == "total_t_ms") {
+            root.end_us = value_us;
+        } else if (timer == "build_request_t_ms") {
+            if (recall_start_us < 0) {
+                recall_start_us = cursor_us;
+            }
+            spans.push_back(Span{key, "timer", cursor_us, cursor_us + value_us, 0, -1, {}, {}});
+            cursor_us += value_us;
+        } else if (timer == "build_request_total_t_ms") {
+            if (recall_start_us < 0) {
+                recall_start_us = cursor_us;
+            }
+            build_end_us = std::max(cursor_us, recall_start_us + value_us);
+            spans.push_back(Span{key, "timer", recall_start_us, build_end_us, 0, -1, {}, {}});
+            cursor_us = build_end_us;
+            calls_end_us = build_end_us;
+        } else if (timer == "recall_t_ms") {
+            const int64_t send_us = build_end_us < 0 ? cursor_us : build_end_us;
+            spans.push_back(Span{
+                    "rpc(" + object + ")", "rpc", send_us, send_us + value_us, 0, -1, {}, {}});
+            calls_end_us = std::max(calls_end_us, send_us + value_us);
+        } else if (timer == "recall_total_t_ms") {
+            const int64_t start_us = recall_start_us < 0 ? cursor_us : recall_start_us;
+            const int64_t recall_end_us = std::max(calls_end_us, start_us + value_us);
+            spans.push_back(Span{key, "timer", start_us, recall_end_us, 0, -1, {}, {}});
+            cursor_us = std::max(cursor_us, recall_end_us);
+            recall_start_us = -1;
+            build_end_us = -1;
+            calls_end_us = 0;
+        } else if (timer == "parse_response_total_t_ms") {
+            // Covered by parse_response_t_ms of each service.
+            continue;
+        } else {
+            spans.push_back(Span{key, "timer", cursor_us, cursor_us + value_us, 0, -1, {}, {}});
+            cursor_us += value_us;
+        }
+    }
+    if (root.end_us < 0) {
+        return -1;
+    }
+    // Time not covered by timers is left as self time of the root.
+    root.end_us = std::max(root.end_us, cursor_us);
+    request.spans.push_back(root);
+    request.spans.insert(request.spans.end(), spans.begin(), spans.end());
+    return 0;
+}
+
+// Returns 0 on success, -1 otherwise.
+static int parse_log(const std::string& content, std::vector<Request>& requests) {
+    std::istringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.find("total_t_ms=") == std::string::npos) {
+            continue;
+        }
+        Request request;
+        if (parse_log_line(line, request) == 0) {
+            if (request.id.empty()) {
+                request.id = "line:" + std::to_string(requests.size() + 1);
+            }
+            requests.push_back(std::move(request));
+        }
+    }
+    return 0;
+}
+
+// Parse what-if scenarios, e.g. `a:20,b:50%'.
+// Returns 0 on success, -1 otherwise.
+static int parse_scenarios(const std::string& spec, std::vector<Scenario>& scenarios) {
+    std::istringstream items(spec);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        const size_t colon = item.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == item.size()) {
+            fprintf(stderr, "Invalid what-if scenario [%s]\n", item.c_str());
+            return -1;
+        }
+        Scenario scenario{item, item.substr(0, colon), 0, 0};
+        std::string amount = item.substr(colon + 1);
+        char* end = nullptr;
+        const double value = strtod(amount.c_str(), &end);
+        if (*end == '%' && *(end + 1) == '\0') {
+            scenario.ratio = value / 100;
+        } else if (*end == '\0') {
+            scenario.delta_us = static_cast<int64_t>(value * 1000);
+        } else {
+            fprintf(stderr, "Invalid what-if scenario [%s]\n", item.c_str());
+            return -1;
+        }
+        scenarios.push_back(scenario);
+    }
+    return 0;
+}
+
+// Nearest rank percentile of sorted values.
+static int64_t percentile(const std::vector<int64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(p * sorted.size() + 0.999999);
+    rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+    return sorted[rank - 1];
+}
+
+static int64_t latency_percentile(std::vector<int64_t> latencies, double p) {
+    std::sort(latencies.begin(), latencies.end());
+    return percentile(latencies, p);
+}
+
+// Critical time of a step, averaged over requests around p50, i.e. latency
+// in [p40, p60], and requests at or above p99.
+struct Contribution {
+    std::string name;
+    double p50_ms;
+    double p99_ms;
+    // Ratio of requests on whose critical path the step is
+    double critical_ratio;
+};
+
+static void print_contributions(
+        const char* title,
+        const std::vector<std::unordered_map<std::string, int64_t>>& critical,
+        const std::vector<int64_t>& latencies,
+        double p50_ms,
+        double p99_ms) {
+    std::vector<int64_t> sorted(latencies);
+    std::sort(sorted.begin(), sorted.end());
+    const int64_t p40 = percentile(sorted, 0.4);
+    const int64_t p60 = percentile(sorted, 0.6);
+    const int64_t p99 = percentile(sorted, 0.99);
+    std::unordered_map<std::string, Contribution> rows;
+    size_t p50_count = 0;
+    size_t p99_count = 0;
+    for (size_t i = 0; i < critical.size(); ++i) {
+        const bool in_p50 = latencies[i] >= p40 && latencies[i] <= p60;
+        const bool in_p99 = latencies[i] >= p99;
+        p50_count += in_p50;
+        p99_count += in_p99;
+        for (const auto& item : critical[i]) {
+            if (item.second <= 0) {
+                continue;
+            }
+            Contribution& row = rows[item.first];
+            row.name = item.first;
+            row.critical_ratio += 1;
+            if (in_p50) {
+                row.p50_ms += item.second / 1000.0;
+            }
+            if (in_p99) {
+                row.p99_ms += item.second / 1000.0;
+            }
+        }
+    }
+    std::vector<Contribution> sorted_rows;
+    for (auto& item : rows) {
+        Contribution& row = item.second;
+        row.p50_ms /= std::max<size_t>(p50_count, 1);
+        row.p99_ms /= std::max<size_t>(p99_count, 1);
+        row.critical_ratio /= critical.size();
+        sorted_rows.push_back(row);
+    }
+    std::sort(sorted_rows.begin(), sorted_rows.end(),
+              [](const Contribution& a, const Contribution& b) {
+                  return a.p99_ms != b.p99_ms ? a.p99_ms > b.p99_ms : a.name < b.name;
+              });
+    printf("\n%s\n", title);
+    printf("%-48s %10s %7s %10s %7s %9s\n", "name", "p50(ms)", "share", "p99(ms)", "share",
+           "critical");
+    for (size_t i = 0; i < sorted_rows.size() && static_cast<int>(i) < FLAGS_top; ++i) {
+        const Contribution& row = sorted_rows[i];
+        printf("%-48s %10.2f %6.1f%% %10.2f %6.1f%% %8.1f%%\n", row.name.c_str(), row.p50_ms,
+               p50_ms > 0 ? row.p50_ms * 100 / p50_ms : 0, row.p99_ms,
+               p99_ms > 0 ? row.p99_ms * 100 / p99_ms : 0, row.critical_ratio * 100);
+    }
+}
+
+static int run(const std::vector<std::string>& paths) {
+    std::vector<Request> requests;
+    for (const auto& path : paths) {
+        std::string content;
+        if (read_file(path, content) != 0) {
+            fprintf(stderr, "Failed to read [%s]\n", path.c_str());
+            return -1;
+        }
+        std::string format = FLAGS_format;
+        if (format == "auto") {
+            const size_t first = content.find_first_not_of(" \t\r\n");
+            format = first != std::string::npos && content[first] == '{' ? "trace" : "log";
+        }
+        int ret = -1;
+        if (format == "trace") {
+            ret = parse_trace(path, content, requests);
+        } else if (format == "log") {
+            ret = parse_log(content, requests);
+        } else {
+            fprintf(stderr, "Unknown format [%s]\n", format.c_str());
+        }
+        if (ret != 0) {
+            return -1;
+        }
+    }
+    std::vector<Request> valid;
+    for (auto& request : requests) {
+        if (build_graph(request) == 0) {
+            valid.push_back(std::move(request));
+        }
+    }
+    if (valid.empty()) {
+        fprintf(stderr, "No request found\n");
+        return -1;
+    }
+
+    std::vector<int64_t> latencies;
+    std::vector<std::unordered_map<std::string, int64_t>> by_step;
+    std::vector<std::unordered_map<std::string, int64_t>> by_service;
+    std::set<std::string> services;
+    for (const auto& request : valid) {
+        Replay replay;
+        latencies.push_back(replay_request(request, nullptr, replay));
+        std::unordered_map<std::string, int64_t> critical_us;
+        walk_critical_path(request, replay, request.root, critical_us);
+        std::unordered_map<std::string, int64_t> service_us;
+        for (const auto& span : request.spans) {
+            const std::string service = span_service(span.name);
+            if (!service.empty()) {
+                services.insert(service);
+            }
+        }
+        for (const auto& item : critical_us) {
+            const std::string service = span_service(item.first);
+            if (!service.empty()) {
+                service_us[service] += item.second;
+            }
+        }
+        by_step.push_back(critical_us);
+        by_service.push_back(service_us);
+    }
+    const double p50_ms = latency_percentile(latencies, 0.5) / 1000.0;
+    const double p99_ms = latency_percentile(latencies, 0.99) / 1000.0;
+    printf("requests: %zu  p50: %.2f ms  p99: %.2f ms\n", valid.size(), p50_ms, p99_ms);
+    print_contributions("critical time by service", by_service, latencies, p50_ms, p99_ms);
+    print_contributions("critical time by step", by_step, latencies, p50_ms, p99_ms);
+
+    std::vector<Scenario> scenarios;
+    if (parse_scenarios(FLAGS_what_if, scenarios) != 0) {
+        return -1;
+    }
+    if (FLAGS_what_if_ms > 0) {
+        for (const auto& service : services) {
+            scenarios.push_back(Scenario{
+                    service + ":" + std::to_string(FLAGS_what_if_ms),
+                    service,
+                    FLAGS_what_if_ms * 1000LL,
+                    0});
+        }
+    }
+    if (scenarios.empty()) {
+        return 0;
+    }
+    printf("\nwhat-if estimates\n");
+    printf("%-48s %10s %9s %10s %9s\n", "scenario", "p50(ms)", "delta", "p99(ms)", "delta");
+    for (const auto& scenario : scenarios) {
+        std::vector<int64_t> estimated;
+        for (const auto& request : valid) {
+            Replay replay;
+            estimated.push_back(replay_request(request, &scenario, replay));
+        }
+        const double new_p50_ms = latency_percentile(estimated, 0.5) / 1000.0;
+        const double new_p99_ms = latency_percentile(estimated, 0.99) / 1000.0;
+        printf("%-48s %10.2f %9.2f %10.2f %9.2f\n", scenario.label.c_str(), new_p50_ms,
+               new_p50_ms - p50_ms, new_p99_ms, new_p99_ms - p99_ms);
+    }
+    return 0;
+}
+
+}  // namespace uskit
+
+int main(int argc, char* argv[]) {
+    GFLAGS_NS::ParseCommandLineFlags(&argc, &argv, true);
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s [flags] trace_or_log_file...\n", argv[0]);
+        return -1;
+    }
+    std::vector<std::string> paths(argv + 1, argv + argc);
+    return uskit::run(paths) == 0 ? 0 : -1;
+}